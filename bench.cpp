@@ -0,0 +1,329 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "utils/histogram.h"
+#include "utils/log.h"
+#include "utils/machine.h"
+#include "utils/timer.h"
+
+#include "db/include/interface.hpp"
+#include "db/include/query_processor.hpp"
+#include "db/include/workload.hpp"
+#include "db/factory.hpp"
+
+void ExitWithHint(const char* command) {
+  std::cerr << "Usage: " << command << " <methods> <workloads> [options]" << std::endl;
+  std::cerr << "Runs every method on every workload (both comma separated) for every combination of the swept options" << std::endl;
+  std::cerr << "Methods: contreap, sequential, pam, inplace (latest-only)" << std::endl;
+  std::cerr << "Options:" << std::endl;
+  std::cerr << "  -threads n,...: numbers of server side threads to sweep (default: number of CPU cores)" << std::endl;
+  std::cerr << "  -clients n,...: numbers of client side threads to sweep (default: 1)" << std::endl;
+  std::cerr << "  -batchsize b,...: batch sizes to sweep, for contreap and pam (default: 1000)" << std::endl;
+  std::cerr << "  -group g: number of queries a client interleaves, not for pam (default: 1)" << std::endl;
+  std::cerr << "  -cache n: cache the results of up to n ranges, contreap and sequential only (default: 0, i.e. off)" << std::endl;
+  std::cerr << "  -rates r,...: open-loop rates in transactions per second to sweep, 0 for a closed loop (default: 0)" << std::endl;
+  std::cerr << "  -poisson: Poisson arrivals at the open-loop rates instead of evenly spaced ones (default: off)" << std::endl;
+  std::cerr << "  -latest: answer queries on the newest readable version without ordering them (default: off)" << std::endl;
+  std::cerr << "  -repeat r: runs of every combination (default: 3)" << std::endl;
+  std::cerr << "  -format f: csv or json (default: csv)" << std::endl;
+  std::cerr << "  -output file: write the results to file (default: standard output)" << std::endl;
+  exit(0);
+}
+
+std::vector<std::string> methods;
+std::vector<std::string> workloads;
+std::vector<size_t> threads_list;
+std::vector<size_t> clients_list;
+std::vector<size_t> batch_sizes;
+std::vector<double> rates;
+DB::options opts;
+DB::arrivals arrivals;
+bool query_latest = false;
+size_t repeats = 3;
+std::string format = "csv";
+std::string output;
+
+std::vector<std::string> Split(const char* list) {
+  std::vector<std::string> items;
+  std::string s(list);
+  for (size_t start = 0; start <= s.size(); ) {
+    size_t end = s.find(',', start);
+    if (end == std::string::npos) { end = s.size(); }
+    if (end > start) { items.push_back(s.substr(start, end-start)); }
+    start = end+1; }
+  return items;
+}
+
+std::vector<size_t> SplitSizes(const char* list) {
+  std::vector<size_t> sizes;
+  for (const std::string& item : Split(list)) { sizes.push_back(std::stoul(item)); }
+  return sizes;
+}
+
+void ParseCommandLine(int argc, const char *argv[]) {
+  if (argc < 3) { ExitWithHint(argv[0]); }
+  methods = Split(argv[1]);
+  workloads = Split(argv[2]);
+  threads_list = { opts.num_threads };
+  clients_list = { opts.num_clients };
+  batch_sizes = { opts.batch_size };
+  rates = { 0 };
+  size_t argindex = 3;
+  while (argindex < argc && strncmp(argv[argindex], "-", 1) == 0) {
+    if (strcmp(argv[argindex], "-threads") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      threads_list = SplitSizes(argv[argindex]);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-clients") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      clients_list = SplitSizes(argv[argindex]);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-batchsize") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      batch_sizes = SplitSizes(argv[argindex]);
+      for (size_t& b : batch_sizes) { if (b == 0) { b = 1; } }
+      argindex++; }
+    else if (strcmp(argv[argindex], "-group") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      opts.query_group = std::stoi(argv[argindex]);
+      if (opts.query_group == 0) { opts.query_group = 1; }
+      argindex++; }
+    else if (strcmp(argv[argindex], "-cache") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      opts.cache_size = std::stoul(argv[argindex]);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-rates") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      rates.clear();
+      for (const std::string& item : Split(argv[argindex])) { rates.push_back(std::stod(item)); }
+      argindex++; }
+    else if (strcmp(argv[argindex], "-poisson") == 0) {
+      arrivals.poisson = true;
+      argindex++; }
+    else if (strcmp(argv[argindex], "-latest") == 0) {
+      query_latest = true;
+      argindex++; }
+    else if (strcmp(argv[argindex], "-repeat") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      repeats = std::stoul(argv[argindex]);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-format") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      format = argv[argindex];
+      if (format != "csv" && format != "json") { ExitWithHint(argv[0]); }
+      argindex++; }
+    else if (strcmp(argv[argindex], "-output") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      output = argv[argindex];
+      argindex++; }
+    else {
+      log_fatal("Unknown option '%s'", argv[argindex]);
+      ExitWithHint(argv[0]); } }
+  if (argindex != argc || methods.empty() || workloads.empty()) { ExitWithHint(argv[0]); }
+  for (const std::string& method : methods) {
+    if (method != "contreap" && method != "sequential" && method != "pam" && method != "inplace") {
+      log_fatal("Unknown method '%s'", method.c_str());
+      ExitWithHint(argv[0]); } }
+}
+
+// the setting and the measurements of one run
+struct run_result {
+  size_t method;
+  size_t workload;
+  size_t num_threads;
+  size_t num_clients;
+  size_t batch_size;
+  double rate; // 0 for a closed loop
+  size_t repeat;
+  bool ok;
+  double seconds;
+  uint64_t num_txs;
+  uint64_t num_queries; // the queries answered by clients
+  double latency_mean; // nanoseconds from push (intended send in an open loop) to return, the same below
+  uint64_t latency_p50;
+  uint64_t latency_p90;
+  uint64_t latency_p99;
+  uint64_t latency_p999;
+  uint64_t latency_max;
+  uint64_t update_p50; // open loop only, nanoseconds from the intended send until the call returns
+  uint64_t update_p99;
+  uint64_t update_max;
+  uint64_t lag_max; // open loop only, the largest delay of a send behind its intended time
+  uint64_t rss_base; // bytes resident before the backend is built
+  uint64_t rss_peak;
+};
+
+void Measure(const DB::Workload& w, run_result& res) {
+  DB::options run_opts = opts;
+  run_opts.num_threads = res.num_threads;
+  run_opts.num_clients = res.num_clients;
+  run_opts.batch_size = res.batch_size;
+  res.rss_base = utils::CurrentRSS();
+  DB::Interface* db = DB::Create(methods[res.method], run_opts);
+  DB::QueryProcessor* query_processor = db->Processor();
+  if (query_processor != nullptr) { query_processor->Measure(); }
+  db->Init(w.n, w.m, w.elems);
+
+  Timer tmr;
+  tmr.Start();
+  utils::Histogram updates;
+  if (res.rate > 0) {
+    DB::arrivals a = arrivals;
+    a.rate = res.rate;
+    a.seed = res.repeat+1;
+    res.lag_max = w.ReplayOpen(db, query_latest, a, updates); }
+  else { w.Replay(db, query_latest); }
+  db->Close();
+  res.seconds = tmr.End();
+  res.update_p50 = updates.percentile(0.5);
+  res.update_p99 = updates.percentile(0.99);
+  res.update_max = updates.max();
+
+  res.num_txs = w.m;
+  if (query_processor != nullptr) {
+    utils::Histogram latencies = query_processor->Latencies();
+    res.num_queries = latencies.count();
+    res.latency_mean = latencies.mean();
+    res.latency_p50 = latencies.percentile(0.5);
+    res.latency_p90 = latencies.percentile(0.9);
+    res.latency_p99 = latencies.percentile(0.99);
+    res.latency_p999 = latencies.percentile(0.999);
+    res.latency_max = latencies.max(); }
+  res.rss_peak = utils::PeakRSS();
+  res.ok = true;
+}
+
+// every run is forked, so that it starts from the same memory and its peak is its own;
+// the backends do not release their trees on close either
+void Run(const DB::Workload& w, run_result& res) {
+  int fds[2];
+  if (pipe(fds) != 0) { log_fatal("pipe failed: %s", strerror(errno)); exit(1); }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) { log_fatal("fork failed: %s", strerror(errno)); exit(1); }
+  if (pid == 0) {
+    close(fds[0]);
+    Measure(w, res);
+    bool written = write(fds[1], &res, sizeof(res)) == sizeof(res);
+    _exit(written ? 0 : 1); }
+  close(fds[1]);
+  run_result child = res;
+  bool received = read(fds[0], &child, sizeof(child)) == sizeof(child);
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  if (received && WIFEXITED(status) && WEXITSTATUS(status) == 0) { res = child; }
+  else { log_error("run of %s on %s failed", methods[res.method].c_str(), workloads[res.workload].c_str()); }
+}
+
+std::string Quote(const std::string& s) {
+  std::string quoted = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') { quoted += '\\'; }
+    quoted += c; }
+  return quoted + "\"";
+}
+
+void PrintCSV(std::ostream& os, const utils::Machine& machine, const std::vector<run_result>& results) {
+  os << "# host: " << machine.host << std::endl;
+  os << "# cpu: " << machine.cpu << std::endl;
+  os << "# cpus: " << machine.num_cpus << std::endl;
+  os << "# memory: " << machine.memory << std::endl;
+  os << "# kernel: " << machine.kernel << std::endl;
+  os << "# compiler: " << machine.compiler << std::endl;
+  os << "# date: " << machine.date << std::endl;
+  os << "method,workload,threads,clients,batchsize,rate,repeat,ok,seconds,txs,ktps,queries,"
+     << "latency_mean_ns,latency_p50_ns,latency_p90_ns,latency_p99_ns,latency_p999_ns,latency_max_ns,"
+     << "update_p50_ns,update_p99_ns,update_max_ns,lag_max_ns,rss_base_bytes,rss_peak_bytes" << std::endl;
+  for (const run_result& res : results) {
+    os << methods[res.method] << ',' << workloads[res.workload] << ',' << res.num_threads << ','
+       << res.num_clients << ',' << res.batch_size << ',' << res.rate << ',' << res.repeat << ',' << res.ok << ','
+       << res.seconds << ',' << res.num_txs << ',' << (res.ok ? res.num_txs / res.seconds / 1000 : 0) << ','
+       << res.num_queries << ',' << res.latency_mean << ',' << res.latency_p50 << ',' << res.latency_p90 << ','
+       << res.latency_p99 << ',' << res.latency_p999 << ',' << res.latency_max << ','
+       << res.update_p50 << ',' << res.update_p99 << ',' << res.update_max << ',' << res.lag_max << ','
+       << res.rss_base << ',' << res.rss_peak << std::endl; }
+}
+
+void PrintJSON(std::ostream& os, const utils::Machine& machine, const std::vector<run_result>& results) {
+  os << "{\n  \"machine\": {"
+     << "\"host\": " << Quote(machine.host) << ", \"cpu\": " << Quote(machine.cpu)
+     << ", \"cpus\": " << machine.num_cpus << ", \"memory\": " << machine.memory
+     << ", \"kernel\": " << Quote(machine.kernel) << ", \"compiler\": " << Quote(machine.compiler)
+     << ", \"date\": " << Quote(machine.date) << "},\n  \"runs\": [";
+  for (size_t i = 0; i < results.size(); i++) {
+    const run_result& res = results[i];
+    os << (i == 0 ? "\n" : ",\n") << "    {"
+       << "\"method\": " << Quote(methods[res.method]) << ", \"workload\": " << Quote(workloads[res.workload])
+       << ", \"threads\": " << res.num_threads << ", \"clients\": " << res.num_clients
+       << ", \"batchsize\": " << res.batch_size << ", \"rate\": " << res.rate << ", \"repeat\": " << res.repeat
+       << ", \"ok\": " << (res.ok ? "true" : "false") << ", \"seconds\": " << res.seconds
+       << ", \"txs\": " << res.num_txs << ", \"ktps\": " << (res.ok ? res.num_txs / res.seconds / 1000 : 0)
+       << ", \"queries\": " << res.num_queries
+       << ", \"latency_ns\": {\"mean\": " << res.latency_mean << ", \"p50\": " << res.latency_p50
+       << ", \"p90\": " << res.latency_p90 << ", \"p99\": " << res.latency_p99
+       << ", \"p999\": " << res.latency_p999 << ", \"max\": " << res.latency_max << "}"
+       << ", \"update_latency_ns\": {\"p50\": " << res.update_p50 << ", \"p99\": " << res.update_p99
+       << ", \"max\": " << res.update_max << "}, \"lag_max_ns\": " << res.lag_max
+       << ", \"rss_base_bytes\": " << res.rss_base << ", \"rss_peak_bytes\": " << res.rss_peak << "}"; }
+  os << "\n  ]\n}" << std::endl;
+}
+
+int main(int argc, const char *argv[]) {
+  ParseCommandLine(argc, argv);
+  utils::Machine machine = utils::Machine::Probe();
+
+  std::vector<run_result> results;
+  for (size_t wid = 0; wid < workloads.size(); wid++) {
+    DB::Workload w;
+    if (!w.Load(workloads[wid])) {
+      log_fatal("Cannot load workload '%s'", workloads[wid].c_str());
+      return 1; }
+    for (size_t mid = 0; mid < methods.size(); mid++) {
+      // only the batched backends take a batch size
+      bool batched = methods[mid] == "contreap" || methods[mid] == "pam";
+      for (size_t num_threads : threads_list) {
+        for (size_t num_clients : clients_list) {
+          for (size_t bid = 0; bid < (batched ? batch_sizes.size() : 1); bid++) {
+            for (double rate : rates) {
+              for (size_t repeat = 0; repeat < repeats; repeat++) {
+                run_result res{};
+                res.method = mid;
+                res.workload = wid;
+                res.num_threads = num_threads;
+                res.num_clients = num_clients;
+                res.batch_size = batched ? batch_sizes[bid] : 0;
+                res.rate = rate;
+                res.repeat = repeat;
+                log_info("%s on %s, threads %zu, clients %zu, batch size %zu, rate %g, run %zu", methods[mid].c_str(),
+                  workloads[wid].c_str(), num_threads, num_clients, res.batch_size, rate, repeat);
+                Run(w, res);
+                results.push_back(res); } } } } } }
+    delete[] w.elems;
+    delete[] w.txs; }
+
+  std::ofstream file;
+  if (!output.empty()) { file.open(output); }
+  std::ostream& os = output.empty() ? std::cout : file;
+  if (format == "json") { PrintJSON(os, machine, results); }
+  else { PrintCSV(os, machine, results); }
+
+  return 0;
+}
@@ -3,13 +3,18 @@
 #include <assert.h>
 #include "utils/log.h"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <thread>
 
 #include "db/include/interface.hpp"
+#include "db/include/memory_stats.hpp"
 #include "db/include/query_processor.hpp"
 
+#include "lib/alloc_count.hpp"
 #include "lib/parlay/parallel.h"
 
 namespace DB {
@@ -28,9 +33,14 @@ private:
   operation buffer_type_;
   size_t buffer_count_;
   uint64_t* buffer_;
+  uint64_t* buffer_cnts_;
 
   size_t version_submitted_;
   size_t version_committed_;
+  typename T::drained_list drained_; // the keys the last batch drained, removed by the next one
+
+  // the nodes each batch allocates, which copies of the paths do not tell apart here, so only with COUNT_ALLOCS
+  memory_stats stats_;
 
   // following data are shared with query processor
 
@@ -41,41 +51,68 @@ private:
     typename T::node_ptr t;
     root_list* prev;
     root_list* next;
+    size_t vid; // the position in the list, from 0
   };
 
   root_list* root_;
   root_list* root0_;
+  std::atomic<root_list*> base_; // the oldest root kept, the ones before it are freed by the compactor
   std::atomic_size_t num_versions_;
+  std::atomic_size_t version_readable_; // the version of the newest root
+
+  // following data are ownned by the compactor thread
+
+  static constexpr auto compaction_interval_ = std::chrono::milliseconds(10);
+
+  alignas(128) std::thread* compactor_;
+  std::atomic_bool compacting_;
+  root_list* compacted_;
+  size_t compacted_vid_;
+
+  alignas(128) std::atomic_size_t update_epoch_; // odd while the modifier reads the latest root
 
   alignas(128) uint8_t pad_[]; // padding to avoid false sharing
 
   void do_update_() {
+    update_epoch_.fetch_add(1, std::memory_order_seq_cst);
+    alloc_count::counts before = alloc_count::read();
     typename T::node_ptr t_new;
     switch (buffer_type_) {
       case operation::INSERT:
-        t_new = T::inserted(root_->t, version_committed_+1, buffer_count_, buffer_);
+        t_new = T::inserted(root_->t, version_committed_+1, buffer_count_, buffer_, buffer_cnts_, &drained_);
         break;
       case operation::DELETE:
-        t_new = T::deleted(root_->t, version_committed_+1, buffer_count_, buffer_);
+        t_new = T::deleted(root_->t, version_committed_+1, buffer_count_, buffer_, buffer_cnts_, &drained_);
         break;
       default:
         log_fatal("unknown type of operation");
         abort(); }
+    if constexpr (alloc_count::enabled) {
+      memory_stats::op_kind kind = buffer_type_ == operation::INSERT ? memory_stats::INSERT : memory_stats::DELETE;
+      uint64_t created = (alloc_count::read() - before).n[alloc_count::NODE_MADE];
+      stats_.num_versions++;
+      stats_.ops[kind] += buffer_count_;
+      stats_.created[kind] += created;
+      stats_.max_created = std::max(stats_.max_created, created); }
     version_committed_ += buffer_count_;
     buffer_count_ = 0;
     log_debug("commit version: %zu", version_committed_);
     log_debug("current size: %lu", t_new->aug);
-    root_->next = new root_list { version_committed_, t_new, root_, nullptr };
+    root_->next = new root_list { version_committed_, t_new, root_, nullptr, root_->vid + 1 };
     root_ = root_->next;
     num_versions_.fetch_add(1, std::memory_order_release);
+    version_readable_.store(version_committed_, std::memory_order_release);
+    update_epoch_.fetch_add(1, std::memory_order_release);
+    query_processor_->Advance(version_submitted_);
   }
 
-  void update_enbuffer_(operation type, uint64_t key) {
+  void update_enbuffer_(operation type, uint64_t key, uint64_t cnt = 1) {
     // clear buffer if another type of operations exist
     if (buffer_type_ != type) {
       do_update_();
       buffer_type_ = type; }
 
+    buffer_cnts_[buffer_count_] = cnt;
     buffer_[buffer_count_++] = key;
     version_submitted_++;
     if (buffer_count_ == batch_size_) { do_update_(); }
@@ -84,9 +121,15 @@ private:
   uint64_t process_range_query_(size_t ver, uint64_t l, uint64_t r) {
     static thread_local size_t cur_vid = 0;
     static thread_local size_t last_vid = 0;
-    static thread_local root_list* cur_root = root0_;
+    static thread_local root_list* cur_root = nullptr;
+
+    // a root before the base may be freed, so a cursor left behind it restarts from the base
+    root_list* base = base_.load(std::memory_order_seq_cst);
+    if (cur_root == nullptr || cur_vid < base->vid) {
+      cur_root = base;
+      cur_vid = base->vid; }
 
-    while (cur_root != root0_ && ver <= cur_root->prev->ver) {
+    while (cur_vid > base->vid && ver <= cur_root->prev->ver) {
       cur_vid--;
       cur_root = cur_root->prev; }
 
@@ -100,6 +143,48 @@ private:
     return T::range_estimate(cur_root->t, ver, l, r);
   }
 
+  // wait until the modifier leaves the update in progress, if any
+  void synchronize_update_() const {
+    size_t epoch = update_epoch_.load(std::memory_order_seq_cst);
+    if (epoch % 2 == 0) { return; }
+    while (update_epoch_.load(std::memory_order_acquire) == epoch) { std::this_thread::yield(); }
+  }
+
+  /* drops the roots older than the oldest version pinned by the query clients,
+   * and trims the version histories of the batches that no client can look into.
+   * The entries of the dropped roots are freed once no query in flight may still walk them */
+  void compact_() {
+    size_t wmark = query_processor_->OldestPinned();
+    size_t last_vid = num_versions_.load(std::memory_order_acquire);
+    typename T::retired_list retired;
+    root_list* base = compacted_;
+    while (compacted_vid_ < last_vid && compacted_->next->ver <= wmark) {
+      root_list* r = compacted_->next;
+      T::compact(r->t, compacted_->t, retired);
+      T::release(compacted_->t, r->t);
+      compacted_->t = nullptr;
+      compacted_ = r;
+      compacted_vid_++; }
+    if (compacted_ == base) { return; }
+    base_.store(compacted_, std::memory_order_seq_cst);
+    log_debug("compact before version %zu, retire %zu histories", compacted_->ver, retired.size());
+    query_processor_->Synchronize();
+    synchronize_update_();
+    T::release(retired);
+    while (base != compacted_) {
+      root_list* next = base->next;
+      delete base;
+      base = next; }
+  }
+
+  void compactor_thread_() {
+    log_debug("start compactor");
+    while (compacting_.load(std::memory_order_acquire)) {
+      compact_();
+      std::this_thread::sleep_for(compaction_interval_); }
+    log_debug("stop compactor");
+  }
+
   auto processor_function_() {
     return [this](size_t ver, uint64_t l, uint64_t r)->uint64_t { return process_range_query_(ver, l, r); };
   }
@@ -112,28 +197,68 @@ public:
     buffer_type_(operation::INSERT),
     buffer_count_(0),
     buffer_(new uint64_t[batch_size_]),
+    buffer_cnts_(new uint64_t[batch_size_]),
     version_submitted_(0),
     version_committed_(0),
     query_processor_(new QueryProcessorImpl(num_clients, processor_function_())),
     root_(nullptr),
     root0_(nullptr),
-    num_versions_(0)
+    base_(nullptr),
+    num_versions_(0),
+    version_readable_(0),
+    compactor_(nullptr),
+    compacting_(false),
+    compacted_(nullptr),
+    compacted_vid_(0),
+    update_epoch_(0)
   { }
 
   void Init(size_t n, size_t m, uint64_t* elems) override {
-    root_ = root0_ = new root_list{ 0, T::build(n, elems), nullptr, nullptr };
+    alloc_count::counts before = alloc_count::read();
+    root_ = root0_ = new root_list{ 0, T::build(n, elems), nullptr, nullptr, 0 };
+    base_.store(root0_, std::memory_order_release);
+    stats_.initial_nodes = (alloc_count::read() - before).n[alloc_count::NODE_MADE];
     log_debug("size of root0 %lu", root0_->t->aug);
     schd_ = new parlay::scheduler<parlay::WorkStealingJob>(num_threads_);
     query_processor_->Start();
+    compacted_ = root0_;
+    compacting_.store(true, std::memory_order_release);
+    compactor_ = new std::thread(&Batch::compactor_thread_, this);
   }
 
   void Close() override {
     if (buffer_count_ > 0) { do_update_(); }
     delete schd_;
+    compacting_.store(false, std::memory_order_release);
+    compactor_->join();
     query_processor_->Stop();
   }
 
+  QueryProcessor* Processor() override {
+    return query_processor_;
+  }
+
+  size_t Snapshot() override {
+    return version_readable_.load(std::memory_order_acquire);
+  }
+
+  // commits the partial batch, its queries wait for it otherwise
+  size_t Flush() override {
+    if (buffer_count_ > 0) { do_update_(); }
+    return 0;
+  }
+
+  bool MemoryStats(memory_stats& stats) override {
+    if (!alloc_count::enabled) { return false; }
+    stats = stats_;
+    stats.node_bytes = sizeof(typename T::node_t);
+    stats.latest_nodes = T::count_nodes(root_->t);
+    stats.released_nodes = alloc_count::read().n[alloc_count::NODE_RELEASED];
+    return true;
+  }
+
   int Query(uint64_t l, uint64_t r) override {
+    stats_.ops[memory_stats::QUERY]++;
     return query_processor_->Push(version_submitted_, l, r);
   }
 
@@ -146,6 +271,14 @@ public:
     update_enbuffer_(operation::DELETE, k);
     return 0;
   }
+
+  int Add(uint64_t k, int64_t delta) override {
+    if (delta > 0) { update_enbuffer_(operation::INSERT, k, delta); }
+    else if (delta < 0) { update_enbuffer_(operation::DELETE, k, -static_cast<uint64_t>(delta)); }
+    // a zero count with the buffered type still takes a version, as in the other backends, without ending the batch
+    else { update_enbuffer_(buffer_type_, k, 0); }
+    return 0;
+  }
 };
 
 }
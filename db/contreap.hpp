@@ -6,15 +6,23 @@
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <string_view>
+#include <vector>
 
 #include "db/include/interface.hpp"
+#include "db/include/memory_stats.hpp"
 #include "db/include/query_processor.hpp"
+#include "db/include/result_cache.hpp"
+#include "db/include/time_index.hpp"
 
 #include "lib/treap/augment.hpp"
 #include "lib/treap/build.hpp"
+#include "lib/treap/footprint.hpp"
+#include "lib/treap/interleave.hpp"
 #include "lib/treap/node.hpp"
 #include "lib/treap/query.hpp"
 #include "lib/treap/scheduler.hpp"
+#include "lib/treap/value.hpp"
 
 namespace DB {
 
@@ -26,50 +34,160 @@ private:
   const size_t block_size_;
 
   alignas(128) treap::scheduler* contreap_;
+  treap::value_arena values_;
+  TimeIndex times_; // recorded by the collector of the scheduler as the versions commit
+  const bool track_memory_; // kinds_ is kept for MemoryStats only then
+  std::vector<uint8_t> kinds_; // the kind of operation of every version, from version 1
 
-  alignas(128) QueryProcessor* query_processor_;
+  alignas(128) ResultCache* cache_; // null if the results are not cached
+  QueryProcessor* query_processor_;
 
   alignas(128) uint8_t pad_[]; // padding to avoid false sharing
 
   auto processor_function_() {
     return [this](size_t ver, uint64_t l, uint64_t r)->uint64_t {
+      uint64_t ret;
+      // a cached result saves waiting for the snapshot as well
+      if (cache_ != nullptr && cache_->lookup(ver, l, r, ret)) { return ret; }
       treap::node_ptr t = contreap_->get_snapshot(ver);
-      if (l == r) { return treap::find(t, l)->val; }
-      return treap::range_estimate(t, l, r); };
+      if (l == r) { treap::constnode_ptr t_l = treap::find(t, l); ret = t_l == nullptr ? 0 : t_l->val; }
+      else { ret = treap::range_estimate(t, l, r); }
+      if (cache_ != nullptr) { cache_->insert(ver, l, r, ret); }
+      return ret; };
+  }
+
+  // answers a group of queries with their traversals interleaved
+  auto group_function_() {
+    return [this](const QueryProcessor::query_context* qs, size_t n, uint64_t* rets) {
+      thread_local std::vector<treap::constnode_ptr> roots;
+      thread_local std::vector<uint64_t> ls, rs, misses, outs;
+      roots.resize(n); ls.resize(n); rs.resize(n); misses.resize(n); outs.resize(n);
+      size_t num_misses = 0;
+      for (size_t i = 0; i < n; i++) {
+        if (cache_ != nullptr && cache_->lookup(qs[i].ver, qs[i].l, qs[i].r, rets[i])) { continue; }
+        misses[num_misses] = i;
+        roots[num_misses] = contreap_->get_snapshot(qs[i].ver);
+        ls[num_misses] = qs[i].l;
+        rs[num_misses++] = qs[i].r; }
+      treap::range_estimate_interleaved(roots.data(), ls.data(), rs.data(), num_misses, outs.data());
+      for (size_t j = 0; j < num_misses; j++) {
+        const QueryProcessor::query_context& q = qs[misses[j]];
+        rets[misses[j]] = outs[j];
+        if (cache_ != nullptr) { cache_->insert(q.ver, q.l, q.r, outs[j]); } } };
+  }
+
+  // the kind of the next version, kept only when the memory is tracked
+  inline void kind_(uint8_t kind) {
+    if (track_memory_) { kinds_.push_back(kind); }
+  }
+
+  // stamp the version just issued, which updates key if touch
+  void stamp_(uint64_t key = 0, bool touch = true) {
+    size_t ver = contreap_->last_version();
+    if (cache_ != nullptr) { cache_->record(ver, key, touch); }
   }
 
 public:
-  explicit Contreap(size_t num_threads, size_t num_clients, size_t block_size) :
+  explicit Contreap(size_t num_threads, size_t num_clients, size_t block_size, size_t query_group = 1,
+      size_t cache_size = 0, bool track_memory = false) :
     num_threads_(num_threads),
     block_size_(block_size),
     contreap_(nullptr),
-    query_processor_(new QueryProcessorImpl(num_clients, processor_function_()))
+    track_memory_(track_memory),
+    cache_(cache_size > 0 ? new ResultCache(cache_size) : nullptr),
+    query_processor_(new QueryProcessorImpl(num_clients, processor_function_(), query_group, group_function_()))
   { }
 
   void Init(size_t n, size_t m, uint64_t* elems) override {
     treap::node_ptr t = treap::build_parallel(n, elems);
-    contreap_ = new treap::scheduler(num_threads_, m, block_size_, t);
+    times_.reserve(m+1);
+    times_.record(0);
+    contreap_ = new treap::scheduler(num_threads_, m, block_size_, t, [this](size_t ver) { times_.record(ver); });
+    if (track_memory_) { kinds_.reserve(m); }
     query_processor_->Start();
   }
 
   void Close() override {
+    contreap_->seal();
     contreap_->process();
     query_processor_->Stop();
     log_debug("final result: %lu", contreap_->get_snapshot(contreap_->last_version())->aug);
   }
 
+  QueryProcessor* Processor() override {
+    return query_processor_;
+  }
+
+  size_t Snapshot() override {
+    return contreap_->last_augmented();
+  }
+
+  // completes the block of the latest version with no-ops, which spend versions
+  size_t Flush() override {
+    size_t n = contreap_->block_padding();
+    for (size_t i = 0; i < n; i++) {
+      contreap_->nop();
+      kind_(memory_stats::QUERY);
+      stamp_(0, false); }
+    return n;
+  }
+
+  // every version is kept, and read once the pipeline has finished
+  bool MemoryStats(memory_stats& stats) override {
+    if (!track_memory_) { return false; }
+    size_t latest = contreap_->last_augmented();
+    stats.node_bytes = sizeof(treap::node_t);
+    stats.num_versions = latest;
+    for (size_t ver = 1; ver <= latest; ver++) {
+      size_t created = treap::count_created(contreap_->get_augmented_snapshot(ver), ver);
+      stats.ops[kinds_[ver-1]]++;
+      stats.created[kinds_[ver-1]] += created;
+      stats.max_created = std::max<uint64_t>(stats.max_created, created); }
+    stats.initial_nodes = treap::count_nodes(contreap_->get_augmented_snapshot(0));
+    stats.latest_nodes = treap::count_nodes(contreap_->get_augmented_snapshot(latest));
+    return true;
+  }
+
   int Query(uint64_t l, uint64_t r) override {
     size_t ver = contreap_->nop();
+    kind_(memory_stats::QUERY);
+    stamp_(0, false);
     return query_processor_->Push(ver, l, r);
   }
 
+  int QueryLatest(uint64_t l, uint64_t r) override {
+    return query_processor_->Push(contreap_->last_augmented(), l, r);
+  }
+
+  int QueryAt(uint64_t timestamp, uint64_t l, uint64_t r) override {
+    return query_processor_->Push(times_.lookup(timestamp), l, r);
+  }
+
   int Insert(uint64_t k) override {
     contreap_->insert_elem(k);
+    kind_(memory_stats::INSERT);
+    stamp_(k);
     return 0;
   }
 
   int Delete(uint64_t k) override {
     contreap_->delete_elem(k);
+    kind_(memory_stats::DELETE);
+    stamp_(k);
+    return 0;
+  }
+
+  int Add(uint64_t k, int64_t delta) override {
+    contreap_->add_elem(k, delta);
+    kind_(memory_stats::ADD);
+    stamp_(k, delta != 0);
+    return 0;
+  }
+
+  int Put(uint64_t k, std::string_view value) override {
+    contreap_->put_elem(k, values_.append(value));
+    kind_(memory_stats::PUT);
+    stamp_(k);
     return 0;
   }
 };
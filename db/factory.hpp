@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <thread>
+
+#include "db/include/interface.hpp"
+#include "db/include/retention.hpp"
+#include "db/batch.hpp"
+#include "db/contreap.hpp"
+#include "db/in_place.hpp"
+#include "db/sequential.hpp"
+#include "lib/pam/interface.hpp"
+
+namespace DB {
+
+struct options {
+  size_t num_threads = std::thread::hardware_concurrency();
+  size_t num_clients = 1;
+  size_t batch_size = 1000;
+  size_t query_group = 1;
+  size_t cache_size = 0;
+  retention_policy retention;
+  bool track_memory = false; // keeps the kind of every version for MemoryStats
+};
+
+// the backend named method, null if there is none
+inline Interface* Create(const std::string& method, const options& opts) {
+  if (method == "sequential") {
+    return new Sequential(opts.num_threads, opts.num_clients, opts.query_group, opts.retention, opts.cache_size,
+      opts.track_memory); }
+  if (method == "contreap") {
+    return new Contreap(opts.num_threads, opts.num_clients, opts.batch_size, opts.query_group, opts.cache_size,
+      opts.track_memory); }
+  if (method == "inplace") { return new InPlace(opts.num_clients, opts.query_group); }
+  if (method == "pam") { return new Batch<pam::interface>(opts.num_threads, opts.num_clients, opts.batch_size); }
+  return nullptr;
+}
+
+}
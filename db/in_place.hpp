@@ -0,0 +1,150 @@
+#pragma once
+
+#include <assert.h>
+#include "utils/log.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "include/interface.hpp"
+#include "include/query_processor.hpp"
+
+#include "lib/aes_hash.hpp"
+#include "lib/treap/augment.hpp"
+#include "lib/treap/build.hpp"
+#include "lib/treap/in_place.hpp"
+#include "lib/treap/interleave.hpp"
+#include "lib/treap/node.hpp"
+#include "lib/treap/query.hpp"
+#include "lib/treap/search_delete.hpp"
+#include "lib/treap/search_insert.hpp"
+#include "lib/treap/value.hpp"
+
+namespace DB {
+
+/* latest-only: no version is kept, a query reads the treap as of when it runs and sees a prefix of the updates
+ * (see treap/in_place.hpp). The updates are applied by the calling thread rather than through the pipeline of
+ * treap::scheduler: its steps copy the path of an update a level at a time, each owning the nodes it writes, while
+ * an in-place update rewrites the aggregates shared with the updates in flight around it, so that the steps would
+ * race on them. */
+class alignas(128) InPlace : public Interface {
+private:
+  static constexpr size_t retire_batch_ = 4096;
+
+  size_t num_versions_; // the number of updates, which stamps the nodes they copy
+  std::atomic<treap::node_ptr> root_;
+  treap::in_place_seq seq_;
+  std::vector<treap::node_ptr> retired_;
+  treap::value_arena values_;
+
+  alignas(128) QueryProcessor* query_processor_;
+
+  alignas(128) uint8_t pad_[]; // padding to avoid false sharing
+
+  auto processor_function_() {
+    return [this]([[maybe_unused]] size_t ver, uint64_t l, uint64_t r)->uint64_t {
+      // a single counter is the one of some prefix already
+      if (l == r) {
+        treap::constnode_ptr t_l = treap::find(root_.load(std::memory_order_acquire), l);
+        return t_l == nullptr ? 0 : treap::load_field(t_l->val); }
+      uint64_t ret;
+      seq_.read([&]() { ret = treap::range_estimate(root_.load(std::memory_order_acquire), l, r); });
+      return ret; };
+  }
+
+  // answers a group of queries with their traversals interleaved
+  auto group_function_() {
+    return [this](const QueryProcessor::query_context* qs, size_t n, uint64_t* rets) {
+      thread_local std::vector<treap::constnode_ptr> roots;
+      thread_local std::vector<uint64_t> ls, rs;
+      roots.resize(n); ls.resize(n); rs.resize(n);
+      for (size_t i = 0; i < n; i++) {
+        ls[i] = qs[i].l;
+        rs[i] = qs[i].r; }
+      seq_.read([&]() {
+        treap::constnode_ptr t = root_.load(std::memory_order_acquire);
+        for (size_t i = 0; i < n; i++) { roots[i] = t; }
+        treap::range_estimate_interleaved(roots.data(), ls.data(), rs.data(), n, rets); }); };
+  }
+
+  void release_retired_() {
+    query_processor_->Synchronize();
+    for (treap::node_ptr t : retired_) { treap::release_node(t); }
+    retired_.clear();
+  }
+
+  void update_(uint64_t k, uint64_t cnt, bool subtract, uint64_t ref = treap::ref_none) {
+    num_versions_++;
+    treap::node_ptr t = root_.load(std::memory_order_relaxed);
+    treap::constnode_ptr t_k = treap::find(t, k);
+    if (t_k != nullptr && (!subtract || t_k->val > cnt)) {
+      seq_.begin_write();
+      treap::add_in_place(t, k, subtract ? -static_cast<int64_t>(cnt) : static_cast<int64_t>(cnt), ref);
+      seq_.end_write();
+      return; }
+    if (t_k == nullptr && subtract) { return; }
+    treap::node_ptr t_new;
+    uint64_t pry = aes_hash::hash(k);
+    if (subtract) {
+      treap::replaced_by_search_delete(t, pry, k, cnt, retired_);
+      t_new = treap::search_delete(num_versions_, t, pry, k, cnt); }
+    else {
+      treap::replaced_by_search_insert(t, pry, k, retired_);
+      t_new = treap::search_insert(num_versions_, t, pry, k, cnt, ref); }
+    treap::augment(t_new);
+    root_.store(t_new, std::memory_order_release);
+    if (retired_.size() >= retire_batch_) { release_retired_(); }
+  }
+
+public:
+  explicit InPlace(size_t num_clients, size_t query_group = 1) :
+    num_versions_(0),
+    root_(nullptr),
+    query_processor_(new QueryProcessorImpl(num_clients, processor_function_(), query_group, group_function_()))
+  { }
+
+  void Init(size_t n, [[maybe_unused]] size_t m, uint64_t* elems) override {
+    root_.store(treap::build_parallel(n, elems), std::memory_order_release);
+    query_processor_->Start();
+  }
+
+  void Close() override {
+    query_processor_->Stop();
+    release_retired_();
+    [[maybe_unused]] treap::constnode_ptr t = root_.load(std::memory_order_acquire);
+    log_debug("final result: %lu", t == nullptr ? 0 : t->aug);
+  }
+
+  QueryProcessor* Processor() override {
+    return query_processor_;
+  }
+
+  int Query(uint64_t l, uint64_t r) override {
+    return query_processor_->Push(num_versions_, l, r);
+  }
+
+  int Insert(uint64_t k) override {
+    update_(k, 1, false);
+    return 0;
+  }
+
+  int Delete(uint64_t k) override {
+    update_(k, 1, true);
+    return 0;
+  }
+
+  int Add(uint64_t k, int64_t delta) override {
+    if (delta != 0) { update_(k, delta > 0 ? delta : -static_cast<uint64_t>(delta), delta < 0); }
+    return 0;
+  }
+
+  int Put(uint64_t k, std::string_view value) override {
+    update_(k, 0, false, values_.append(value));
+    return 0;
+  }
+};
+
+}
@@ -2,16 +2,39 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <string_view>
 
 namespace DB {
 
+class QueryProcessor;
+struct memory_stats;
+
 class Interface {
 public:
   virtual void Init(size_t n, size_t m, uint64_t* elems) = 0;
   virtual void Close() { }
   virtual int Query(uint64_t l, uint64_t r) = 0;
+  // answers on the newest version readable without waiting, unordered with the updates still in flight
+  virtual int QueryLatest(uint64_t l, uint64_t r) { return Query(l, r); }
+  /* answers on the newest version committed by timestamp (nanoseconds since the Unix epoch), only backends keeping
+   * every version support it */
+  virtual int QueryAt([[maybe_unused]] uint64_t timestamp, [[maybe_unused]] uint64_t l, [[maybe_unused]] uint64_t r) {
+    return -1;
+  }
   virtual int Insert(uint64_t key) = 0;
   virtual int Delete(uint64_t key) = 0;
+  virtual int Add(uint64_t key, int64_t delta) = 0; // the key is deleted once its counter reaches zero
+  // only backends in map mode support it
+  virtual int Put([[maybe_unused]] uint64_t key, [[maybe_unused]] std::string_view value) { return -1; }
+  // the clients answering the queries, for measurement, null if the backend answers them itself
+  virtual QueryProcessor* Processor() { return nullptr; }
+  // the newest version that reads without waiting, which any thread may call to push queries of its own
+  virtual size_t Snapshot() { return 0; }
+  /* makes the versions issued so far readable without waiting for more updates, e.g. those of a partial batch,
+   * and returns the versions it spent out of the capacity given to Init */
+  virtual size_t Flush() { return 0; }
+  // the memory spent on the versions (see memory_stats.hpp), called after Close, false if not supported or tracked
+  virtual bool MemoryStats([[maybe_unused]] memory_stats& stats) { return false; }
   virtual ~Interface() { }
 };
 
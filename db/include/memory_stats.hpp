@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#include "lib/alloc_count.hpp"
+
+namespace DB {
+
+/* The memory a backend spent on its versions, filled by Interface::MemoryStats after Close.
+ * The nodes a version created are counted from the nodes carrying its version, since an update copies a path
+ * from the root; a batched backend counts the allocations of each batch instead, which needs COUNT_ALLOCS. */
+struct memory_stats {
+  enum op_kind : uint8_t { QUERY, INSERT, DELETE, ADD, PUT, NUM_OPS };
+
+  size_t node_bytes = 0;
+  uint64_t num_versions = 0; // the versions written, a batch counts once
+  uint64_t ops[NUM_OPS] = {};
+  uint64_t created[NUM_OPS] = {}; // nodes created by the operations of each kind
+  uint64_t max_created = 0; // the most nodes a single version created
+  uint64_t initial_nodes = 0;
+  uint64_t latest_nodes = 0; // the nodes reachable from the latest version, which is all that stays live without history
+  uint64_t released_nodes = 0; // nodes reclaimed during the run, e.g. of the versions a retention policy dropped
+
+  uint64_t total_created() const {
+    uint64_t total = 0;
+    for (size_t k = 0; k < NUM_OPS; k++) { total += created[k]; }
+    return total;
+  }
+
+  // the nodes kept by every version still readable, the initial tree included
+  uint64_t retained() const {
+    return initial_nodes + total_created() - released_nodes;
+  }
+
+  /* the mean fraction of the nodes of a version it shares with the previous one, taking the size of a version
+   * as the mean of the initial and the latest sizes, which is exact as long as the size stays the same */
+  double sharing() const {
+    double size = (initial_nodes + latest_nodes) / 2.0;
+    if (num_versions == 0 || size == 0) { return 1; }
+    return std::max(0.0, 1 - double(total_created()) / num_versions / size);
+  }
+
+  void Print(std::ostream& os) const {
+    static const char* names[NUM_OPS] = { "query", "insert", "delete", "add", "put" };
+    const double mb = 1 << 20;
+    os << "# Memory accounting (nodes of " << node_bytes << " bytes)" << std::endl;
+    os << "versions\t" << num_versions << std::endl;
+    os << "# Nodes created per operation (kind, operations, nodes per operation, bytes per operation)" << std::endl;
+    for (size_t k = 0; k < NUM_OPS; k++) {
+      if (ops[k] == 0) { continue; }
+      double per_op = double(created[k]) / ops[k];
+      os << names[k] << '\t' << ops[k] << '\t' << per_op << '\t' << per_op * node_bytes << std::endl; }
+    os << "# Bytes per version (mean, max)" << std::endl;
+    os << (num_versions == 0 ? 0 : double(total_created()) * node_bytes / num_versions) << '\t'
+       << max_created * node_bytes << std::endl;
+    os << "# Nodes (initial, created, released, retained, live in the latest version, garbage without history)" << std::endl;
+    os << initial_nodes << '\t' << total_created() << '\t' << released_nodes << '\t' << retained() << '\t'
+       << latest_nodes << '\t' << retained() - std::min(retained(), latest_nodes) << std::endl;
+    os << "# Megabytes (retained, live, garbage)" << std::endl;
+    os << retained() * node_bytes / mb << '\t' << latest_nodes * node_bytes / mb << '\t'
+       << (retained() - std::min(retained(), latest_nodes)) * node_bytes / mb << std::endl;
+    os << "# Sharing between consecutive versions (approximate)" << std::endl;
+    os << sharing() << std::endl;
+    if constexpr (alloc_count::enabled) {
+      alloc_count::counts c = alloc_count::read();
+      os << "# Allocator (nodes made, copied, released, histories made, released, megabytes made, released)" << std::endl;
+      os << c.n[alloc_count::NODE_MADE] << '\t' << c.n[alloc_count::NODE_COPIED] << '\t'
+         << c.n[alloc_count::NODE_RELEASED] << '\t' << c.n[alloc_count::HISTORY_MADE] << '\t'
+         << c.n[alloc_count::HISTORY_RELEASED] << '\t' << c.n[alloc_count::BYTES_MADE] / mb << '\t'
+         << c.n[alloc_count::BYTES_RELEASED] / mb << std::endl; }
+  }
+};
+
+}
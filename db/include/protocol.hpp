@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "workload.hpp"
+
+/* The binary protocol of the server (server.cpp), in the byte order of the host since it is local only.
+ * A client sends requests and may pipeline any number of them without waiting. Every request is answered
+ * by a response with its id, in no particular order: the updates are answered once the writer has issued them,
+ * the queries once a query client has answered them. */
+namespace DB::protocol {
+
+enum opcode : uint8_t {
+  QUERY, // the count in [arg0, arg1] as of the version the query is issued at
+  INSERT, // arg0
+  DELETE, // arg0
+  ADD, // arg0 by the signed delta arg1
+  QUERY_LATEST, // as QUERY, on the newest readable version
+  QUERY_BATCH, // arg0 ranges follow the request, read on the same version and answered with ids id, id+1, ...
+  ATTACH, // sent with the memfd of a region of rings (see shm_ring.hpp), through which every response goes from then on
+  QUERY_AT // arg1 ranges follow the request, read on the newest version committed by time arg0 (nanoseconds since the
+           // Unix epoch) and answered with ids id, id+1, ...; an ERROR if the backend does not keep every version
+};
+
+enum status : uint8_t {
+  OK,
+  ERROR,
+  FULL // the backend has issued as many versions as it was built for
+};
+
+struct request {
+  uint32_t id;
+  uint8_t op;
+  uint8_t _[3];
+  uint64_t arg0;
+  uint64_t arg1;
+};
+
+struct range {
+  uint64_t l;
+  uint64_t r;
+};
+
+struct response {
+  uint32_t id;
+  uint8_t status;
+  uint8_t _[3];
+  uint64_t value; // the result of a query
+};
+
+static_assert(sizeof(request) == 24 && sizeof(range) == 16 && sizeof(response) == 16);
+
+constexpr size_t max_batch = 4096;
+
+// the ranges following a request, which has none unless a QUERY_BATCH or a QUERY_AT
+static inline size_t num_ranges(const request& req) {
+  if (req.op == QUERY_BATCH) { return req.arg0; }
+  if (req.op == QUERY_AT) { return req.arg1; }
+  return 0;
+}
+
+static inline bool has_ranges(const request& req) {
+  return req.op == QUERY_BATCH || req.op == QUERY_AT;
+}
+
+// the request of a transaction of a workload
+static inline request from_tx(uint32_t id, const tx_context& tx) {
+  static const uint8_t ops[] = { QUERY, INSERT, DELETE, ADD };
+  return request{ id, ops[tx.type], {}, tx.arg0, tx.arg1 };
+}
+
+}
@@ -1,61 +1,238 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
+#include "utils/histogram.h"
 #include "utils/log.h"
+#include "utils/perf.h"
 #include "lib/moodycamel/concurrentqueue.h"
 
 namespace DB {
 
 class QueryProcessor {
-private:
-  const size_t num_threads_;
-  std::thread* const threads_;
-
+public:
   struct query_context {
     size_t ver;
     size_t idx;
     uint64_t l;
     uint64_t r;
+    uint64_t sent; // the time of the push or the scheduled time, when measuring
+    uint64_t tag; // passed on with the result, see OnResult
   };
 
+  using result_callback = std::function<void(uint64_t tag, uint64_t ret)>;
+
+private:
+  const size_t num_threads_;
+  const size_t group_size_; // the number of queries a client takes at a time
+  std::thread* const threads_;
+
   size_t num_queries_;
   moodycamel::ConcurrentQueue<query_context> queries_;
   const moodycamel::ProducerToken producer_token_;
 
+  // the threads pushing queries besides the main producer, each with a queue of its own in queries_,
+  // which the clients then take from every queue instead of the main one only
+  struct alignas(128) producer_state {
+    moodycamel::ProducerToken token;
+    std::atomic_size_t pinned{0}; // the oldest version it may still push
+    size_t num_queries = 0;
+
+    explicit producer_state(moodycamel::ConcurrentQueue<query_context>& queries) : token(queries) { }
+  };
+
+  std::vector<producer_state*> producers_;
+
   struct result_context {
     size_t ver;
     uint64_t ret;
   };
 
   std::vector<result_context>* const results_;
+  utils::Histogram* const latencies_; // per client, in nanoseconds
+  bool measuring_;
+  uint64_t scheduled_; // the intended time of the queries pushed, 0 for the time of the push
+  uint64_t tag_; // the tag of the queries pushed
+  result_callback on_result_; // if set, the results go to it instead of results_
+
+  // the version of a query in flight is pinned until the query returns,
+  // an idle client pins the lower bound of the versions that may still be pushed
+
+  struct alignas(128) client_state {
+    std::atomic_size_t epoch{0}; // odd while a query is in flight
+    std::atomic_size_t pinned{0};
+    alignas(128) std::byte _[0];
+  };
+
+  client_state* const states_;
+  alignas(128) std::atomic_size_t ver_pushed_;
 
   std::atomic_bool working_;
 
   void process_(size_t id) {
     log_trace("start query processing");
+    utils::perf::thread_scope perf(utils::perf::CLIENT);
+    if (group_size_ > 1) { return process_group_(id); }
     query_context q;
-    while (working_.load(std::memory_order_acquire)) {
-      while (queries_.try_dequeue_from_producer(producer_token_, q)) {
+    client_state& state = states_[id-1];
+    moodycamel::ConsumerToken consumer_token(queries_);
+    // the queue is drained once more after stop, every query pushed before it is answered
+    for (bool working = true; working; ) {
+      working = working_.load(std::memory_order_acquire);
+      size_t ver_hint = ver_hint_();
+      while (producers_.empty() ? queries_.try_dequeue_from_producer(producer_token_, q) :
+          queries_.try_dequeue(consumer_token, q)) {
+        state.pinned.store(q.ver, std::memory_order_release);
+        state.epoch.fetch_add(1, std::memory_order_seq_cst);
         log_trace("client %zu processing query: <%zu, %lu, %lu>", id, q.ver, q.l, q.r);
-        results_[id-1].push_back(result_context{ q.idx, do_process_(q.ver, q.l, q.r) });
-        log_trace("client %zu return %lu", id, results_[id-1].back().ret); } }
+        uint64_t ret = do_process_(q.ver, q.l, q.r);
+        if (on_result_) { on_result_(q.tag, ret); }
+        else { results_[id-1].push_back(result_context{ q.idx, ret }); }
+        if (measuring_) { latencies_[id-1].record(Now() - q.sent); }
+        log_trace("client %zu return %lu", id, ret);
+        state.epoch.fetch_add(1, std::memory_order_release); }
+      state.pinned.store(ver_hint, std::memory_order_release); }
     log_trace("stop query processing");
   }
 
+  // takes up to group_size_ queries at a time and answers them together, pinning the oldest version among them
+  void process_group_(size_t id) {
+    std::vector<query_context> qs(group_size_);
+    std::vector<uint64_t> rets(group_size_);
+    client_state& state = states_[id-1];
+    moodycamel::ConsumerToken consumer_token(queries_);
+    for (bool working = true; working; ) {
+      working = working_.load(std::memory_order_acquire);
+      size_t ver_hint = ver_hint_();
+      size_t n;
+      while ((n = producers_.empty() ? queries_.try_dequeue_bulk_from_producer(producer_token_, qs.data(), group_size_) :
+          queries_.try_dequeue_bulk(consumer_token, qs.data(), group_size_)) > 0) {
+        size_t ver = qs[0].ver;
+        for (size_t i = 1; i < n; i++) { ver = std::min(ver, qs[i].ver); }
+        state.pinned.store(ver, std::memory_order_release);
+        state.epoch.fetch_add(1, std::memory_order_seq_cst);
+        log_trace("client %zu processing %zu queries from version %zu", id, n, ver);
+        do_process_group_(qs.data(), n, rets.data());
+        if (on_result_) { for (size_t i = 0; i < n; i++) { on_result_(qs[i].tag, rets[i]); } }
+        else { for (size_t i = 0; i < n; i++) { results_[id-1].push_back(result_context{ qs[i].idx, rets[i] }); } }
+        if (measuring_) {
+          uint64_t now = Now();
+          for (size_t i = 0; i < n; i++) { latencies_[id-1].record(now - qs[i].sent); } }
+        state.epoch.fetch_add(1, std::memory_order_release); }
+      state.pinned.store(ver_hint, std::memory_order_release); }
+    log_trace("stop query processing");
+  }
+
+  // a lower bound of the versions that may still be pushed, by any producer
+  inline size_t ver_hint_() const {
+    size_t ver = ver_pushed_.load(std::memory_order_acquire);
+    for (const producer_state* p : producers_) { ver = std::min(ver, p->pinned.load(std::memory_order_acquire)); }
+    return ver;
+  }
+
 protected:
   virtual uint64_t do_process_(size_t ver, uint64_t l, uint64_t r) = 0;
 
+  // answers n queries into rets, one after another unless a backend interleaves them
+  virtual void do_process_group_(const query_context* qs, size_t n, uint64_t* rets) {
+    for (size_t i = 0; i < n; i++) { rets[i] = do_process_(qs[i].ver, qs[i].l, qs[i].r); }
+  }
+
 public:
-  QueryProcessor(size_t num_threads) :
+  QueryProcessor(size_t num_threads, size_t group_size = 1) :
     num_threads_(num_threads),
+    group_size_(std::max<size_t>(group_size, 1)),
     threads_(new std::thread[num_threads]),
     num_queries_(0),
     queries_(),
     producer_token_(queries_),
     results_(new std::vector<result_context>[num_threads]),
+    latencies_(new utils::Histogram[num_threads]),
+    measuring_(false),
+    scheduled_(0),
+    tag_(0),
+    states_(new client_state[num_threads]),
+    ver_pushed_(0),
     working_(false) { }
 
+  // nanoseconds on the clock the latencies are measured with
+  static inline uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // time every query from its push to its return, called before Start
+  void Measure() {
+    measuring_ = true;
+  }
+
+  /* time the queries pushed from now on from time t (see Now) instead, the time an open-loop producer
+   * intended to send them, so that the delay of a late push is not omitted; 0 to time from the push again */
+  void Schedule(uint64_t t) {
+    scheduled_ = t;
+  }
+
+  // the latencies of the queries answered, valid after Stop
+  utils::Histogram Latencies() const {
+    utils::Histogram h;
+    for (size_t i = 0; i < num_threads_; i++) { h.merge(latencies_[i]); }
+    return h;
+  }
+
+  // the queries pushed by every producer, valid after Stop
+  inline size_t NumQueries() const {
+    size_t n = num_queries_;
+    for (const producer_state* p : producers_) { n += p->num_queries; }
+    return n;
+  }
+
+  // hand every result to f(tag, result) on the client thread answering it instead of keeping it, called before Start
+  void OnResult(result_callback f) {
+    on_result_ = std::move(f);
+  }
+
+  // the tag of the queries pushed from now on by the main producer
+  void Tag(uint64_t tag) {
+    tag_ = tag;
+  }
+
+  // the version of the latest query pushed, or the latest one promised by Advance, by the main producer
+  inline size_t LastPushed() const {
+    return ver_pushed_.load(std::memory_order_relaxed);
+  }
+
+  /* add n producers besides the thread calling Push(ver, l, r), which push from threads of their own by id,
+   * called before Start; returns the id of the first. A producer pins version 0 until it pins another one */
+  size_t AddProducers(size_t n) {
+    size_t first = producers_.size();
+    for (size_t i = 0; i < n; i++) { producers_.push_back(new producer_state(queries_)); }
+    return first;
+  }
+
+  inline size_t NumQueries(size_t producer) const {
+    return producers_[producer]->num_queries;
+  }
+
+  // promise that the producer will push no query older than ver from now on, which never goes back
+  void Pin(size_t producer, size_t ver) {
+    producers_[producer]->pinned.store(ver, std::memory_order_release);
+  }
+
+  int Push(size_t producer, size_t ver, uint64_t l, uint64_t r) {
+    producer_state& p = *producers_[producer];
+    p.num_queries++;
+    uint64_t sent = measuring_ ? Now() : 0;
+    if (queries_.enqueue(p.token, query_context{ ver, p.num_queries, l, r, sent, 0 })) { return 0; }
+    return ~0;
+  }
+
   void Start() {
     working_.store(true, std::memory_order_seq_cst);
     for (size_t thread_id = 1; thread_id <= num_threads_; ++thread_id) {
@@ -69,21 +246,54 @@ public:
 
   int Push(size_t ver, uint64_t l, uint64_t r) {
     num_queries_++;
-    if (queries_.enqueue(producer_token_, query_context{ ver, num_queries_, l, r })) { return 0; }
+    ver_pushed_.store(ver, std::memory_order_release);
+    uint64_t sent = !measuring_ ? 0 : scheduled_ != 0 ? scheduled_ : Now();
+    if (queries_.enqueue(producer_token_, query_context{ ver, num_queries_, l, r, sent, tag_ })) { return 0; }
     return ~0;
   }
+
+  // promise that no query older than ver will be pushed, called by the producer
+  void Advance(size_t ver) {
+    ver_pushed_.store(ver, std::memory_order_release);
+  }
+
+  // the oldest version that any client may still read
+  size_t OldestPinned() const {
+    size_t ver = ~size_t{0};
+    for (size_t i = 0; i < num_threads_; i++) {
+      ver = std::min(ver, states_[i].pinned.load(std::memory_order_acquire)); }
+    return ver;
+  }
+
+  // wait until every query in flight at the time of the call has returned
+  void Synchronize() const {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (size_t i = 0; i < num_threads_; i++) {
+      size_t epoch = states_[i].epoch.load(std::memory_order_seq_cst);
+      if (epoch % 2 == 0) { continue; }
+      while (states_[i].epoch.load(std::memory_order_acquire) == epoch) { std::this_thread::yield(); } }
+  }
 };
 
-template <typename F>
+// G, if given, answers a group of queries as do_process_group_
+template <typename F, typename G = std::nullptr_t>
 class alignas(128) QueryProcessorImpl : public QueryProcessor {
 private:
   F f_;
+  G g_;
+
 protected:
   virtual uint64_t do_process_(size_t ver, uint64_t l, uint64_t r) override {
     return f_(ver, l, r);
   }
+  virtual void do_process_group_(const query_context* qs, size_t n, uint64_t* rets) override {
+    if constexpr (std::is_same_v<G, std::nullptr_t>) { QueryProcessor::do_process_group_(qs, n, rets); }
+    else { g_(qs, n, rets); }
+  }
 public:
-  QueryProcessorImpl(size_t num_threads, F&& f) : QueryProcessor(num_threads), f_(f) { }
+  QueryProcessorImpl(size_t num_threads, F&& f) : QueryProcessor(num_threads), f_(f), g_() { }
+  QueryProcessorImpl(size_t num_threads, F&& f, size_t group_size, G&& g) :
+    QueryProcessor(num_threads, group_size), f_(f), g_(g) { }
 };
 
 }
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "lib/aes_hash.hpp"
+
+namespace DB {
+
+/* A bounded cache of range query results shared by the query clients.
+ * An entry holds the result of [l, r] on version ver, and is valid for the versions from ver up to checked.
+ * The writer records the key of every version in a ring; a lookup on a newer version scans the ring from checked,
+ * and extends checked if no update in between touches [l, r], so that every version is scanned once per entry.
+ * The entries and the ring slots are read optimistically under sequence numbers. */
+class ResultCache {
+private:
+  struct alignas(64) entry {
+    std::atomic_size_t seq{0}; // odd while the entry is written
+    std::atomic_uint64_t l{0};
+    std::atomic_uint64_t r{0};
+    std::atomic_size_t ver{~size_t{0}};
+    std::atomic_size_t checked{0};
+    std::atomic_uint64_t ret{0};
+  };
+
+  struct alignas(32) update {
+    std::atomic_size_t ver{~size_t{0}}; // ~0 while the slot is written
+    std::atomic_uint64_t key{0};
+    std::atomic_bool touch{false}; // false for a version that updates no key
+  };
+
+  const size_t entry_mask_;
+  const size_t update_mask_;
+  entry* const entries_;
+  update* const updates_;
+
+  static inline size_t round_up_(size_t n) {
+    size_t p = 1;
+    while (p < n) { p <<= 1; }
+    return p;
+  }
+
+  inline entry& entry_of_(uint64_t l, uint64_t r) const {
+    return entries_[aes_hash::hash(l ^ aes_hash::hash(r)) & entry_mask_];
+  }
+
+  // whether no version in (from, to] updates a key in [l, r], false if the ring does not cover them
+  bool clean_(uint64_t l, uint64_t r, size_t from, size_t to) const {
+    if (to - from > update_mask_) { return false; }
+    for (size_t ver = from+1; ver <= to; ver++) {
+      const update& u = updates_[ver & update_mask_];
+      if (u.ver.load(std::memory_order_acquire) != ver) { return false; }
+      bool touch = u.touch.load(std::memory_order_relaxed);
+      uint64_t key = u.key.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (u.ver.load(std::memory_order_relaxed) != ver) { return false; }
+      if (touch && l <= key && key <= r) { return false; } }
+    return true;
+  }
+
+  inline bool try_lock_(entry& e, size_t seq) {
+    if (seq % 2 != 0 || !e.seq.compare_exchange_strong(seq, seq+1, std::memory_order_acquire)) { return false; }
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+  }
+
+public:
+  ResultCache(size_t num_entries, size_t num_updates = size_t{1} << 16) :
+    entry_mask_(round_up_(num_entries) - 1),
+    update_mask_(round_up_(num_updates) - 1),
+    entries_(new entry[entry_mask_+1]),
+    updates_(new update[update_mask_+1]) { }
+
+  ~ResultCache() {
+    delete[] entries_;
+    delete[] updates_;
+  }
+
+  // version ver updates key, called by the writer for every version in order
+  void record(size_t ver, uint64_t key, bool touch = true) {
+    update& u = updates_[ver & update_mask_];
+    u.ver.store(~size_t{0}, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    u.key.store(key, std::memory_order_relaxed);
+    u.touch.store(touch, std::memory_order_relaxed);
+    u.ver.store(ver, std::memory_order_release);
+  }
+
+  // version ver updates no key
+  inline void record(size_t ver) {
+    record(ver, 0, false);
+  }
+
+  // the result of [l, r] on version ver if it is cached, which needs the version to be recorded
+  bool lookup(size_t ver, uint64_t l, uint64_t r, uint64_t& ret) {
+    entry& e = entry_of_(l, r);
+    size_t seq = e.seq.load(std::memory_order_acquire);
+    if (seq % 2 != 0) { return false; }
+    uint64_t e_l = e.l.load(std::memory_order_relaxed);
+    uint64_t e_r = e.r.load(std::memory_order_relaxed);
+    size_t e_ver = e.ver.load(std::memory_order_relaxed);
+    size_t e_checked = e.checked.load(std::memory_order_relaxed);
+    uint64_t e_ret = e.ret.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (e.seq.load(std::memory_order_relaxed) != seq) { return false; }
+    if (e_l != l || e_r != r || ver < e_ver) { return false; }
+    if (ver > e_checked) {
+      if (!clean_(l, r, e_checked, ver)) { return false; }
+      if (try_lock_(e, seq)) {
+        e.checked.store(ver, std::memory_order_relaxed);
+        e.seq.store(seq+2, std::memory_order_release); } }
+    ret = e_ret;
+    return true;
+  }
+
+  // cache the result of [l, r] on version ver, unless another client is writing the entry
+  void insert(size_t ver, uint64_t l, uint64_t r, uint64_t ret) {
+    entry& e = entry_of_(l, r);
+    size_t seq = e.seq.load(std::memory_order_relaxed);
+    if (!try_lock_(e, seq)) { return; }
+    e.l.store(l, std::memory_order_relaxed);
+    e.r.store(r, std::memory_order_relaxed);
+    e.ver.store(ver, std::memory_order_relaxed);
+    e.checked.store(ver, std::memory_order_relaxed);
+    e.ret.store(ret, std::memory_order_relaxed);
+    e.seq.store(seq+2, std::memory_order_release);
+  }
+};
+
+}
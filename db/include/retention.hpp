@@ -0,0 +1,134 @@
+#pragma once
+
+#include <assert.h>
+#include "utils/log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "query_processor.hpp"
+
+namespace DB {
+
+/* which versions stay queryable: the last keep_last versions are all kept,
+ * an older version is kept if it is a multiple of keep_every (none if 0) and no older than window seconds,
+ * besides the newest one beyond the window, which stands for the state at its start */
+struct retention_policy {
+  size_t keep_last = 1024;
+  size_t keep_every = 1;
+  double window = 0; // 0 for no limit
+
+  bool enabled() const { return keep_every != 1 || window > 0; }
+};
+
+/* Drops the versions of a persistent treap that the policy does not keep, and reclaims the nodes only they reach.
+ * The history is linear, so a node lives in the versions from the one that created it (its ver) up to the one
+ * that replaced it (before which it is killed). A killed node is dead once no kept version lies in that range.
+ * A query on a dropped version reads the newest kept version before it; the versions below the floor,
+ * i.e. the oldest kept one, are all dropped and read the floor instead. */
+template <typename N>
+class Retention {
+private:
+  using node_ptr = N*;
+  using clock = std::chrono::steady_clock;
+
+  const retention_policy policy_;
+  node_ptr* const roots_; // roots_[ver] of a dropped version is redirected to the root it reads
+  clock::time_point* const times_; // the time each version is created, for the window only
+
+  std::atomic_size_t floor_;
+  size_t classified_; // the versions up to it are either kept or dropped
+  std::deque<size_t> kept_; // the classified versions kept, in order
+  std::deque<std::pair<size_t, node_ptr>> killed_; // nodes with the versions killing them, in order
+  std::deque<std::pair<size_t, node_ptr>> protected_; // killed nodes still reached by a kept version
+  std::vector<node_ptr> dead_;
+  size_t released_; // the nodes released so far
+
+  // sort out the nodes killed by the version after the classified ones
+  void sort_killed_() {
+    for (; !killed_.empty() && killed_.front().first <= classified_+1; killed_.pop_front()) {
+      // dead unless a kept version lies in [created, killed)
+      if (kept_.empty() || kept_.back() < killed_.front().second->ver) { dead_.push_back(killed_.front().second); }
+      else { protected_.push_back(killed_.front()); } }
+  }
+
+  // classify the versions up to limit
+  void classify_(size_t limit) {
+    sort_killed_();
+    for (size_t ver = classified_+1; ver <= limit; ver++) {
+      if (policy_.keep_every != 0 && ver % policy_.keep_every == 0) { kept_.push_back(ver); }
+      else if (kept_.empty()) { floor_.store(ver+1, std::memory_order_release); }
+      else { std::atomic_ref<node_ptr>(roots_[ver]).store(roots_[kept_.back()], std::memory_order_release); }
+      classified_ = ver;
+      sort_killed_(); }
+  }
+
+  // move the floor to the newest kept version beyond the window
+  void expire_(clock::time_point now) {
+    auto start = now - std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(policy_.window));
+    while (kept_.size() > 1 && times_[kept_[1]] <= start) { kept_.pop_front(); }
+    size_t floor = kept_.empty() ? classified_+1 : kept_.front();
+    floor_.store(floor, std::memory_order_release);
+    for (; !protected_.empty() && protected_.front().first <= floor; protected_.pop_front()) {
+      dead_.push_back(protected_.front().second); }
+  }
+
+public:
+  Retention(const retention_policy& policy, node_ptr* roots, size_t num_versions) :
+    policy_(policy),
+    roots_(roots),
+    times_(policy.window > 0 ? new clock::time_point[num_versions+1] : nullptr),
+    floor_(0),
+    classified_(0),
+    released_(0) {
+    if (policy_.keep_every != 0) { kept_.push_back(0); }
+    if (times_ != nullptr) { times_[0] = clock::now(); }
+  }
+
+  ~Retention() {
+    delete[] times_;
+  }
+
+  inline bool enabled() const {
+    return policy_.enabled();
+  }
+
+  inline size_t released() const {
+    return released_;
+  }
+
+  // the root a query on ver reads
+  inline node_ptr root(size_t ver) const {
+    ver = std::max(ver, floor_.load(std::memory_order_acquire));
+    return std::atomic_ref<node_ptr>(roots_[ver]).load(std::memory_order_acquire);
+  }
+
+  // record version ver, which replaces the nodes killed (see replaced_by_search_insert)
+  void commit(size_t ver, const std::vector<node_ptr>& killed) {
+    if (times_ != nullptr) { times_[ver] = clock::now(); }
+    for (node_ptr t : killed) { killed_.emplace_back(ver, t); }
+  }
+
+  /* drops what the policy no longer keeps once latest is committed,
+   * and releases the dead nodes after every query in flight has returned */
+  void advance(size_t latest, QueryProcessor* query_processor) {
+    // the latest version is always kept, the next update is written over it
+    size_t keep_last = std::max<size_t>(policy_.keep_last, 1);
+    if (latest > keep_last) { classify_(latest - keep_last); }
+    if (times_ != nullptr) { expire_(clock::now()); }
+    if (dead_.empty()) { return; }
+    log_debug("retain from version %zu, release %zu nodes", floor_.load(std::memory_order_relaxed), dead_.size());
+    query_processor->Synchronize();
+    for (node_ptr t : dead_) { release_node(t); }
+    released_ += dead_.size();
+    dead_.clear();
+  }
+};
+
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <linux/futex.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "protocol.hpp"
+
+/* The shared-memory transport of the server (server.cpp), for the clients on the same host.
+ * A client creates a memfd holding a region of two rings, and sends it over its socket with an ATTACH request,
+ * which is answered with the doorbell of the server attached. The client then puts its requests on the request
+ * ring, which the writer of the server reads and issues itself, and takes the responses from the completion ring.
+ * Every ring has a single producer and a single consumer, the responders of the server take turns per connection.
+ * A side makes a system call only to wake the other one up when it sleeps on a futex. */
+namespace DB::shm {
+
+static_assert(std::atomic_uint32_t::is_always_lock_free && sizeof(std::atomic_uint32_t) == sizeof(uint32_t));
+
+constexpr uint32_t magic = 0x43545231;
+
+// the futexes are shared between processes, so not private
+static inline void futex_wait(std::atomic_uint32_t* word, uint32_t val, long timeout_ns) {
+  timespec ts{ timeout_ns / 1000000000, timeout_ns % 1000000000 };
+  syscall(SYS_futex, word, FUTEX_WAIT, val, &ts, nullptr, 0);
+}
+
+static inline void futex_wake(std::atomic_uint32_t* word) {
+  syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+struct ring_header {
+  alignas(64) std::atomic_uint32_t head; // the next slot to consume, by the consumer only
+  alignas(64) std::atomic_uint32_t tail; // the next slot to produce, by the producer only, and the futex of the consumer
+  std::atomic_uint32_t sleeping; // the consumer waits on tail
+};
+
+// the region of a client, followed by the slots of the request ring, then those of the completion ring
+struct region {
+  uint32_t magic;
+  uint32_t capacity; // slots of each ring, a power of two
+  ring_header requests; // a QUERY_BATCH of n takes n+1 slots, the ranges in arg0 and arg1 of the n after it
+  ring_header completions;
+};
+
+// the doorbell of the server, shared by its clients, on which the writer sleeps once no request is left
+struct doorbell {
+  alignas(64) std::atomic_uint32_t seq;
+  std::atomic_uint32_t sleeping;
+};
+
+static inline size_t region_size(uint32_t capacity) {
+  return sizeof(region) + size_t{capacity} * (sizeof(protocol::request) + sizeof(protocol::response));
+}
+
+// the capacity is passed by the server, which does not trust the one in the region after attaching it
+static inline protocol::request* request_slots(region* r) {
+  return reinterpret_cast<protocol::request*>(r + 1);
+}
+
+static inline protocol::response* completion_slots(region* r, uint32_t capacity) {
+  return reinterpret_cast<protocol::response*>(request_slots(r) + capacity);
+}
+
+static inline uint32_t free_slots(const ring_header& h, uint32_t capacity) {
+  return capacity - (h.tail.load(std::memory_order_relaxed) - h.head.load(std::memory_order_acquire));
+}
+
+// puts all n items or none, by the producer
+template <typename T>
+static inline bool push(ring_header& h, T* slots, uint32_t capacity, const T* items, size_t n) {
+  if (free_slots(h, capacity) < n) { return false; }
+  uint32_t tail = h.tail.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < n; i++) { slots[(tail + i) & (capacity - 1)] = items[i]; }
+  h.tail.store(tail + n, std::memory_order_release);
+  return true;
+}
+
+// takes up to max items, by the consumer
+template <typename T>
+static inline size_t pop(ring_header& h, const T* slots, uint32_t capacity, T* items, size_t max) {
+  uint32_t head = h.head.load(std::memory_order_relaxed);
+  size_t n = std::min<size_t>(h.tail.load(std::memory_order_acquire) - head, max);
+  for (size_t i = 0; i < n; i++) { items[i] = slots[(head + i) & (capacity - 1)]; }
+  h.head.store(head + n, std::memory_order_release);
+  return n;
+}
+
+// wakes the consumer up after a push, if it sleeps
+static inline void notify(ring_header& h) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (h.sleeping.load(std::memory_order_relaxed)) { futex_wake(&h.tail); }
+}
+
+// sleeps until the ring has items or the timeout passes, by the consumer
+static inline void wait(ring_header& h, long timeout_ns) {
+  h.sleeping.store(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  uint32_t tail = h.tail.load(std::memory_order_relaxed);
+  if (tail == h.head.load(std::memory_order_relaxed)) { futex_wait(&h.tail, tail, timeout_ns); }
+  h.sleeping.store(0, std::memory_order_relaxed);
+}
+
+// wakes the writer up after a push to a request ring, or a request queued otherwise, if it sleeps
+static inline void ring(doorbell& d) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (d.sleeping.load(std::memory_order_relaxed)) {
+    d.seq.fetch_add(1, std::memory_order_relaxed);
+    futex_wake(&d.seq); }
+}
+
+// sends the bytes with fd attached
+static inline ssize_t send_fd(int sock, const void* buf, size_t len, int fd) {
+  iovec iov{ const_cast<void*>(buf), len };
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr* c = CMSG_FIRSTHDR(&msg);
+  c->cmsg_level = SOL_SOCKET;
+  c->cmsg_type = SCM_RIGHTS;
+  c->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(c), &fd, sizeof(int));
+  return sendmsg(sock, &msg, MSG_NOSIGNAL);
+}
+
+// receives some bytes as read would, and the fd attached to them if any, -1 otherwise
+static inline ssize_t recv_fd(int sock, void* buf, size_t len, int* fd) {
+  iovec iov{ buf, len };
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t r = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  *fd = -1;
+  if (r <= 0) { return r; }
+  for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c)) {
+    if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) { memcpy(fd, CMSG_DATA(c), sizeof(int)); } }
+  return r;
+}
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <assert.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace DB {
+
+/* A monotonic index from wall-clock time (nanoseconds since the Unix epoch) to versions, recorded at commit.
+ * The commits that read the same time share an entry holding the newest of them, so the index takes an entry
+ * per tick of the coarse clock at most, without losing a version committed earlier in the tick.
+ * A lookup never returns a version committed after the time asked for. One thread records, while any thread
+ * may look up: the entries are published by the size, and the version of the last one is rewritten atomically. */
+class TimeIndex {
+private:
+  struct entry {
+    uint64_t ts; // the time read at the commit
+    uint64_t ver; // the newest version committed at ts
+  };
+
+  entry* entries_;
+  size_t capacity_;
+  std::atomic_size_t size_;
+
+  static inline uint64_t load_ver_(const entry& e) {
+    return std::atomic_ref<uint64_t>(const_cast<uint64_t&>(e.ver)).load(std::memory_order_acquire);
+  }
+
+public:
+  // the coarse clock costs a few nanoseconds, its resolution (a few milliseconds) bounds the size of the index
+  static inline uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+  TimeIndex() : entries_(nullptr), capacity_(0), size_(0) { }
+
+  ~TimeIndex() {
+    delete[] entries_;
+  }
+
+  // room for the versions 0 to capacity-1, before anything is recorded (untouched memory until then)
+  void reserve(size_t capacity) {
+    assert(size_.load(std::memory_order_relaxed) == 0);
+    delete[] entries_;
+    entries_ = new entry[capacity];
+    capacity_ = capacity;
+  }
+
+  // the versions up to ver are committed at time ts, which is clamped to stay monotonic
+  void record(size_t ver, uint64_t ts = now()) {
+    size_t n = size_.load(std::memory_order_relaxed);
+    if (n > 0) {
+      entry& last = entries_[n-1];
+      if (ver <= last.ver) { return; }
+      if (ts <= last.ts) {
+        std::atomic_ref<uint64_t>(last.ver).store(ver, std::memory_order_release);
+        return; } }
+    assert(n < capacity_);
+    entries_[n] = entry{ ts, ver };
+    size_.store(n+1, std::memory_order_release);
+  }
+
+  // the newest version committed at or before ts, 0 if none
+  size_t lookup(uint64_t ts) const {
+    size_t n = size_.load(std::memory_order_acquire);
+    const entry* it = std::upper_bound(entries_, entries_ + n, ts,
+      [](uint64_t ts, const entry& e) { return ts < e.ts; });
+    return it == entries_ ? 0 : load_ver_(*(it - 1));
+  }
+
+  inline size_t size() const {
+    return size_.load(std::memory_order_acquire);
+  }
+};
+
+}
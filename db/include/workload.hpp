@@ -0,0 +1,142 @@
+#pragma once
+
+#include "utils/log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/histogram.h"
+
+#include "interface.hpp"
+#include "query_processor.hpp"
+
+namespace DB {
+
+// a transaction as exported by ycsbc
+struct tx_context {
+  uint8_t type;
+  uint64_t arg0;
+  uint64_t arg1;
+};
+
+// the intended send times of an open-loop replay: rate transactions per second, evenly spaced or Poisson arrivals
+struct arrivals {
+  double rate = 0;
+  bool poisson = false;
+  uint64_t seed = 1;
+};
+
+// what a submitter thread of a concurrent replay did
+struct submitter_stats {
+  size_t num_queries = 0;
+  double seconds = 0;
+};
+
+/* A workload file: the number of records n, the number of transactions m,
+ * then n records and m transactions. */
+struct Workload {
+  size_t n = 0;
+  size_t m = 0;
+  uint64_t* elems = nullptr;
+  tx_context* txs = nullptr;
+
+  // false if the file cannot be read in full
+  bool Load(const std::string& filename) {
+    std::ifstream fs(filename, std::ios::binary);
+    if (!fs.read((char*)&n, sizeof(n)) || !fs.read((char*)&m, sizeof(m))) { return false; }
+    elems = new uint64_t[n];
+    txs = new tx_context[m];
+    if (!fs.read((char*)elems, n * sizeof(uint64_t))) { return false; }
+    return bool(fs.read((char*)txs, m * sizeof(tx_context)));
+  }
+
+  // issue the transactions to db in order, the queries on the latest version if query_latest
+  void Replay(Interface* db, bool query_latest = false) const {
+    for (size_t i = 0; i < m; i++) { issue_(db, txs[i], query_latest); }
+  }
+
+  /* issue the transactions at the times the arrivals intend, however long the previous ones took (an open loop),
+   * so that a stall delays the sends behind it in the measurements instead of omitting them.
+   * The queries are timed from their intended times by the query processor, if measuring, and the updates from
+   * theirs until their call returns into updates. Returns the largest lag of a send behind its time, in nanoseconds. */
+  uint64_t ReplayOpen(Interface* db, bool query_latest, const arrivals& a, utils::Histogram& updates) const {
+    QueryProcessor* query_processor = db->Processor();
+    std::mt19937_64 rng(a.seed);
+    std::exponential_distribution<double> gap(a.rate / 1e9);
+    const double interval = 1e9 / a.rate;
+    const uint64_t start = QueryProcessor::Now();
+    double offset = 0;
+    uint64_t max_lag = 0;
+    for (size_t i = 0; i < m; i++) {
+      uint64_t intended = start + uint64_t(offset);
+      offset += a.poisson ? gap(rng) : interval;
+      max_lag = std::max(max_lag, wait_until_(intended) - intended);
+      if (query_processor != nullptr) { query_processor->Schedule(intended); }
+      issue_(db, txs[i], query_latest);
+      if (txs[i].type != 0 /* QUERY */) { updates.record(QueryProcessor::Now() - intended); } }
+    if (query_processor != nullptr) { query_processor->Schedule(0); }
+    return max_lag;
+  }
+
+  /* issue the updates from the calling thread and the queries from num_submitters threads besides, the i-th query
+   * of the trace from submitter i % num_submitters, i.e. producer i of the query processor, which has to have
+   * added them (see QueryProcessor::AddProducers) before Init. A submitter pins the newest readable version
+   * (see Interface::Snapshot) for session queries at a time, as an independent reader session would. */
+  std::vector<submitter_stats> ReplayConcurrent(Interface* db, size_t num_submitters, size_t session) const {
+    QueryProcessor* query_processor = db->Processor();
+    std::vector<std::vector<size_t>> queries(num_submitters);
+    for (size_t i = 0, j = 0; i < m; i++) {
+      if (txs[i].type == 0 /* QUERY */) { queries[j++ % num_submitters].push_back(i); } }
+    std::vector<submitter_stats> stats(num_submitters);
+    std::vector<std::thread> submitters;
+    for (size_t id = 0; id < num_submitters; id++) {
+      submitters.emplace_back([&, id]() {
+        uint64_t start = QueryProcessor::Now();
+        size_t ver = 0;
+        for (size_t j = 0; j < queries[id].size(); j++) {
+          if (j % std::max<size_t>(session, 1) == 0) {
+            ver = db->Snapshot();
+            query_processor->Pin(id, ver); }
+          const tx_context& tx = txs[queries[id][j]];
+          query_processor->Push(id, ver, tx.arg0, tx.arg1); }
+        stats[id].num_queries = queries[id].size();
+        stats[id].seconds = (QueryProcessor::Now() - start) / 1e9; }); }
+    for (size_t i = 0; i < m; i++) {
+      if (txs[i].type != 0 /* QUERY */) { issue_(db, txs[i], false); } }
+    for (std::thread& t : submitters) { t.join(); }
+    return stats;
+  }
+
+private:
+  static void issue_(Interface* db, const tx_context& tx, bool query_latest) {
+    switch (tx.type) {
+      case 0 /* QUERY */:
+        if (query_latest) { db->QueryLatest(tx.arg0, tx.arg1); }
+        else { db->Query(tx.arg0, tx.arg1); }
+        break;
+      case 1 /* INSERT */: db->Insert(tx.arg0); break;
+      case 2 /* DELETE */: db->Delete(tx.arg0); break;
+      case 3 /* ADD */: db->Add(tx.arg0, static_cast<int64_t>(tx.arg1)); break;
+      default: log_fatal("Unknown Transaction Type %u", (unsigned)tx.type); }
+  }
+
+  // sleeps until shortly before t and spins the rest, returns the time it is then
+  static uint64_t wait_until_(uint64_t t) {
+    constexpr uint64_t spin = 50000; // nanoseconds, below the slack of a sleep
+    uint64_t now = QueryProcessor::Now();
+    if (now + spin < t) {
+      std::this_thread::sleep_for(std::chrono::nanoseconds(t - now - spin));
+      now = QueryProcessor::Now(); }
+    while (now < t) { now = QueryProcessor::Now(); }
+    return now;
+  }
+};
+
+}
@@ -5,17 +5,26 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <string_view>
+#include <vector>
 
 #include "include/interface.hpp"
+#include "include/memory_stats.hpp"
 #include "include/query_processor.hpp"
+#include "include/result_cache.hpp"
+#include "include/retention.hpp"
+#include "include/time_index.hpp"
 
 #include "lib/aes_hash.hpp"
 #include "lib/treap/augment.hpp"
 #include "lib/treap/build.hpp"
+#include "lib/treap/footprint.hpp"
+#include "lib/treap/interleave.hpp"
 #include "lib/treap/node.hpp"
 #include "lib/treap/query.hpp"
 #include "lib/treap/search_delete.hpp"
 #include "lib/treap/search_insert.hpp"
+#include "lib/treap/value.hpp"
 
 namespace DB {
 
@@ -24,29 +33,120 @@ private:
   const size_t num_threads_;
   std::atomic_size_t num_versions_;
   treap::node_ptr* roots_;
-
-  alignas(128) QueryProcessor* query_processor_;
+  treap::value_arena values_;
+  TimeIndex times_;
+  const bool track_memory_; // kinds_ is kept for MemoryStats only then
+  std::vector<uint8_t> kinds_; // the kind of operation of every version, from version 1
+
+  static constexpr size_t retention_interval_ = 1024; // the number of versions between two rounds of retention
+  const retention_policy retention_policy_;
+  Retention<treap::node_t>* retention_;
+  std::vector<treap::node_ptr> killed_;
+  // with retention, the nodes each version created and the initial tree are counted before they may be released
+  std::vector<uint32_t> created_;
+  size_t initial_nodes_;
+
+  // null if the results are not cached, which retention also disables since a dropped version reads an older one
+  alignas(128) ResultCache* cache_;
+  QueryProcessor* query_processor_;
 
   alignas(128) uint8_t pad_[]; // padding to avoid false sharing
 
   auto processor_function_() {
     return [this](size_t ver, uint64_t l, uint64_t r)->uint64_t {
+      uint64_t ret;
+      if (cache_ != nullptr && cache_->lookup(ver, l, r, ret)) { return ret; }
       while (num_versions_.load(std::memory_order_acquire) < ver) { }
-      if (l == r) { return treap::find(roots_[ver], l)->val; }
-      return treap::range_estimate(roots_[ver], l, r); };
+      treap::constnode_ptr t = root_(ver);
+      if (l == r) { treap::constnode_ptr t_l = treap::find(t, l); ret = t_l == nullptr ? 0 : t_l->val; }
+      else { ret = treap::range_estimate(t, l, r); }
+      if (cache_ != nullptr) { cache_->insert(ver, l, r, ret); }
+      return ret; };
+  }
+
+  inline treap::node_ptr root_(size_t ver) const {
+    return retention_ == nullptr ? roots_[ver] : retention_->root(ver);
+  }
+
+  // the kind of the next version, kept only when the memory is tracked
+  inline void kind_(uint8_t kind) {
+    if (track_memory_) { kinds_.push_back(kind); }
+  }
+
+  // the version ver is written, which updates key if touch and replaced the nodes in killed_
+  void commit_(size_t ver, uint64_t key = 0, bool touch = false) {
+    times_.record(ver);
+    if (cache_ != nullptr) { cache_->record(ver, key, touch); }
+    if (retention_ == nullptr) { return; }
+    created_.push_back(treap::count_created(roots_[ver], ver));
+    retention_->commit(ver, killed_);
+    killed_.clear();
+    if (ver % retention_interval_ == 0) { retention_->advance(ver, query_processor_); }
+  }
+
+  void insert_(uint64_t k, uint64_t cnt, uint64_t ref = treap::ref_none) {
+    size_t ver = 1+num_versions_.fetch_add(1, std::memory_order_release);
+    uint64_t pry = aes_hash::hash(k);
+    if (retention_ != nullptr) { treap::replaced_by_search_insert(roots_[ver-1], pry, k, killed_); }
+    roots_[ver] = treap::search_insert(ver, roots_[ver-1], pry, k, cnt, ref);
+    treap::augment(roots_[ver]);
+    commit_(ver, k, true);
+  }
+
+  void delete_(uint64_t k, uint64_t cnt) {
+    size_t ver = 1+num_versions_.fetch_add(1, std::memory_order_release);
+    uint64_t pry = aes_hash::hash(k);
+    if (retention_ != nullptr) { treap::replaced_by_search_delete(roots_[ver-1], pry, k, cnt, killed_); }
+    roots_[ver] = treap::search_delete(ver, roots_[ver-1], pry, k, cnt);
+    treap::augment(roots_[ver]);
+    commit_(ver, k, true);
+  }
+
+  // answers a group of queries with their traversals interleaved
+  auto group_function_() {
+    return [this](const QueryProcessor::query_context* qs, size_t n, uint64_t* rets) {
+      thread_local std::vector<treap::constnode_ptr> roots;
+      thread_local std::vector<uint64_t> ls, rs, misses, outs;
+      roots.resize(n); ls.resize(n); rs.resize(n); misses.resize(n); outs.resize(n);
+      size_t num_misses = 0;
+      for (size_t i = 0; i < n; i++) {
+        if (cache_ != nullptr && cache_->lookup(qs[i].ver, qs[i].l, qs[i].r, rets[i])) { continue; }
+        while (num_versions_.load(std::memory_order_acquire) < qs[i].ver) { }
+        misses[num_misses] = i;
+        roots[num_misses] = root_(qs[i].ver);
+        ls[num_misses] = qs[i].l;
+        rs[num_misses++] = qs[i].r; }
+      treap::range_estimate_interleaved(roots.data(), ls.data(), rs.data(), num_misses, outs.data());
+      for (size_t j = 0; j < num_misses; j++) {
+        const QueryProcessor::query_context& q = qs[misses[j]];
+        rets[misses[j]] = outs[j];
+        if (cache_ != nullptr) { cache_->insert(q.ver, q.l, q.r, outs[j]); } } };
   }
 
 public:
-  explicit Sequential(size_t num_threads, size_t num_clients) :
+  explicit Sequential(size_t num_threads, size_t num_clients, size_t query_group = 1,
+      const retention_policy& retention = retention_policy(), size_t cache_size = 0, bool track_memory = false) :
     num_threads_(num_threads),
     num_versions_(0),
     roots_(nullptr),
-    query_processor_(new QueryProcessorImpl(num_clients, processor_function_()))
+    track_memory_(track_memory),
+    retention_policy_(retention),
+    retention_(nullptr),
+    initial_nodes_(0),
+    cache_(cache_size > 0 && !retention.enabled() ? new ResultCache(cache_size) : nullptr),
+    query_processor_(new QueryProcessorImpl(num_clients, processor_function_(), query_group, group_function_()))
   { }
 
   void Init(size_t n, size_t m, uint64_t* elems) override {
     roots_ = new treap::node_ptr[m+1];
     roots_[0] = treap::build_parallel(n, elems);
+    times_.reserve(m+1);
+    times_.record(0);
+    if (track_memory_) { kinds_.reserve(m); }
+    if (retention_policy_.enabled()) {
+      retention_ = new Retention<treap::node_t>(retention_policy_, roots_, m);
+      created_.reserve(m);
+      initial_nodes_ = treap::count_nodes(roots_[0]); }
     query_processor_->Start();
   }
 
@@ -55,23 +155,74 @@ public:
     log_debug("final result: %lu", roots_[num_versions_]->aug);
   }
 
+  QueryProcessor* Processor() override {
+    return query_processor_;
+  }
+
+  // version ver is written once the next one is issued
+  size_t Snapshot() override {
+    size_t ver = num_versions_.load(std::memory_order_acquire);
+    return ver == 0 ? 0 : ver-1;
+  }
+
+  bool MemoryStats(memory_stats& stats) override {
+    if (!track_memory_) { return false; }
+    size_t latest = num_versions_.load();
+    stats.node_bytes = sizeof(treap::node_t);
+    stats.num_versions = latest;
+    for (size_t ver = 1; ver <= latest; ver++) {
+      size_t created = retention_ == nullptr ? treap::count_created(roots_[ver], ver) : created_[ver-1];
+      stats.ops[kinds_[ver-1]]++;
+      stats.created[kinds_[ver-1]] += created;
+      stats.max_created = std::max<uint64_t>(stats.max_created, created); }
+    stats.initial_nodes = retention_ == nullptr ? treap::count_nodes(roots_[0]) : initial_nodes_;
+    stats.latest_nodes = treap::count_nodes(roots_[latest]);
+    stats.released_nodes = retention_ == nullptr ? 0 : retention_->released();
+    return true;
+  }
+
   int Query(uint64_t l, uint64_t r) override {
     size_t ver = 1+num_versions_.fetch_add(1, std::memory_order_release);
+    kind_(memory_stats::QUERY);
     roots_[ver] = roots_[ver-1];
+    commit_(ver);
     return query_processor_->Push(ver, l, r);
   }
 
+  int QueryLatest(uint64_t l, uint64_t r) override {
+    return query_processor_->Push(num_versions_.load(std::memory_order_relaxed), l, r);
+  }
+
+  int QueryAt(uint64_t timestamp, uint64_t l, uint64_t r) override {
+    return query_processor_->Push(times_.lookup(timestamp), l, r);
+  }
+
   int Insert(uint64_t k) override {
-    size_t ver = 1+num_versions_.fetch_add(1, std::memory_order_release);
-    roots_[ver] = treap::search_insert(ver, roots_[ver-1], aes_hash::hash(k), k);
-    treap::augment(roots_[ver]);
+    kind_(memory_stats::INSERT);
+    insert_(k, 1);
     return 0;
   }
 
   int Delete(uint64_t k) override {
-    size_t ver = 1+num_versions_.fetch_add(1, std::memory_order_release);
-    roots_[ver] = treap::search_delete(ver, roots_[ver-1], aes_hash::hash(k), k);
-    treap::augment(roots_[ver]);
+    kind_(memory_stats::DELETE);
+    delete_(k, 1);
+    return 0;
+  }
+
+  int Add(uint64_t k, int64_t delta) override {
+    kind_(memory_stats::ADD);
+    if (delta > 0) { insert_(k, delta); }
+    else if (delta < 0) { delete_(k, -static_cast<uint64_t>(delta)); }
+    else {
+      size_t ver = 1+num_versions_.fetch_add(1, std::memory_order_release);
+      roots_[ver] = roots_[ver-1];
+      commit_(ver); }
+    return 0;
+  }
+
+  int Put(uint64_t k, std::string_view value) override {
+    kind_(memory_stats::PUT);
+    insert_(k, 0, values_.append(value));
     return 0;
   }
 };
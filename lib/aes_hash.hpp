@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <random>
 #include <type_traits>
 #include <x86intrin.h>
@@ -13,12 +15,17 @@ private:
     return _mm_set_epi32(_rand(), _rand(), _rand(), _rand());
   }
 
+  // the round keys of hash64, shared with hash_many
+  static inline const __m128i* keys64() {
+    static const __m128i _keys[2] = { aes_keygen(), aes_keygen() };
+    return _keys;
+  }
+
   static inline uint64_t hash64(uint64_t x) {
-    static const __m128i _key = aes_keygen();
-    static const __m128i _key64 = aes_keygen();
+    const __m128i* keys = keys64();
     __m128i r = _mm_set1_epi64x(x);
-    r = _mm_aesenc_si128(r, _key);
-    r = _mm_aesenc_si128(r, _key64);
+    r = _mm_aesenc_si128(r, keys[0]);
+    r = _mm_aesenc_si128(r, keys[1]);
     return *reinterpret_cast<uint64_t*>(&r);
   }
 
@@ -36,6 +43,15 @@ private:
     return *reinterpret_cast<uint16_t*>(&r);
   }
 
+  // 128-bit keys (e.g. composite ones) are hashed down to 64 bits
+  static inline uint64_t hash128(__m128i x) {
+    static const __m128i _key = aes_keygen();
+    static const __m128i _key128 = aes_keygen();
+    __m128i r = _mm_aesenc_si128(x, _key);
+    r = _mm_aesenc_si128(r, _key128);
+    return _mm_cvtsi128_si64(_mm_xor_si128(r, _mm_unpackhi_epi64(r, r)));
+  }
+
   static inline uint8_t hash8(uint8_t x) {
     static const __m128i _key = aes_keygen();
     __m128i r = _mm_set1_epi8(x);
@@ -44,12 +60,81 @@ private:
   }
 
 public:
+  // the number of 64-bit keys that hash_many hashes per instruction
+#if defined(__VAES__) && defined(__AVX512F__)
+  static constexpr size_t batch_width = 4;
+#elif defined(__VAES__) && defined(__AVX2__)
+  static constexpr size_t batch_width = 2;
+#else
+  static constexpr size_t batch_width = 1;
+#endif
+
+  /* hashes n 64-bit keys into out, out[i] == hash(xs[i])
+   * with VAES every 128-bit lane runs the rounds of hash64 on one key, otherwise the keys are hashed one by one */
+  static inline void hash_many(const uint64_t* xs, size_t n, uint64_t* out) {
+    const __m128i* keys = keys64();
+    size_t i = 0;
+#if defined(__VAES__) && defined(__AVX512F__)
+    // the zero-masking forms throughout: the plain ones pass an undefined register through, which GCC flags as used
+    // uninitialized under -Wall
+    const __m512i key0 = _mm512_maskz_broadcast_i32x4(0xFFFF, keys[0]);
+    const __m512i key1 = _mm512_maskz_broadcast_i32x4(0xFFFF, keys[1]);
+    const __m512i dup = _mm512_set_epi64(3, 3, 2, 2, 1, 1, 0, 0);
+    const __m512i low = _mm512_set_epi64(6, 4, 2, 0, 6, 4, 2, 0);
+    // the four keys at p in the low half, the upper half zeroed
+    auto load4 = [](const uint64_t* p) {
+      return _mm512_maskz_inserti64x4(0xFF, _mm512_setzero_si512(), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), 0); };
+    auto permute = [](__m512i idx, __m512i r) { return _mm512_maskz_permutexvar_epi64(0xFF, idx, r); };
+    for (; i + 8 <= n; i += 8) {
+      // two independent vectors keep both AES units busy
+      __m512i r0 = permute(dup, load4(xs + i));
+      __m512i r1 = permute(dup, load4(xs + i + 4));
+      r0 = _mm512_aesenc_epi128(r0, key0);
+      r1 = _mm512_aesenc_epi128(r1, key0);
+      r0 = _mm512_aesenc_epi128(r0, key1);
+      r1 = _mm512_aesenc_epi128(r1, key1);
+      _mm512_mask_storeu_epi64(out + i, 0x0F, permute(low, r0));
+      _mm512_mask_storeu_epi64(out + i + 4, 0x0F, permute(low, r1)); }
+    for (; i + 4 <= n; i += 4) {
+      __m512i r = permute(dup, load4(xs + i));
+      r = _mm512_aesenc_epi128(r, key0);
+      r = _mm512_aesenc_epi128(r, key1);
+      _mm512_mask_storeu_epi64(out + i, 0x0F, permute(low, r)); }
+#elif defined(__VAES__) && defined(__AVX2__)
+    const __m256i key0 = _mm256_broadcastsi128_si256(keys[0]);
+    const __m256i key1 = _mm256_broadcastsi128_si256(keys[1]);
+    for (; i + 2 <= n; i += 2) {
+      __m256i r = _mm256_permute4x64_epi64(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(xs + i))), 0x50);
+      r = _mm256_aesenc_epi128(r, key0);
+      r = _mm256_aesenc_epi128(r, key1);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm256_castsi256_si128(_mm256_permute4x64_epi64(r, 0x08))); }
+#endif
+    for (; i < n; i++) { out[i] = hash64(xs[i]); }
+  }
+
+  // hashes a byte string of any length block by block, the length is mixed in first
+  static inline uint64_t hash_bytes(const char* data, size_t len) {
+    static const __m128i _key = aes_keygen();
+    static const __m128i _keyfin = aes_keygen();
+    __m128i r = _mm_set_epi64x(0, len);
+    for (; len >= sizeof(__m128i); data += sizeof(__m128i), len -= sizeof(__m128i)) {
+      r = _mm_aesenc_si128(_mm_xor_si128(r, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data))), _key); }
+    if (len > 0) {
+      alignas(16) char tail[sizeof(__m128i)] = { };
+      std::memcpy(tail, data, len);
+      r = _mm_aesenc_si128(_mm_xor_si128(r, _mm_load_si128(reinterpret_cast<const __m128i*>(tail))), _key); }
+    r = _mm_aesenc_si128(r, _keyfin);
+    return _mm_cvtsi128_si64(_mm_xor_si128(r, _mm_unpackhi_epi64(r, r)));
+  }
+
   template <typename T>
   static inline auto hash(T x) {
     if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, int8_t>) { return hash8(x); }
     else if constexpr (std::is_same_v<T, uint16_t> || std::is_same_v<T, int16_t>) { return hash16(x); }
     else if constexpr (std::is_same_v<T, uint32_t> || std::is_same_v<T, int32_t>) { return hash32(x); }
     else if constexpr (std::is_same_v<T, uint64_t> || std::is_same_v<T, int64_t>) { return hash64(x); }
+    else if constexpr (sizeof(T) == sizeof(__m128i) && std::is_trivially_copyable_v<T>) {
+      return hash128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&x))); }
     else { return std::void_t<T>(); }
   }
 }; // class aes_hash
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/* Counters of the nodes (and PAM histories) allocated and released, for measurement.
+ * They are compiled in only if COUNT_ALLOCS is defined before any treap or PAM header is included
+ * (by every translation unit of a program alike), otherwise counting costs nothing.
+ * Every thread counts into a slot of its own without atomic read-modify-writes, and a reader sums the slots. */
+namespace alloc_count {
+
+enum kind : size_t {
+  NODE_MADE, // every node allocated, copies included
+  NODE_COPIED,
+  NODE_RELEASED,
+  HISTORY_MADE, // PAM only
+  HISTORY_RELEASED,
+  BYTES_MADE, // of the nodes and the histories
+  BYTES_RELEASED,
+  NUM_KINDS
+};
+
+struct counts {
+  uint64_t n[NUM_KINDS] = {};
+
+  inline uint64_t allocations() const { return n[NODE_MADE] + n[HISTORY_MADE]; }
+  inline uint64_t releases() const { return n[NODE_RELEASED] + n[HISTORY_RELEASED]; }
+
+  counts operator-(const counts& other) const {
+    counts diff;
+    for (size_t k = 0; k < NUM_KINDS; k++) { diff.n[k] = n[k] - other.n[k]; }
+    return diff;
+  }
+};
+
+#ifdef COUNT_ALLOCS
+
+constexpr bool enabled = true;
+
+// threads beyond this many share slots, and may lose counts
+constexpr size_t max_slots = 1024;
+
+struct alignas(64) slot {
+  std::atomic_uint64_t n[NUM_KINDS];
+};
+
+inline slot slots[max_slots];
+inline std::atomic_size_t num_slots{0};
+
+static inline slot& local_slot() {
+  thread_local slot& s = slots[num_slots.fetch_add(1, std::memory_order_relaxed) % max_slots];
+  return s;
+}
+
+static inline void count(kind k, uint64_t n = 1) {
+  std::atomic_uint64_t& c = local_slot().n[k];
+  c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// the totals so far, exact once the counting threads are joined or quiescent
+static inline counts read() {
+  counts total;
+  size_t n = std::min(num_slots.load(std::memory_order_acquire), max_slots);
+  for (size_t i = 0; i < n; i++) {
+    for (size_t k = 0; k < NUM_KINDS; k++) { total.n[k] += slots[i].n[k].load(std::memory_order_relaxed); } }
+  return total;
+}
+
+#else
+
+constexpr bool enabled = false;
+
+static inline void count(kind, uint64_t = 1) { }
+
+static inline counts read() { return counts(); }
+
+#endif
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <mimalloc.h>
+#include <mimalloc-override.h>
+#include <mimalloc-new-delete.h>
+
+/* An append-only arena of byte records.
+ * It is written by one thread only, and a record is never moved or freed until the arena is destroyed,
+ * so that every version referring to it stays readable. A reference becomes visible to readers
+ * through the same release/acquire chain which publishes the node holding it. */
+class chunk_arena {
+private:
+  static constexpr size_t chunk_size_ = size_t{1} << 20;
+  static constexpr size_t align_ = alignof(std::max_align_t);
+
+  std::vector<char*> chunks_;
+  char* cur_;
+  size_t left_;
+  size_t bytes_;
+
+public:
+  chunk_arena() : cur_(nullptr), left_(0), bytes_(0) { }
+
+  chunk_arena(const chunk_arena&) = delete;
+  chunk_arena& operator=(const chunk_arena&) = delete;
+
+  ~chunk_arena() {
+    for (char* chunk : chunks_) { ::operator delete(chunk); }
+  }
+
+  char* allocate(size_t size) {
+    bytes_ += size;
+    size = (size + align_ - 1) & ~(align_ - 1);
+    if (size > left_) {
+      // a large record gets a chunk on its own, the current chunk keeps serving small ones
+      if (size > chunk_size_ / 4) {
+        chunks_.push_back(static_cast<char*>(::operator new(size)));
+        return chunks_.back(); }
+      chunks_.push_back(static_cast<char*>(::operator new(chunk_size_)));
+      cur_ = chunks_.back();
+      left_ = chunk_size_; }
+    char* p = cur_;
+    cur_ += size;
+    left_ -= size;
+    return p;
+  }
+
+  // bytes requested by the records, without alignment and chunk slack
+  inline size_t bytes() const {
+    return bytes_;
+  }
+};
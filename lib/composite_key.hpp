@@ -0,0 +1,14 @@
+#pragma once
+
+#include <compare>
+#include <cstdint>
+
+// a 128-bit key ordered by (major, minor), e.g. (tenant, id), hashed by aes_hash as a whole
+struct composite_key {
+  uint64_t major;
+  uint64_t minor;
+
+  friend constexpr auto operator<=>(const composite_key&, const composite_key&) = default;
+};
+
+static_assert(sizeof(composite_key) == 16);
@@ -5,21 +5,67 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
 #include "lib/parlay/parallel.h"
 #include "node.hpp"
+#include "query.hpp"
 
 namespace pam {
 
-uint64_t augment_parallel(node_ptr t) {
+/* records the aggregates of t at the versions before vstat where its subtree changes,
+ * so that a fully covered subtree is answered in O(log k) for every version after vsince.
+ * only the fresh children carry a history, the others are constant for the whole batch. */
+template <typename N>
+void augment_history(N* t, bool fresh_l, bool fresh_r) {
+  size_t vsince = std::max(
+    fresh_l ? subtree_vsince(t->lch) : subtree_vstat(t->lch),
+    fresh_r ? subtree_vsince(t->rch) : subtree_vstat(t->rch));
+  if (vsince >= t->vstat) { return; }
+
+  // scratch buffers of the thread, the function does not recurse
+  thread_local std::vector<size_t> vers;
+  thread_local std::vector<valver> augs;
+  vers.clear();
+  augs.clear();
+  vers.push_back(vsince);
+  auto collect = [vsince, t](const N* c) {
+    if (c == nullptr) { return; }
+    for (size_t i = 0; i < c->hist->naugs; i++) {
+      if (c->hist->augs()[i].ver > vsince) { vers.push_back(c->hist->augs()[i].ver); } }
+    if (c->vstat > vsince && c->vstat < t->vstat) { vers.push_back(c->vstat); } };
+  if (fresh_l) { collect(t->lch); }
+  if (fresh_r) { collect(t->rch); }
+  for (size_t i = 0; i < t->hist->nvals; i++) {
+    size_t ver = t->hist->vals()[i].ver;
+    if (ver > vsince && ver < t->vstat) { vers.push_back(ver); } }
+  std::sort(vers.begin(), vers.end());
+  vers.erase(std::unique(vers.begin(), vers.end()), vers.end());
+
+  for (size_t ver : vers) {
+    uint64_t aug = subtree_aug(t->lch, ver) + find_value(t, ver) + subtree_aug(t->rch, ver);
+    if (augs.empty() || augs.back().val != aug) { augs.push_back(valver{aug, ver}); } }
+
+  history* h = make_history(t->hist->nvals, augs.size());
+  std::copy(t->hist->vals(), t->hist->vals() + t->hist->nvals, h->vals());
+  std::copy(augs.begin(), augs.end(), h->augs());
+  release_history(t->hist);
+  t->hist = h;
+}
+
+template <typename N>
+uint64_t augment_parallel(N* t) {
   if (t == nullptr) { return 0; }
   if (t->vstat != vstat_uninitialized) { return t->aug; }
+  bool fresh_l = t->lch != nullptr && t->lch->vstat == vstat_uninitialized;
+  bool fresh_r = t->rch != nullptr && t->rch->vstat == vstat_uninitialized;
   uint64_t aug_l, aug_r;
   parlay::par_do(
     [&aug_l, t]() { aug_l = augment_parallel(t->lch); },
     [&aug_r, t]() { aug_r = augment_parallel(t->rch); });
-  t->aug = aug_l + t->vals[t->nvals-1].val + aug_r;
-  t->vstat = std::max(t->vals[t->nvals-1].ver, std::max(subtree_vstat(t->lch), subtree_vstat(t->rch)));
+  t->aug = aug_l + last_value(t).val + aug_r;
+  t->vstat = std::max(last_value(t).ver, std::max(subtree_vstat(t->lch), subtree_vstat(t->rch)));
+  augment_history(t, fresh_l, fresh_r);
   return t->aug;
 }
 
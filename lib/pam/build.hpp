@@ -10,10 +10,12 @@
 
 namespace pam {
 
-std::tuple<node_ptr, node_ptr> split(node_ptr t, uint64_t key) {
+template <typename N>
+std::tuple<N*, N*> split(N* t, const key_of<N>& key) {
+  using node_ptr = N*;
   node_ptr t_l, t_r;
   if (t == nullptr) { return std::make_tuple(nullptr, nullptr); }
-  else if (key < t->key) {
+  else if (N::less(key, t->key)) {
     t_r = t;
     std::tie(t_l, t_r->lch) = split(t->lch, key); }
   else /* key > t->key */ {
@@ -22,12 +24,14 @@ std::tuple<node_ptr, node_ptr> split(node_ptr t, uint64_t key) {
   return std::make_tuple(t_l, t_r);
 }
 
-node_ptr merge(node_ptr t_0, node_ptr t_1) {
+template <typename N>
+N* merge(N* t_0, N* t_1) {
+  using node_ptr = N*;
   if (t_0 == nullptr) { return t_1; }
   if (t_1 == nullptr) { return t_0; }
 
-  if (t_0->key == t_1->key) {
-    t_0->vals[0].val += t_1->vals[0].val;
+  if (N::equal(t_0->key, t_1->key)) {
+    t_0->hist->vals()[0].val += t_1->hist->vals()[0].val;
     parlay::par_do(
       [t_0, t_1] { t_0->lch = merge(t_0->lch, t_1->lch); },
       [t_0, t_1] { t_0->rch = merge(t_0->rch, t_1->rch); });
@@ -50,13 +54,31 @@ node_ptr merge(node_ptr t_0, node_ptr t_1) {
     return t_1; }
 }
 
-node_ptr build(size_t n, const uint64_t* elems) {
+// the leaves of build are blocks of up to this many keys, whose priorities are hashed together
+constexpr size_t build_block = 8;
+
+// merges the nodes of a leaf block by halves, in the same way as the blocks are merged
+template <typename N, typename F>
+N* merge_nodes(N** ts, size_t n, F merge_fn) {
+  if (n == 1) { return ts[0]; }
+  return merge_fn(merge_nodes(ts, n / 2, merge_fn), merge_nodes(ts + n / 2, n - n / 2, merge_fn));
+}
+
+template <typename Key, typename Compare = std::less<Key>>
+basic_node<Key, Compare>* build(size_t n, const Key* elems) {
+  using node_t = basic_node<Key, Compare>;
+  using node_ptr = node_t*;
   if (n == 0) { return nullptr; }
-  if (n == 1) { return make_node(0, elems[0]); }
+  if (n <= build_block) {
+    uint64_t prys[build_block];
+    node_ptr ts[build_block];
+    node_t::priorities(elems, n, prys);
+    for (size_t i = 0; i < n; i++) { ts[i] = make_node<node_t>(0, prys[i], elems[i]); }
+    return merge_nodes(ts, n, merge<node_t>); }
   node_ptr t_0, t_1;
   parlay::par_do(
-    [n, elems, &t_0] { t_0 = build(n / 2, elems); },
-    [n, elems, &t_1] { t_1 = build(n - n / 2, elems + n / 2); });
+    [n, elems, &t_0] { t_0 = build<Key, Compare>(n / 2, elems); },
+    [n, elems, &t_1] { t_1 = build<Key, Compare>(n - n / 2, elems + n / 2); });
   return merge(t_0, t_1);
 }
 
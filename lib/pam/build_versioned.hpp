@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <tuple>
@@ -11,23 +12,27 @@
 namespace pam {
 
 /* values in t_0 are always earlier than that in t_1 */
-void merge_values(node_ptr t_0, node_ptr t_1) {
-  valver* new_vals = new valver[t_0->nvals + t_1->nvals];
-  for (size_t i = 0; i < t_0->nvals; i++) { new_vals[i] = t_0->vals[i]; }
-  uint64_t val_base = t_0->vals[t_0->nvals-1].val;
-  for (size_t i = 0; i < t_1->nvals; i++) {
-    new_vals[t_0->nvals+i].val = val_base + t_1->vals[i].val;
-    new_vals[t_0->nvals+i].ver = t_1->vals[i].ver; }
-  t_0->nvals += t_1->nvals;
-  delete t_0->vals;
-  t_0->vals = new_vals;
+template <typename N>
+void merge_values(N* t_0, N* t_1) {
+  history* h_0 = t_0->hist;
+  history* h_1 = t_1->hist;
+  history* h = make_history(h_0->nvals + h_1->nvals);
+  std::copy(h_0->vals(), h_0->vals() + h_0->nvals, h->vals());
+  uint64_t val_base = h_0->vals()[h_0->nvals-1].val;
+  for (size_t i = 0; i < h_1->nvals; i++) {
+    h->vals()[h_0->nvals+i].val = val_base + h_1->vals()[i].val;
+    h->vals()[h_0->nvals+i].ver = h_1->vals()[i].ver; }
+  release_history(h_0);
+  t_0->hist = h;
 }
 
-node_ptr merge_versioned(node_ptr t_0, node_ptr t_1) {
+template <typename N>
+N* merge_versioned(N* t_0, N* t_1) {
+  using node_ptr = N*;
   if (t_0 == nullptr) { return t_1; }
   if (t_1 == nullptr) { return t_0; }
 
-  if (t_0->key == t_1->key) {
+  if (N::equal(t_0->key, t_1->key)) {
     merge_values(t_0, t_1);
     parlay::par_do(
       [t_0, t_1] { t_0->lch = merge_versioned(t_0->lch, t_1->lch); },
@@ -51,13 +56,23 @@ node_ptr merge_versioned(node_ptr t_0, node_ptr t_1) {
     return t_1; }
 }
 
-node_ptr build_versioned(size_t ver, size_t n, const uint64_t* elems) {
+// the i-th element gets version ver+i, and counts its weight cnts[i] (or 1 if cnts is null)
+template <typename Key, typename Compare = std::less<Key>>
+basic_node<Key, Compare>* build_versioned(size_t ver, size_t n, const Key* elems, const uint64_t* cnts = nullptr) {
+  using node_t = basic_node<Key, Compare>;
   if (n == 0) { return nullptr; }
-  if (n == 1) { return make_node(ver, elems[0]); }
-  node_ptr t_0, t_1;
+  if (n <= build_block) {
+    uint64_t prys[build_block];
+    node_t* ts[build_block];
+    node_t::priorities(elems, n, prys);
+    for (size_t i = 0; i < n; i++) { ts[i] = make_node<node_t>(ver + i, prys[i], elems[i], cnts == nullptr ? 1 : cnts[i]); }
+    return merge_nodes(ts, n, merge_versioned<node_t>); }
+  node_t* t_0;
+  node_t* t_1;
+  const uint64_t* cnts_1 = cnts == nullptr ? nullptr : cnts + n / 2;
   parlay::par_do(
-    [ver, n, elems, &t_0] { t_0 = build_versioned(ver, n / 2, elems); },
-    [ver, n, elems, &t_1] { t_1 = build_versioned(ver + n / 2, n - n / 2, elems + n / 2); });
+    [ver, n, elems, cnts, &t_0] { t_0 = build_versioned<Key, Compare>(ver, n / 2, elems, cnts); },
+    [ver, n, elems, cnts_1, &t_1] { t_1 = build_versioned<Key, Compare>(ver + n / 2, n - n / 2, elems + n / 2, cnts_1); });
   return merge_versioned(t_0, t_1);
 }
 
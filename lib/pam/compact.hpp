@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "node.hpp"
+
+namespace pam {
+
+template <typename N>
+static inline const N* find_node(const N* t, const key_of<N>& k) {
+  while (t != nullptr) {
+    if (N::equal(k, t->key)) { return t; }
+    t = N::less(k, t->key) ? t->lch : t->rch; }
+  return nullptr;
+}
+
+/* trims the histories of the nodes introduced by t on top of t_prev down to their last value,
+ * which is valid once no reader needs a version before the end of the batch of t.
+ * the replaced histories are retired, and must outlive the readers that may still hold them */
+template <typename N>
+void compact_history(N* t, const N* t_prev, std::vector<history*>& retired) {
+  if (t == nullptr || find_node(t_prev, t->key) == t) { return; }
+  history* h_old = t->hist;
+  if (h_old->nvals > 1 || h_old->naugs > 0) {
+    history* h = make_history(1);
+    h->vals()[0] = h_old->vals()[h_old->nvals-1];
+    store_history(t, h);
+    retired.push_back(h_old); }
+  compact_history(t->lch, t_prev, retired);
+  compact_history(t->rch, t_prev, retired);
+}
+
+/* releases the nodes of t_old that are not shared with t_new,
+ * requires that no older version than t_old is alive */
+template <typename N>
+void release_unshared(N* t_old, const N* t_new) {
+  if (t_old == nullptr || find_node(t_new, t_old->key) == t_old) { return; }
+  release_unshared(t_old->lch, t_new);
+  release_unshared(t_old->rch, t_new);
+  release_node(t_old);
+}
+
+static inline void release_retired(std::vector<history*>& retired) {
+  for (history* h : retired) { release_history(h); }
+  retired.clear();
+}
+
+}
@@ -10,21 +10,33 @@
 
 namespace pam {
 
-void update_values(node_ptr t, uint64_t val_base) {
-  for (size_t i = 0; i < t->nvals; i++) { t->vals[i].val += val_base; }
+// rebase the versioned values of t on the last value of its persistent counterpart,
+// which stays visible to the versions of this batch before the first update on the key
+template <typename N>
+void update_values(N* t, const valver& val_base) {
+  history* h = make_history(t->hist->nvals + 1);
+  h->vals()[0] = val_base;
+  for (size_t i = 0; i < t->hist->nvals; i++) {
+    h->vals()[i+1].val = val_base.val + t->hist->vals()[i].val;
+    h->vals()[i+1].ver = t->hist->vals()[i].ver; }
+  release_history(t->hist);
+  t->hist = h;
 }
 
-static inline std::tuple<node_ptr, node_ptr, node_ptr> expose(node_ptr t) {
-  node_ptr t_l = t->lch;
-  node_ptr t_r = t->rch;
+template <typename N>
+static inline std::tuple<N*, N*, N*> expose(N* t) {
+  N* t_l = t->lch;
+  N* t_r = t->rch;
   t->lch = t->rch = nullptr;
   return std::make_tuple(t_l, t, t_r);
 }
 
-std::tuple<node_ptr, node_ptr> copy_split(constnode_ptr t, uint64_t key) {
+template <typename N>
+std::tuple<N*, N*> copy_split(const N* t, const key_of<N>& key) {
+  using node_ptr = N*;
   node_ptr t_l, t_r;
   if (t == nullptr) { return std::make_tuple(nullptr, nullptr); }
-  else if (key < t->key) {
+  else if (N::less(key, t->key)) {
     t_r = make_weak_copy(t);
     t_r->rch = t->rch;
     std::tie(t_l, t_r->lch) = copy_split(t->lch, key); }
@@ -35,7 +47,10 @@ std::tuple<node_ptr, node_ptr> copy_split(constnode_ptr t, uint64_t key) {
   return std::make_tuple(t_l, t_r);
 }
 
-node_ptr copy_merge(constnode_ptr t_old, node_ptr t_ins) {
+template <typename N>
+N* copy_merge(const N* t_old, N* t_ins) {
+  using node_ptr = N*;
+  using constnode_ptr = const N*;
   if (t_old == nullptr) { return t_ins; }
   if (t_ins == nullptr) { return const_cast<node_ptr>(t_old); }
 
@@ -53,10 +68,10 @@ node_ptr copy_merge(constnode_ptr t_old, node_ptr t_ins) {
   else /* t_old->pry <= t_ins->pry */ {
     std::tie(t_ins_l, t_new, t_ins_r) = expose(t_ins);
     // if the key exist, update value and merge the subtrees
-    if (t_old->key == t_ins->key) {
+    if (N::equal(t_old->key, t_ins->key)) {
       t_old_l = t_old->lch;
       t_old_r = t_old->rch;
-      update_values(t_new, t_old->vals[t_old->nvals-1].val); }
+      update_values(t_new, last_value(t_old)); }
     // otherwise, split the persistent tree t_old with copying
     else /* t_old->key != t_ins->key */ { std::tie(t_old_l, t_old_r) = copy_split(t_old, t_ins->key); } }
 
@@ -1,25 +1,30 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <tuple>
+#include <vector>
 
 #include "lib/parlay/parallel.h"
 #include "build.hpp"
+#include "compact.hpp"
 #include "node.hpp"
 
 namespace pam {
 
-static inline node_ptr make_copy_if_need(node_ptr t) {
+template <typename N>
+static inline N* make_copy_if_need(N* t) {
   // use vstat to determine whether the node is persistent
   if (t->vstat == vstat_uninitialized) { return t; }
   return make_weak_copy(t);
 }
 
-node_ptr copy_concat(node_ptr t_l, node_ptr t_r) {
+template <typename N>
+N* copy_concat(N* t_l, N* t_r) {
   if (t_l == nullptr) { return t_r; }
   if (t_r == nullptr) { return t_l; }
-  node_ptr t_new;
+  N* t_new;
   // if t_l has a higher priority, concat t_r with its right subtree
   if (t_l->pry > t_r->pry) {
     t_new = make_copy_if_need(t_l);
@@ -33,20 +38,44 @@ node_ptr copy_concat(node_ptr t_l, node_ptr t_r) {
   return t_new;
 }
 
-node_ptr copy_subtract(constnode_ptr t_old, node_ptr t_det) {
+// rebase the versioned counts to subtract in t on the last value of its persistent counterpart
+template <typename N>
+void subtract_values(N* t, const valver& val_base) {
+  history* h = make_history(t->hist->nvals + 1);
+  h->vals()[0] = val_base;
+  for (size_t i = 0; i < t->hist->nvals; i++) {
+    uint64_t cnt = t->hist->vals()[i].val;
+    h->vals()[i+1].val = val_base.val > cnt ? val_base.val - cnt : 0;
+    h->vals()[i+1].ver = t->hist->vals()[i].ver; }
+  release_history(t->hist);
+  t->hist = h;
+}
+
+// subtract the counters in t_det from t_old, a key is deleted once its counter reaches zero
+// (a key drained within a batch stays with a zero counter for the versions of the batch, see remove_drained)
+template <typename N>
+N* copy_subtract(const N* t_old, N* t_det) {
+  using node_ptr = N*;
   if (t_old == nullptr) {
     release_tree(t_det);
     return nullptr; }
   if (t_det == nullptr) { return const_cast<node_ptr>(t_old); }
 
   node_ptr t_new;
-  if (t_old->key == t_det->key) {
+  if (N::equal(t_old->key, t_det->key)) {
     node_ptr t_new_l, t_new_r;
     parlay::par_do(
       [t_old, t_det, &t_new_l]() { t_new_l = copy_subtract(t_old->lch, t_det->lch); },
       [t_old, t_det, &t_new_r]() { t_new_r = copy_subtract(t_old->rch, t_det->rch); });
+    // the versions in the batch before the first subtraction still see the old counter
+    if (last_value(t_old).val > 0) {
+      subtract_values(t_det, last_value(t_old));
+      t_new = t_det;
+      t_new->lch = t_new_l;
+      t_new->rch = t_new_r; }
+    else /* the key has been drained by an earlier batch */ {
       release_node(t_det);
-      t_new = copy_concat(t_new_l, t_new_r); }
+      t_new = copy_concat(t_new_l, t_new_r); } }
   // make a copy of t_old since it will not appear in t_det
   else if (t_old->pry > t_det->pry) {
     t_new = make_weak_copy(t_old);
@@ -64,4 +93,42 @@ node_ptr copy_subtract(constnode_ptr t_old, node_ptr t_det) {
   return t_new;
 }
 
+// a node which counts nothing at any version of the batch being built: a persistent one drained by an earlier batch,
+// or a fresh copy of one made on the path of an update
+template <typename N>
+static inline bool is_drained(const N* t) {
+  return last_value(t).val == 0 && (t->vstat != vstat_uninitialized || t->hist->nvals == 1);
+}
+
+/* removes the node of k from t, the tree of a batch before it is augmented, if the node counts nothing at any version
+ * of the batch, copying the persistent nodes on its path; one drained by an earlier batch is released with its tree */
+template <typename N>
+N* remove_drained(N* t, const key_of<N>& k) {
+  if (t == nullptr) { return nullptr; }
+  if (N::equal(k, t->key)) {
+    if (!is_drained(t)) { return t; }
+    N* t_new = copy_concat(t->lch, t->rch);
+    if (t->vstat == vstat_uninitialized) { release_node(t); }
+    return t_new; }
+  bool left = N::less(k, t->key);
+  N* t_ch = left ? t->lch : t->rch;
+  N* t_ch_new = remove_drained(t_ch, k);
+  if (t_ch_new == t_ch) { return t; }
+  N* t_new = make_copy_if_need(t);
+  t_new->lch = left ? t_ch_new : t->lch;
+  t_new->rch = left ? t->rch : t_ch_new;
+  return t_new;
+}
+
+/* the keys among the n of a batch whose counters it drains to zero in t, once augmented. Their nodes stay for the
+ * versions of the batch before the drain and are removed by the next batch, as the versions after it see none */
+template <typename N>
+void collect_drained(const N* t, size_t n, const key_of<N>* keys, std::vector<key_of<N>>& drained) {
+  for (size_t i = 0; i < n; i++) {
+    const N* t_k = find_node(t, keys[i]);
+    if (t_k != nullptr && last_value(t_k).val == 0) { drained.push_back(keys[i]); } }
+  std::sort(drained.begin(), drained.end(), N::less);
+  drained.erase(std::unique(drained.begin(), drained.end(), N::equal), drained.end());
+}
+
 }
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+
+#include "node.hpp"
+
+namespace pam {
+
+// the nodes of t
+template <typename N>
+size_t count_nodes(const N* t) {
+  if (t == nullptr) { return 0; }
+  return count_nodes(t->lch) + 1 + count_nodes(t->rch);
+}
+
+}
@@ -2,59 +2,127 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <vector>
 
 #include "augment.hpp"
 #include "build.hpp"
 #include "build_versioned.hpp"
+#include "compact.hpp"
 #include "copy_merge.hpp"
 #include "copy_subtract.hpp"
+#include "footprint.hpp"
 #include "node.hpp"
 #include "query.hpp"
+#include "rank.hpp"
+#include "scan.hpp"
 
-namespace pam { struct interface {
+namespace pam {
 
-using node_ptr = pam::node_ptr;
+template <typename Key = uint64_t, typename Compare = std::less<Key>>
+struct basic_interface {
 
-static inline node_ptr build(size_t n, const uint64_t* elems) {
+using key_type = Key;
+using node_t = basic_node<Key, Compare>;
+using node_ptr = node_t*;
+using constnode_ptr = const node_t*;
+using entry = basic_entry<Key>;
+using cursor = basic_cursor<node_t>;
+using retired_list = std::vector<history*>;
+// the keys a batch drains, whose nodes the next batch removes (see collect_drained)
+using drained_list = std::vector<Key>;
+
+static inline node_ptr build(size_t n, const Key* elems) {
   node_ptr t;
   parlay::execute_with_scheduler(
-    [&t, n, elems](){ pam::augment_parallel(t = pam::build(n, elems)); },
+    [&t, n, elems](){ pam::augment_parallel(t = pam::build<Key, Compare>(n, elems)); },
     std::thread::hardware_concurrency());
   return t;
 }
 
-static inline node_ptr inserted(constnode_ptr t_old, size_t ver, uint64_t elem) {
-  node_ptr t = copy_merge(t_old, make_node(ver, elem));
+static inline node_ptr inserted(constnode_ptr t_old, size_t ver, const Key& elem) {
+  node_ptr t = copy_merge(t_old, make_node<node_t>(ver, elem));
   augment_parallel(t);
   return t;
 }
 
-static inline node_ptr inserted(constnode_ptr t_old, size_t ver, size_t n, const uint64_t* elems) {
-  node_ptr t_det = build_versioned(ver, n, elems);
+// with drained, the nodes of the keys the previous batch drained are removed
+static inline node_ptr inserted(constnode_ptr t_old, size_t ver, size_t n, const Key* elems,
+    const uint64_t* cnts = nullptr, drained_list* drained = nullptr) {
+  node_ptr t_det = build_versioned<Key, Compare>(ver, n, elems, cnts);
   node_ptr t = copy_merge(t_old, t_det);
+  if (drained != nullptr) {
+    for (const Key& k : *drained) { t = remove_drained(t, k); }
+    drained->clear(); }
   augment_parallel(t);
   return t;
 }
 
-static inline node_ptr deleted(constnode_ptr t_old, size_t ver, uint64_t elem) {
-  node_ptr t = copy_subtract(t_old, make_node(ver, elem));
+static inline node_ptr deleted(constnode_ptr t_old, size_t ver, const Key& elem) {
+  node_ptr t = copy_subtract(t_old, make_node<node_t>(ver, elem));
   augment_parallel(t);
   return t;
 }
 
-static inline node_ptr deleted(constnode_ptr t_old, size_t ver, size_t n, const uint64_t* elems) {
-  node_ptr t_det = build_versioned(ver, n, elems);
+// with drained, the nodes of the keys the previous batch drained are removed, and those this one drains are kept
+static inline node_ptr deleted(constnode_ptr t_old, size_t ver, size_t n, const Key* elems,
+    const uint64_t* cnts = nullptr, drained_list* drained = nullptr) {
+  node_ptr t_det = build_versioned<Key, Compare>(ver, n, elems, cnts);
   node_ptr t = copy_subtract(t_old, t_det);
+  if (drained != nullptr) {
+    for (const Key& k : *drained) { t = remove_drained(t, k); }
+    drained->clear(); }
   augment_parallel(t);
+  if (drained != nullptr) { collect_drained(t, n, elems, *drained); }
   return t;
 }
 
-static inline uint64_t find(constnode_ptr t, size_t v, uint64_t k) {
+static inline void compact(node_ptr t, constnode_ptr t_prev, retired_list& retired) {
+  compact_history(t, t_prev, retired);
+}
+
+static inline void release(node_ptr t_old, constnode_ptr t_new) {
+  release_unshared(t_old, t_new);
+}
+
+static inline void release(retired_list& retired) {
+  release_retired(retired);
+}
+
+static inline size_t count_nodes(constnode_ptr t) {
+  return pam::count_nodes(t);
+}
+
+static inline uint64_t find(constnode_ptr t, size_t v, const Key& k) {
   return pam::find(t, v, k);
 }
 
-static inline uint64_t range_estimate(node_ptr t, size_t v, uint64_t l, uint64_t r) {
+static inline uint64_t range_estimate(node_ptr t, size_t v, const Key& l, const Key& r) {
   return pam::range_estimate(t, v, l, r);
 }
 
-}; }
+static inline uint64_t rank(node_ptr t, size_t v, const Key& k) {
+  return pam::rank(t, v, k);
+}
+
+static inline constnode_ptr select(node_ptr t, size_t v, uint64_t k) {
+  return pam::select(t, v, k);
+}
+
+static inline std::vector<Key> quantiles(node_ptr t, size_t v, const double* qs, size_t n) {
+  return pam::quantiles(t, v, qs, n);
+}
+
+static inline cursor scan(constnode_ptr t, size_t v, const Key& l, const Key& r) {
+  return cursor(t, v, l, r);
+}
+
+static inline parlay::sequence<entry> range_collect(constnode_ptr t, size_t v, const Key& l, const Key& r) {
+  return pam::range_collect(t, v, l, r);
+}
+
+};
+
+using interface = basic_interface<>;
+
+}
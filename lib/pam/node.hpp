@@ -2,9 +2,13 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <new>
+#include <type_traits>
 #include <vector>
 
 #include <mimalloc.h>
@@ -12,6 +16,7 @@
 #include <mimalloc-new-delete.h>
 
 #include "lib/aes_hash.hpp"
+#include "lib/alloc_count.hpp"
 
 namespace pam {
 
@@ -20,60 +25,164 @@ static_assert(alignof(size_t) == alignof(std::atomic_size_t));
 
 struct valver { uint64_t val; size_t ver; };
 
-struct alignas(64) node_t {
+// versioned values of a node, followed by the versioned aggregates of its subtree
+struct history {
+  uint32_t nvals;
+  uint32_t naugs; // aggregates before vstat, empty if the node is not fresh in its batch
+  valver data[0];
+
+  valver* vals() { return data; }
+  const valver* vals() const { return data; }
+  valver* augs() { return data + nvals; }
+  const valver* augs() const { return data + nvals; }
+};
+
+/* a node keyed by Key in the order of Compare, where two keys are the same if neither is less than the other,
+ * the priority of a key is its AES hash, so that Key is an integer, a 128-bit trivially copyable type,
+ * or provides its own priority() which is the same for equal keys (e.g. string_key) */
+template <typename Key = uint64_t, typename Compare = std::less<Key>>
+struct alignas(64) basic_node {
+  using key_type = Key;
+  using key_compare = Compare;
+
   size_t vstat; // version of augment
   uint64_t pry;
-  uint64_t key;
-  size_t nvals;
-  valver* vals;
+  Key key;
+  history* hist;
   uint64_t aug; // in this demo, it's the sum of counters, 0 as uninitialized
-  node_t* lch;
-  node_t* rch;
+  basic_node* lch;
+  basic_node* rch;
+
+  static inline bool less(const Key& a, const Key& b) { return Compare{}(a, b); }
+  static inline bool equal(const Key& a, const Key& b) { return !less(a, b) && !less(b, a); }
+
+  static inline uint64_t priority(const Key& key) {
+    if constexpr (std::is_integral_v<Key>) { return aes_hash::hash(static_cast<uint64_t>(key)); }
+    else if constexpr (requires { key.priority(); }) { return key.priority(); }
+    else { return aes_hash::hash(key); }
+  }
+
+  // the priorities of n keys, hashed several at a time for 64-bit integers
+  static inline void priorities(const Key* keys, size_t n, uint64_t* out) {
+    if constexpr (std::is_integral_v<Key> && sizeof(Key) == sizeof(uint64_t)) {
+      aes_hash::hash_many(reinterpret_cast<const uint64_t*>(keys), n, out); }
+    else { for (size_t i = 0; i < n; i++) { out[i] = priority(keys[i]); } }
+  }
 };
 
-static_assert(sizeof(node_t) == 64);
+template <typename N>
+using key_of = typename N::key_type;
 
+using node_t = basic_node<>;
 using node_ptr = node_t*;
 using constnode_ptr = const node_t*;
 
+static_assert(sizeof(node_t) == 64);
+
 constexpr uint64_t vstat_uninitialized = ~uint64_t{0};
 constexpr uint64_t aug_uninitialized = 0;
 
-static inline node_ptr make_node(size_t ver, uint64_t pry, uint64_t key, uint64_t val = 1) {
-  node_ptr t = new node_t {
+static inline history* make_history(size_t nvals, size_t naugs = 0) {
+  size_t bytes = sizeof(history) + (nvals + naugs) * sizeof(valver);
+  alloc_count::count(alloc_count::HISTORY_MADE);
+  alloc_count::count(alloc_count::BYTES_MADE, bytes);
+  history* h = static_cast<history*>(::operator new(bytes));
+  h->nvals = nvals;
+  h->naugs = naugs;
+  return h;
+}
+
+static inline void release_history(history* h) {
+  alloc_count::count(alloc_count::HISTORY_RELEASED);
+  alloc_count::count(alloc_count::BYTES_RELEASED, sizeof(history) + (h->nvals + h->naugs) * sizeof(valver));
+  ::operator delete(h);
+}
+
+// the history of a persistent node is replaced by compaction while readers are running
+template <typename N>
+static inline const history* load_history(const N* t) {
+  return std::atomic_ref<history*>(const_cast<N*>(t)->hist).load(std::memory_order_acquire);
+}
+
+template <typename N>
+static inline void store_history(N* t, history* h) {
+  std::atomic_ref<history*>(t->hist).store(h, std::memory_order_release);
+}
+
+template <typename N>
+static inline valver last_value(const N* t) {
+  const history* h = load_history(t);
+  return h->vals()[h->nvals-1];
+}
+
+template <typename N = node_t>
+static inline N* make_node(size_t ver, uint64_t pry, const key_of<N>& key, uint64_t val = 1) {
+  alloc_count::count(alloc_count::NODE_MADE);
+  alloc_count::count(alloc_count::BYTES_MADE, sizeof(N));
+  N* t = new N {
     vstat_uninitialized,
     pry, key,
-    1, new valver[1],
+    make_history(1),
     aug_uninitialized,
     nullptr, nullptr };
-  t->vals[0].val = val;
-  t->vals[0].ver = ver;
+  t->hist->vals()[0].val = val;
+  t->hist->vals()[0].ver = ver;
   return t;
 }
 
-static inline node_ptr make_node(size_t ver, uint64_t key) {
-  return make_node(ver, aes_hash::hash(key), key);
+template <typename N = node_t>
+static inline N* make_node(size_t ver, const key_of<N>& key) {
+  return make_node<N>(ver, N::priority(key), key);
 }
 
 // only copy the last value
-static inline node_ptr make_weak_copy(constnode_ptr t) {
+template <typename N>
+static inline N* make_weak_copy(const N* t) {
   assert(t != nullptr);
-  return make_node(t->vals[t->nvals-1].ver, t->pry, t->key, t->vals[t->nvals-1].val);
+  alloc_count::count(alloc_count::NODE_COPIED);
+  return make_node<N>(last_value(t).ver, t->pry, t->key, last_value(t).val);
 }
 
-size_t subtree_vstat(node_ptr t) {
+template <typename N>
+size_t subtree_vstat(const N* t) {
   if (t == nullptr) { return 0; }
   assert(t->vstat != vstat_uninitialized);
   return t->vstat;
 }
 
-static inline void release_node(node_ptr t) {
+// the earliest version whose aggregate of t is answered without visiting its subtree
+template <typename N>
+static inline size_t subtree_vsince(const N* t) {
+  if (t == nullptr) { return 0; }
+  assert(t->vstat != vstat_uninitialized);
+  const history* h = load_history(t);
+  return h->naugs > 0 ? h->augs()[0].ver : t->vstat;
+}
+
+// aggregate of the subtree t at version v, requires v >= subtree_vsince(t)
+template <typename N>
+static inline uint64_t subtree_aug(const N* t, size_t v) {
+  if (t == nullptr) { return 0; }
+  if (t->vstat <= v) { return t->aug; }
+  const history* h = load_history(t);
+  const valver* augs = h->augs();
+  const valver* it = std::upper_bound(augs, augs + h->naugs, v,
+    [](size_t v, const valver& a) { return v < a.ver; });
+  assert(it != augs);
+  return (it-1)->val;
+}
+
+template <typename N>
+static inline void release_node(N* t) {
   assert(t != nullptr);
-  if (t->vals != nullptr) { delete t->vals; }
+  if (t->hist != nullptr) { release_history(t->hist); }
+  alloc_count::count(alloc_count::NODE_RELEASED);
+  alloc_count::count(alloc_count::BYTES_RELEASED, sizeof(N));
   delete t;
 }
 
-void release_tree(node_ptr t) {
+template <typename N>
+void release_tree(N* t) {
   if (t == nullptr) { return; }
   release_tree(t->lch);
   release_tree(t->rch);
@@ -8,45 +8,51 @@
 
 namespace pam {
 
-static inline uint64_t find_value(constnode_ptr t, size_t v) {
-  if (v < t->vals[0].ver) { return 0; }
-  for (size_t i = 0; i < t->nvals-1; i++) {
-    if (v < t->vals[i+1].ver) { return t->vals[i].val; } }
-  return t->vals[t->nvals-1].val;
+template <typename N>
+static inline uint64_t find_value(const N* t, size_t v) {
+  const history* h = load_history(t);
+  const valver* vals = h->vals();
+  size_t nvals = h->nvals;
+  if (v < vals[0].ver) { return 0; }
+  for (size_t i = 0; i < nvals-1; i++) {
+    if (v < vals[i+1].ver) { return vals[i].val; } }
+  return vals[nvals-1].val;
 }
 
-static inline uint64_t find(constnode_ptr t, size_t v, uint64_t k) {
+template <typename N>
+static inline uint64_t find(const N* t, size_t v, const key_of<N>& k) {
   while (t != nullptr) {
-    if (k == t->key) { return find_value(t, v); }
-    t = k < t->key ? t->lch : t->rch; }
+    if (N::equal(k, t->key)) { return find_value(t, v); }
+    t = N::less(k, t->key) ? t->lch : t->rch; }
   return 0;
 }
 
 enum RANGE_COVER { OPEN_OPEN, OPEN_CLOSE, CLOSE_OPEN, CLOSE_CLOSE };
 
-uint64_t range_estimate(node_ptr t, size_t v, uint64_t l, uint64_t r, RANGE_COVER d) {
+template <typename N>
+uint64_t range_estimate(N* t, size_t v, const key_of<N>& l, const key_of<N>& r, RANGE_COVER d) {
   if (!t) return 0;
 
   uint64_t ret_l, ret_r;
   switch (d) {
     case RANGE_COVER::OPEN_OPEN:
-      if (r < t->key) { return range_estimate(t->lch, v, l, r, d); }
-      if (l > t->key) { return range_estimate(t->rch, v, l, r, d); }
+      if (N::less(r, t->key)) { return range_estimate(t->lch, v, l, r, d); }
+      if (N::less(t->key, l)) { return range_estimate(t->rch, v, l, r, d); }
       ret_l = range_estimate(t->lch, v, l, r, RANGE_COVER::OPEN_CLOSE);
       ret_r = range_estimate(t->rch, v, l, r, RANGE_COVER::CLOSE_OPEN);
       break;
     case RANGE_COVER::OPEN_CLOSE:
-      if (l > t->key) { return range_estimate(t->rch, v, l, r, d); }
+      if (N::less(t->key, l)) { return range_estimate(t->rch, v, l, r, d); }
       ret_l = range_estimate(t->lch, v, l, r, d);
       ret_r = range_estimate(t->rch, v, l, r, RANGE_COVER::CLOSE_CLOSE);
       break;
     case RANGE_COVER::CLOSE_OPEN:
-      if (r < t->key) { return range_estimate(t->lch, v, l, r, d); }
+      if (N::less(r, t->key)) { return range_estimate(t->lch, v, l, r, d); }
       ret_l = range_estimate(t->lch, v, l, r, RANGE_COVER::CLOSE_CLOSE);
       ret_r = range_estimate(t->rch, v, l, r, d);
       break;
     case RANGE_COVER::CLOSE_CLOSE:
-      if (t->vstat <= v) { return t->aug; }
+      if (subtree_vsince(t) <= v) { return subtree_aug(t, v); }
       ret_l = range_estimate(t->lch, v, l, r, d);
       ret_r = range_estimate(t->rch, v, l, r, d);
       break;
@@ -55,7 +61,8 @@ uint64_t range_estimate(node_ptr t, size_t v, uint64_t l, uint64_t r, RANGE_COVE
   return ret_l + find_value(t, v) + ret_r;
 }
 
-static inline uint64_t range_estimate(node_ptr t, size_t v, uint64_t l, uint64_t r) {
+template <typename N>
+static inline uint64_t range_estimate(N* t, size_t v, const key_of<N>& l, const key_of<N>& r) {
   return range_estimate(t, v, l, r, RANGE_COVER::OPEN_OPEN);
 }
 
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "node.hpp"
+#include "query.hpp"
+
+namespace pam {
+
+// the sum of counters in the subtree t at version v
+template <typename N>
+static inline uint64_t subtree_sum(N* t, size_t v) {
+  if (t == nullptr) { return 0; }
+  return range_estimate(t, v, t->key, t->key, RANGE_COVER::CLOSE_CLOSE);
+}
+
+// the sum of counters of the keys less than key at version v
+template <typename N>
+static inline uint64_t rank(N* t, size_t v, const key_of<N>& key) {
+  uint64_t ret = 0;
+  while (t != nullptr) {
+    if (!N::less(t->key, key)) { t = t->lch; }
+    else /* key > t->key */ {
+      ret += subtree_sum(t->lch, v) + find_value(t, v);
+      t = t->rch; } }
+  return ret;
+}
+
+// the node holding the k-th counter (from 0) at version v in key order, nullptr if k is out of range
+template <typename N>
+static inline const N* select(N* t, size_t v, uint64_t k) {
+  while (t != nullptr) {
+    uint64_t aug_l = subtree_sum(t->lch, v);
+    uint64_t val = find_value(t, v);
+    if (k < aug_l) { t = t->lch; }
+    else if (k < aug_l + val) { return t; }
+    else /* k >= aug_l + val */ {
+      k -= aug_l + val;
+      t = t->rch; } }
+  return nullptr;
+}
+
+/* selects the nodes of n ascending ranks at version v in one descent,
+ * the ranks falling into the same subtree share the path down to it */
+template <typename N>
+void select_many(N* t, size_t v, const uint64_t* ks, size_t n, uint64_t base, const N** out) {
+  if (n == 0) { return; }
+  if (t == nullptr) {
+    std::fill(out, out + n, nullptr);
+    return; }
+  uint64_t aug_l = base + subtree_sum(t->lch, v);
+  uint64_t val = find_value(t, v);
+  size_t n_l = std::lower_bound(ks, ks + n, aug_l) - ks;
+  size_t n_m = std::lower_bound(ks + n_l, ks + n, aug_l + val) - ks;
+  select_many(t->lch, v, ks, n_l, base, out);
+  std::fill(out + n_l, out + n_m, t);
+  select_many(t->rch, v, ks + n_m, n - n_m, aug_l + val, out + n_m);
+}
+
+static inline uint64_t quantile_rank(uint64_t total, double q) {
+  assert(total > 0);
+  return std::min<uint64_t>(total - 1, std::max(0.0, std::floor(q * total)));
+}
+
+// the key at quantile q in [0, 1] by nearest rank at version v, requires a non-empty snapshot
+template <typename N>
+static inline key_of<N> quantile(N* t, size_t v, double q) {
+  return select(t, v, quantile_rank(subtree_sum(t, v), q))->key;
+}
+
+// the keys at n ascending quantiles at version v in one descent, requires a non-empty snapshot
+template <typename N>
+std::vector<key_of<N>> quantiles(N* t, size_t v, const double* qs, size_t n) {
+  uint64_t total = subtree_sum(t, v);
+  std::vector<uint64_t> ks(n);
+  for (size_t i = 0; i < n; i++) { ks[i] = quantile_rank(total, qs[i]); }
+  std::vector<const N*> nodes(n);
+  select_many(t, v, ks.data(), n, 0, nodes.data());
+  std::vector<key_of<N>> keys(n);
+  for (size_t i = 0; i < n; i++) { keys[i] = nodes[i]->key; }
+  return keys;
+}
+
+}
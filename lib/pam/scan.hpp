@@ -0,0 +1,97 @@
+#pragma once
+
+#include <assert.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "lib/parlay/primitives.h"
+#include "lib/parlay/sequence.h"
+#include "lib/range_pieces.hpp"
+#include "node.hpp"
+#include "query.hpp"
+
+namespace pam {
+
+template <typename Key = uint64_t>
+struct basic_entry { Key key; uint64_t val; };
+
+using entry = basic_entry<>;
+
+// in-order cursor over the keys in [l, r] present at version v, it keeps the path on an explicit stack
+template <typename N = node_t>
+class basic_cursor {
+private:
+  using constnode_ptr = const N*;
+  using key_type = key_of<N>;
+
+  std::vector<constnode_ptr> path_;
+  size_t v_;
+  key_type r_;
+
+  void push_left_(constnode_ptr t) {
+    for (; t != nullptr; t = t->lch) { path_.push_back(t); }
+  }
+
+  // skip the keys that are not inserted yet at version v, or drained by then within the batch of the tree
+  void settle_() {
+    while (valid() && find_value(path_.back(), v_) == 0) { step_(); }
+  }
+
+  void step_() {
+    constnode_ptr t = path_.back();
+    path_.pop_back();
+    push_left_(t->rch);
+  }
+
+public:
+  basic_cursor(constnode_ptr t, size_t v, const key_type& l, const key_type& r) : v_(v), r_(r) {
+    path_.reserve(64);
+    while (t != nullptr) {
+      if (!N::less(t->key, l)) {
+        path_.push_back(t);
+        t = t->lch; }
+      else /* l > t->key */ { t = t->rch; } }
+    settle_();
+  }
+
+  inline bool valid() const { return !path_.empty() && !N::less(r_, path_.back()->key); }
+  inline const key_type& key() const { return path_.back()->key; }
+  inline uint64_t val() const { return find_value(path_.back(), v_); }
+  inline basic_entry<key_type> get() const { return basic_entry<key_type>{key(), val()}; }
+
+  inline void next() {
+    assert(valid());
+    step_();
+    settle_();
+  }
+};
+
+using cursor = basic_cursor<>;
+
+/* collects the keys in [l, r] present at version v in order, the pieces are collected in parallel,
+ * a covered subtree is cut by its counters at the latest version, as aug holds them */
+template <typename N>
+parlay::sequence<basic_entry<key_of<N>>> range_collect(const N* t, size_t v, const key_of<N>& l, const key_of<N>& r,
+    uint64_t grain = 4096) {
+  using constnode_ptr = const N*;
+  using entry = basic_entry<key_of<N>>;
+  std::vector<std::pair<constnode_ptr, bool>> pieces;
+  range_pieces(t, l, r, RANGE_COVER::OPEN_OPEN, grain, pieces);
+  auto parts = parlay::tabulate(pieces.size(), [&pieces, v](size_t i) {
+    auto [t, whole] = pieces[i];
+    parlay::sequence<entry> part;
+    if (!whole) {
+      uint64_t val = find_value(t, v);
+      if (val != 0) { part.push_back(entry{t->key, val}); } }
+    else {
+      constnode_ptr t_min = t, t_max = t;
+      while (t_min->lch != nullptr) { t_min = t_min->lch; }
+      while (t_max->rch != nullptr) { t_max = t_max->rch; }
+      for (basic_cursor<N> it(t, v, t_min->key, t_max->key); it.valid(); it.next()) { part.push_back(it.get()); } }
+    return part; }, 1);
+  return parlay::flatten(std::move(parts));
+}
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <assert.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/* cuts the nodes in [l, r] into in-order pieces, i.e. single nodes and fully covered subtrees,
+ * where a covered subtree whose aggregate is above grain is cut into smaller pieces;
+ * shared by the scans of the treap and of PAM, each with its own nodes and RANGE_COVER (see query.hpp) */
+template <typename N, typename Cover>
+void range_pieces(const N* t, const typename N::key_type& l, const typename N::key_type& r, Cover d, uint64_t grain,
+    std::vector<std::pair<const N*, bool>>& pieces) {
+  if (t == nullptr) { return; }
+  switch (d) {
+    case Cover::OPEN_OPEN:
+      if (N::less(r, t->key)) { return range_pieces(t->lch, l, r, d, grain, pieces); }
+      if (N::less(t->key, l)) { return range_pieces(t->rch, l, r, d, grain, pieces); }
+      range_pieces(t->lch, l, r, Cover::OPEN_CLOSE, grain, pieces);
+      pieces.emplace_back(t, false);
+      range_pieces(t->rch, l, r, Cover::CLOSE_OPEN, grain, pieces);
+      break;
+    case Cover::OPEN_CLOSE:
+      if (N::less(t->key, l)) { return range_pieces(t->rch, l, r, d, grain, pieces); }
+      range_pieces(t->lch, l, r, d, grain, pieces);
+      pieces.emplace_back(t, false);
+      range_pieces(t->rch, l, r, Cover::CLOSE_CLOSE, grain, pieces);
+      break;
+    case Cover::CLOSE_OPEN:
+      if (N::less(r, t->key)) { return range_pieces(t->lch, l, r, d, grain, pieces); }
+      range_pieces(t->lch, l, r, Cover::CLOSE_CLOSE, grain, pieces);
+      pieces.emplace_back(t, false);
+      range_pieces(t->rch, l, r, d, grain, pieces);
+      break;
+    case Cover::CLOSE_CLOSE:
+      if (t->aug <= grain) { pieces.emplace_back(t, true); break; }
+      range_pieces(t->lch, l, r, d, grain, pieces);
+      pieces.emplace_back(t, false);
+      range_pieces(t->rch, l, r, d, grain, pieces);
+      break;
+    default: assert(false); }
+}
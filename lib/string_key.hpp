@@ -0,0 +1,92 @@
+#pragma once
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "lib/aes_hash.hpp"
+#include "lib/arena.hpp"
+
+/* A string key in 16 bytes, ordered lexicographically by its bytes.
+ * head holds the first 7 bytes in big-endian order above the length capped at 8, so comparing heads as
+ * integers follows the lexicographic order, and only two keys longer than 7 bytes with the same prefix tie.
+ * Such a key refers to its full bytes: tail holds the length in its top 16 bits and their address below. */
+class string_key {
+private:
+  static constexpr size_t prefix_len_ = 7;
+  static constexpr uint64_t addr_mask_ = (uint64_t{1} << 48) - 1;
+
+  uint64_t head_;
+  uint64_t tail_; // 0 if the key is not longer than the prefix
+
+  static inline uint64_t make_head_(std::string_view s) {
+    uint64_t head = 0;
+    for (size_t i = 0; i < prefix_len_ && i < s.size(); i++) {
+      head |= uint64_t{static_cast<uint8_t>(s[i])} << (8 * (prefix_len_ - i)); }
+    return head | std::min(s.size(), prefix_len_ + 1);
+  }
+
+  inline const char* data_() const {
+    return reinterpret_cast<const char*>(tail_ & addr_mask_);
+  }
+
+public:
+  static constexpr size_t max_size = (size_t{1} << 16) - 1;
+
+  string_key() : head_(0), tail_(0) { }
+
+  // refers to the bytes of s, which must outlive the key if it is longer than the prefix
+  explicit string_key(std::string_view s) : head_(make_head_(s)), tail_(0) {
+    assert(s.size() <= max_size);
+    if (s.size() > prefix_len_) {
+      uint64_t addr = reinterpret_cast<uint64_t>(s.data());
+      assert((addr & ~addr_mask_) == 0);
+      tail_ = (uint64_t{s.size()} << 48) | addr; }
+  }
+
+  // copies the bytes of s into arena when they do not fit in the prefix
+  static inline string_key make(std::string_view s, chunk_arena& arena) {
+    if (s.size() <= prefix_len_) { return string_key(s); }
+    char* p = arena.allocate(s.size());
+    std::memcpy(p, s.data(), s.size());
+    return string_key(std::string_view(p, s.size()));
+  }
+
+  inline size_t size() const {
+    return tail_ == 0 ? (head_ & 0xff) : (tail_ >> 48);
+  }
+
+  std::string str() const {
+    if (tail_ != 0) { return std::string(data_(), size()); }
+    std::string s(size(), '\0');
+    for (size_t i = 0; i < s.size(); i++) { s[i] = static_cast<char>(head_ >> (8 * (prefix_len_ - i))); }
+    return s;
+  }
+
+  // the same for equal keys wherever their bytes are
+  inline uint64_t priority() const {
+    return tail_ == 0 ? aes_hash::hash(head_) : aes_hash::hash_bytes(data_(), size());
+  }
+
+  friend inline bool operator<(const string_key& a, const string_key& b) {
+    if (a.head_ != b.head_) { return a.head_ < b.head_; }
+    // the same head of short keys means the same key
+    if (a.tail_ == 0) { return false; }
+    size_t len_a = a.size(), len_b = b.size();
+    int c = std::memcmp(a.data_() + prefix_len_, b.data_() + prefix_len_, std::min(len_a, len_b) - prefix_len_);
+    return c < 0 || (c == 0 && len_a < len_b);
+  }
+
+  friend inline bool operator==(const string_key& a, const string_key& b) {
+    if (a.head_ != b.head_) { return false; }
+    if (a.tail_ == 0) { return true; }
+    return a.size() == b.size() && std::memcmp(a.data_(), b.data_(), a.size()) == 0;
+  }
+};
+
+static_assert(sizeof(string_key) == 16);
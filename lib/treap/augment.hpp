@@ -11,14 +11,16 @@
 
 namespace treap {
 
-uint64_t augment(node_ptr t) {
+template <typename N>
+uint64_t augment(N* t) {
   if (t == nullptr) { return 0; }
   if (t->aug != aug_uninitialized) { return t->aug; }
   t->aug = augment(t->lch) + t->val + augment(t->rch);
   return t->aug;
 }
 
-uint64_t augment_parallel(node_ptr t) {
+template <typename N>
+uint64_t augment_parallel(N* t) {
   if (t == nullptr) { return 0; }
   if (t->aug != aug_uninitialized) { return t->aug; }
   uint64_t aug_l, aug_r;
@@ -11,10 +11,12 @@
 
 namespace treap {
 
-std::tuple<node_ptr, node_ptr> split(node_ptr t, uint64_t key) {
+template <typename N>
+std::tuple<N*, N*> split(N* t, const key_of<N>& key) {
+  using node_ptr = N*;
   node_ptr t_l, t_r;
   if (t == nullptr) { return std::make_tuple(nullptr, nullptr); }
-  else if (key < t->key) {
+  else if (N::less(key, t->key)) {
     t_r = t;
     std::tie(t_l, t_r->lch) = split(t->lch, key); }
   else /* key > t->key */ {
@@ -23,11 +25,13 @@ std::tuple<node_ptr, node_ptr> split(node_ptr t, uint64_t key) {
   return std::make_tuple(t_l, t_r);
 }
 
-node_ptr merge(node_ptr t_0, node_ptr t_1) {
+template <typename N>
+N* merge(N* t_0, N* t_1) {
+  using node_ptr = N*;
   if (t_0 == nullptr) { return t_1; }
   if (t_1 == nullptr) { return t_0; }
 
-  if (t_0->key == t_1->key) {
+  if (N::equal(t_0->key, t_1->key)) {
     t_1->val += t_0->val; // update value
     parlay::par_do(
       [t_0, t_1] { t_1->lch = merge(t_0->lch, t_1->lch); },
@@ -37,13 +41,13 @@ node_ptr merge(node_ptr t_0, node_ptr t_1) {
 
   node_ptr t_l, t_r;
   // choose the node with higher priority as the root node
-  if (t_0->pry > t_1->pry) {
+  if (t_0->priority() > t_1->priority()) {
     std::tie(t_l, t_r) = split(t_1, t_0->key);
     parlay::par_do(
       [t_0, t_l] { t_0->lch = merge(t_0->lch, t_l); },
       [t_0, t_r] { t_0->rch = merge(t_0->rch, t_r); });
     return t_0; }
-  else /* t_0->pry < t_1->pry */ {
+  else /* t_0->priority() < t_1->priority() */ {
     std::tie(t_l, t_r) = split(t_0, t_1->key);
     parlay::par_do(
       [t_1, t_l] { t_1->lch = merge(t_l, t_1->lch); },
@@ -51,20 +55,38 @@ node_ptr merge(node_ptr t_0, node_ptr t_1) {
     return t_1; }
 }
 
-node_ptr build(size_t n, const uint64_t* elems) {
+// the leaves of build are blocks of up to this many keys, whose priorities are hashed together
+constexpr size_t build_block = 8;
+
+template <typename N>
+N* merge_nodes(N** ts, size_t n) {
+  if (n == 1) { return ts[0]; }
+  return merge(merge_nodes(ts, n / 2), merge_nodes(ts + n / 2, n - n / 2));
+}
+
+template <typename Key, typename Compare = std::less<Key>, bool StorePriority = true>
+basic_node<Key, Compare, StorePriority>* build(size_t n, const Key* elems) {
+  using node_t = basic_node<Key, Compare, StorePriority>;
+  using node_ptr = node_t*;
   if (n == 0) { return nullptr; }
-  if (n == 1) { return make_node(0, elems[0]); }
+  if (n <= build_block) {
+    uint64_t prys[build_block];
+    node_ptr ts[build_block];
+    node_t::priorities(elems, n, prys);
+    for (size_t i = 0; i < n; i++) { ts[i] = make_node<node_t>(0, prys[i], elems[i]); }
+    return merge_nodes(ts, n); }
   node_ptr t_0, t_1;
   parlay::par_do(
-    [n, elems, &t_0] { t_0 = build(n / 2, elems); },
-    [n, elems, &t_1] { t_1 = build(n - n / 2, elems + n / 2); });
+    [n, elems, &t_0] { t_0 = build<Key, Compare, StorePriority>(n / 2, elems); },
+    [n, elems, &t_1] { t_1 = build<Key, Compare, StorePriority>(n - n / 2, elems + n / 2); });
   return merge(t_0, t_1);
 }
 
-static inline node_ptr build_parallel(size_t n, const uint64_t* elems) {
-  node_ptr t;
+template <typename Key, typename Compare = std::less<Key>, bool StorePriority = true>
+static inline basic_node<Key, Compare, StorePriority>* build_parallel(size_t n, const Key* elems) {
+  basic_node<Key, Compare, StorePriority>* t;
   parlay::execute_with_scheduler(
-    [&t, n, elems](){ treap::augment_parallel(t = treap::build(n, elems)); },
+    [&t, n, elems](){ treap::augment_parallel(t = treap::build<Key, Compare, StorePriority>(n, elems)); },
     std::thread::hardware_concurrency());
   return t;
 }
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+#include "node.hpp"
+
+namespace treap {
+
+// the nodes of t
+template <typename N>
+size_t count_nodes(const N* t) {
+  if (t == nullptr) { return 0; }
+  return count_nodes(t->lch) + 1 + count_nodes(t->rch);
+}
+
+// the nodes version ver created under its root t: an update copies a path from the root,
+// so that they are the nodes of version ver connected to the root
+template <typename N>
+size_t count_created(const N* t, size_t ver) {
+  if (t == nullptr || t->ver != ver) { return 0; }
+  return count_created(t->lch, ver) + 1 + count_created(t->rch, ver);
+}
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include "node.hpp"
+
+namespace treap {
+
+/* In the latest-only mode a single writer keeps one treap, which readers traverse concurrently.
+ * Updating the counter of a present key does not change the shape, so it is applied in place: the aggregates
+ * on the path and the counter are rewritten. Inserting a new key or dropping one copies the path as usual; the nodes
+ * replaced by the copy are retired, and released by the writer once no reader of the old root remains.
+ * A reader sees a prefix of the updates: the in-place writes are fenced by a sequence count (see in_place_seq),
+ * and a traversal which overlapped one is retried, while a new root publishes a path copy at once. */
+
+// the readers take the fields with load_field (see node.hpp)
+static inline void store_field(uint64_t& field, uint64_t value) {
+  std::atomic_ref<uint64_t>(field).store(value, std::memory_order_relaxed);
+}
+
+/* the sequence count of the in-place updates, odd while one is written. A traversal is retried until no write
+ * began or ended during it; a reader which has been retried max_retries times holds the writer before its next
+ * in-place write instead, so that a reader completes however busy the writer is */
+class in_place_seq {
+private:
+  alignas(64) std::atomic_size_t seq_;
+  alignas(64) std::atomic_size_t holding_; // the readers holding the writer
+
+public:
+  static constexpr size_t max_retries = 8;
+
+  in_place_seq() : seq_(0), holding_(0) { }
+
+  // the store of the odd count and the load of the holding readers are ordered against the reader's, in reverse
+  inline void begin_write() {
+    for (;;) {
+      size_t seq = seq_.load(std::memory_order_relaxed);
+      seq_.store(seq + 1, std::memory_order_seq_cst);
+      if (holding_.load(std::memory_order_seq_cst) == 0) {
+        // the writes which follow are not seen before the odd count
+        std::atomic_thread_fence(std::memory_order_release);
+        return; }
+      seq_.store(seq + 2, std::memory_order_release);
+      while (holding_.load(std::memory_order_acquire) != 0) { std::this_thread::yield(); } }
+  }
+
+  inline void end_write() {
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  // runs read, which only reads the treap with load_field and may run several times, until it sees no write
+  template <typename F>
+  void read(F&& read) {
+    bool holding = false;
+    for (size_t retries = 0; ; retries++) {
+      if (retries == max_retries) {
+        holding_.fetch_add(1, std::memory_order_seq_cst);
+        holding = true; }
+      size_t seq = seq_.load(std::memory_order_seq_cst);
+      if (seq % 2 == 1) {
+        std::this_thread::yield();
+        continue; }
+      read();
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq_.load(std::memory_order_relaxed) == seq) { break; } }
+    if (holding) { holding_.fetch_sub(1, std::memory_order_release); }
+  }
+};
+
+// add a signed delta to the counter of a present key, whose counter stays positive
+template <typename N>
+void add_in_place(N* t, const key_of<N>& key, int64_t delta, uint64_t ref = ref_none) {
+  while (t != nullptr) {
+    store_field(t->aug, t->aug + delta);
+    if (N::equal(key, t->key)) {
+      store_field(t->val, t->val + delta);
+      if (ref != ref_none) { store_field(t->ref, ref); }
+      return; }
+    t = N::less(key, t->key) ? t->lch : t->rch; }
+}
+
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "node.hpp"
+
+namespace treap {
+
+/* Runs n range queries (a point query has l == r) on their snapshots, interleaved in the AMAC style.
+ * Every query in flight is a small state machine over the iterative form of range_estimate:
+ * it descends to the node splitting [l, r], then walks the left and the right boundary paths.
+ * A round takes one step of every query and prefetches what its next step touches,
+ * so the cache misses of up to width queries overlap instead of stalling one after another. */
+template <typename N>
+void range_estimate_interleaved(const N* const* roots, const key_of<N>* ls, const key_of<N>* rs, size_t n,
+    uint64_t* rets, size_t width = 16) {
+  enum phase : uint8_t { PH_SPLIT, PH_LEFT, PH_RIGHT, PH_DONE };
+
+  struct slot {
+    const N* t;
+    const N* t_right; // start of the right boundary path
+    const N* t_aug; // covered subtree whose aggregate is added in the next step, after its prefetch
+    uint64_t sum;
+    size_t idx;
+    phase ph;
+  };
+
+  auto prefetch = [](const N* t) { if (t != nullptr) { __builtin_prefetch(t); } };
+
+  auto step = [ls, rs, &prefetch](slot& s) {
+    if (s.t_aug != nullptr) {
+      s.sum += load_field(s.t_aug->aug);
+      s.t_aug = nullptr; }
+    const N* t = s.t;
+    const key_of<N>& l = ls[s.idx];
+    const key_of<N>& r = rs[s.idx];
+    switch (s.ph) {
+      case PH_SPLIT:
+        if (t == nullptr) { s.ph = PH_DONE; return; }
+        if (N::less(r, t->key)) { s.t = t->lch; }
+        else if (N::less(t->key, l)) { s.t = t->rch; }
+        else {
+          s.sum += load_field(t->val);
+          // the boundary paths are only needed where the range goes beyond the splitting key
+          s.t_right = N::less(t->key, r) ? t->rch : nullptr;
+          if (N::less(l, t->key)) {
+            s.t = t->lch;
+            s.ph = PH_LEFT; }
+          else {
+            s.t = s.t_right;
+            s.ph = PH_RIGHT;
+            prefetch(s.t);
+            return; } }
+        break;
+      case PH_LEFT:
+        if (t == nullptr) {
+          s.t = s.t_right;
+          s.ph = PH_RIGHT;
+          break; }
+        if (N::less(t->key, l)) { s.t = t->rch; }
+        else {
+          s.sum += load_field(t->val);
+          s.t_aug = t->rch;
+          s.t = t->lch; }
+        break;
+      case PH_RIGHT:
+        if (t == nullptr) {
+          s.ph = PH_DONE;
+          return; }
+        if (N::less(r, t->key)) { s.t = t->lch; }
+        else {
+          s.sum += load_field(t->val);
+          s.t_aug = t->lch;
+          s.t = t->rch; }
+        break;
+      default: break; }
+    prefetch(s.t_aug);
+    prefetch(s.t);
+  };
+
+  std::vector<slot> slots;
+  slots.reserve(width);
+  size_t next = 0;
+  for (; next < n && next < width; next++) {
+    slots.push_back(slot{roots[next], nullptr, nullptr, 0, next, PH_SPLIT});
+    prefetch(roots[next]); }
+  while (!slots.empty()) {
+    for (size_t i = 0; i < slots.size(); ) {
+      step(slots[i]);
+      if (slots[i].ph != PH_DONE || slots[i].t_aug != nullptr) {
+        i++;
+        continue; }
+      rets[slots[i].idx] = slots[i].sum;
+      // refill the slot with a new query, or shrink the window
+      if (next < n) {
+        slots[i] = slot{roots[next], nullptr, nullptr, 0, next, PH_SPLIT};
+        prefetch(roots[next]);
+        next++;
+        i++; }
+      else {
+        slots[i] = slots.back();
+        slots.pop_back(); } } }
+}
+
+}
@@ -3,9 +3,11 @@
 #include <assert.h>
 
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <type_traits>
 
 #include <mimalloc.h>
@@ -13,53 +15,141 @@
 #include <mimalloc-new-delete.h>
 
 #include "lib/aes_hash.hpp"
+#include "lib/alloc_count.hpp"
 
 namespace treap {
 
 static_assert(sizeof(size_t) == sizeof(std::atomic_size_t));
 static_assert(alignof(size_t) == alignof(std::atomic_size_t));
 
-struct alignas(64) node_t {
-  size_t ver;
+// the priority kept in a node
+template <bool Stored>
+struct priority_slot {
   uint64_t pry;
-  uint64_t key;
+  priority_slot(uint64_t p) : pry(p) { }
+};
+
+// nothing is kept if the node recomputes its priority from the key
+template <>
+struct priority_slot<false> {
+  priority_slot(uint64_t) { }
+};
+
+// the size of the fields of a node, next to its key and priority there are six words
+template <typename Key, bool StorePriority>
+constexpr size_t node_fields_size = 6 * sizeof(uint64_t) + sizeof(Key) + (StorePriority ? sizeof(uint64_t) : 0);
+
+/* a node with the stored priority takes whole cache lines, one without it only if its fields fill one exactly, so
+ * that dropping the priority of a 64-bit key makes the node smaller rather than padding it back to the line */
+template <typename Key, bool StorePriority>
+constexpr size_t node_alignment = StorePriority || node_fields_size<Key, StorePriority> == 64 ? 64
+  : std::max(alignof(Key), alignof(uint64_t));
+
+/* a node keyed by Key in the order of Compare, where two keys are the same if neither is less than the other,
+ * the priority of a key is its AES hash, so that Key is an integer, a 128-bit trivially copyable type,
+ * or provides its own priority() which is the same for equal keys (e.g. string_key),
+ * without StorePriority the node does not keep its priority but hashes its key whenever the priority is read */
+template <typename Key = uint64_t, typename Compare = std::less<Key>, bool StorePriority = true>
+struct alignas(node_alignment<Key, StorePriority>) basic_node {
+  using key_type = Key;
+  using key_compare = Compare;
+  static constexpr bool store_priority = StorePriority;
+
+  size_t ver;
+  [[no_unique_address]] priority_slot<StorePriority> pry;
+  Key key;
   uint64_t val; // in this demo, it's the counter of the key
   uint64_t aug; // in this demo, it's the sum of counters, 0 as uninitialized
-  node_t* lch;
-  node_t* rch;
+  basic_node* lch;
+  basic_node* rch;
+  uint64_t ref; // payload of the key, either inlined or referring to a value arena (see value.hpp)
+
+  static inline bool less(const Key& a, const Key& b) { return Compare{}(a, b); }
+  static inline bool equal(const Key& a, const Key& b) { return !less(a, b) && !less(b, a); }
+
+  static inline uint64_t priority(const Key& key) {
+    if constexpr (std::is_integral_v<Key>) { return aes_hash::hash(static_cast<uint64_t>(key)); }
+    else if constexpr (requires { key.priority(); }) { return key.priority(); }
+    else { return aes_hash::hash(key); }
+  }
+
+  inline uint64_t priority() const {
+    if constexpr (StorePriority) { return pry.pry; }
+    else { return priority(key); }
+  }
+
+  // the priorities of n keys, hashed several at a time for 64-bit integers
+  static inline void priorities(const Key* keys, size_t n, uint64_t* out) {
+    if constexpr (std::is_integral_v<Key> && sizeof(Key) == sizeof(uint64_t)) {
+      aes_hash::hash_many(reinterpret_cast<const uint64_t*>(keys), n, out); }
+    else { for (size_t i = 0; i < n; i++) { out[i] = priority(keys[i]); } }
+  }
 };
 
-static_assert(sizeof(node_t) == 64);
+template <typename N>
+using key_of = typename N::key_type;
 
+using node_t = basic_node<>;
 using node_ptr = node_t*;
 using constnode_ptr = const node_t*;
 
+static_assert(sizeof(node_t) == 64);
+// a 128-bit key fits in a cache line only without the stored priority
+static_assert(sizeof(basic_node<std::array<uint64_t, 2>, std::less<std::array<uint64_t, 2>>, false>) == 64);
+static_assert(alignof(basic_node<std::array<uint64_t, 2>, std::less<std::array<uint64_t, 2>>, false>) == 64);
+// and a 64-bit key without it saves a word per node
+static_assert(sizeof(basic_node<uint64_t, std::less<uint64_t>, false>) == 56);
+
 constexpr uint64_t aug_uninitialized = 0;
+constexpr uint64_t ref_none = 0;
+
+// the counters and aggregates read by the queries may be rewritten concurrently in the latest-only mode
+// (see in_place.hpp), so they are read as relaxed atomics, which costs a plain load
+static inline uint64_t load_field(const uint64_t& field) {
+  return std::atomic_ref<uint64_t>(const_cast<uint64_t&>(field)).load(std::memory_order_relaxed);
+}
 
-static inline node_ptr make_node(size_t ver, uint64_t pry, uint64_t key) {
-  return new node_t{ver, pry, key, 1, aug_uninitialized, nullptr, nullptr};
+// pry is dropped by a node without the stored priority
+template <typename N = node_t>
+static inline N* make_node(size_t ver, uint64_t pry, const key_of<N>& key, uint64_t cnt = 1, uint64_t ref = ref_none) {
+  alloc_count::count(alloc_count::NODE_MADE);
+  alloc_count::count(alloc_count::BYTES_MADE, sizeof(N));
+  return new N{ver, pry, key, cnt, aug_uninitialized, nullptr, nullptr, ref};
 }
 
-static inline node_ptr make_node(size_t ver, uint64_t key) {
-  return make_node(ver, aes_hash::hash(key), key);
+template <typename N = node_t>
+static inline N* make_node(size_t ver, const key_of<N>& key) {
+  return make_node<N>(ver, N::priority(key), key);
 }
 
-static inline node_ptr make_weak_copy(constnode_ptr t) {
+template <typename N>
+static inline N* make_weak_copy(const N* t) {
   assert(t != nullptr);
-  return new node_t{t->ver, t->pry, t->key, t->val, aug_uninitialized, nullptr, nullptr};
+  alloc_count::count(alloc_count::NODE_MADE);
+  alloc_count::count(alloc_count::NODE_COPIED);
+  alloc_count::count(alloc_count::BYTES_MADE, sizeof(N));
+  return new N{t->ver, t->pry, t->key, t->val, aug_uninitialized, nullptr, nullptr, t->ref};
 }
 
-static inline node_ptr make_weak_copy(constnode_ptr t, size_t ver) {
+template <typename N>
+static inline N* make_weak_copy(const N* t, size_t ver) {
   assert(t != nullptr);
-  return new node_t{ver, t->pry, t->key, t->val, aug_uninitialized, nullptr, nullptr};
+  alloc_count::count(alloc_count::NODE_MADE);
+  alloc_count::count(alloc_count::NODE_COPIED);
+  alloc_count::count(alloc_count::BYTES_MADE, sizeof(N));
+  return new N{ver, t->pry, t->key, t->val, aug_uninitialized, nullptr, nullptr, t->ref};
 }
 
-static inline void release_node(node_ptr t) {
+template <typename N>
+static inline void release_node(N* t) {
   assert(t != nullptr);
+  alloc_count::count(alloc_count::NODE_RELEASED);
+  alloc_count::count(alloc_count::BYTES_RELEASED, sizeof(N));
   delete t;
 }
 
-void release_tree(node_ptr t) {
+template <typename N>
+void release_tree(N* t) {
   if (t == nullptr) { return; }
   release_tree(t->lch);
   release_tree(t->rch);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "node.hpp"
+
+namespace treap {
+
+template <typename N>
+static inline uint64_t subtree_aug(const N* t) {
+  return t == nullptr ? 0 : t->aug;
+}
+
+// the sum of counters of the keys less than key in an augmented snapshot
+template <typename N>
+static inline uint64_t rank(const N* t, const key_of<N>& key) {
+  uint64_t ret = 0;
+  while (t != nullptr) {
+    if (!N::less(t->key, key)) { t = t->lch; }
+    else /* key > t->key */ {
+      ret += subtree_aug(t->lch) + t->val;
+      t = t->rch; } }
+  return ret;
+}
+
+// the node holding the k-th counter (from 0) in key order, nullptr if k is out of range
+template <typename N>
+static inline const N* select(const N* t, uint64_t k) {
+  while (t != nullptr) {
+    uint64_t aug_l = subtree_aug(t->lch);
+    if (k < aug_l) { t = t->lch; }
+    else if (k < aug_l + t->val) { return t; }
+    else /* k >= aug_l + t->val */ {
+      k -= aug_l + t->val;
+      t = t->rch; } }
+  return nullptr;
+}
+
+/* selects the nodes of n ascending ranks in one descent,
+ * the ranks falling into the same subtree share the path down to it */
+template <typename N>
+void select_many(const N* t, const uint64_t* ks, size_t n, uint64_t base, const N** out) {
+  if (n == 0) { return; }
+  if (t == nullptr) {
+    std::fill(out, out + n, nullptr);
+    return; }
+  uint64_t aug_l = base + subtree_aug(t->lch);
+  size_t n_l = std::lower_bound(ks, ks + n, aug_l) - ks;
+  size_t n_m = std::lower_bound(ks + n_l, ks + n, aug_l + t->val) - ks;
+  select_many(t->lch, ks, n_l, base, out);
+  std::fill(out + n_l, out + n_m, t);
+  select_many(t->rch, ks + n_m, n - n_m, aug_l + t->val, out + n_m);
+}
+
+static inline uint64_t quantile_rank(uint64_t total, double q) {
+  assert(total > 0);
+  return std::min<uint64_t>(total - 1, std::max(0.0, std::floor(q * total)));
+}
+
+// the key at quantile q in [0, 1] by nearest rank, requires a non-empty snapshot
+template <typename N>
+static inline key_of<N> quantile(const N* t, double q) {
+  return select(t, quantile_rank(t->aug, q))->key;
+}
+
+// the keys at n ascending quantiles in one descent, requires a non-empty snapshot
+template <typename N>
+std::vector<key_of<N>> quantiles(const N* t, const double* qs, size_t n) {
+  std::vector<uint64_t> ks(n);
+  for (size_t i = 0; i < n; i++) { ks[i] = quantile_rank(t->aug, qs[i]); }
+  std::vector<const N*> nodes(n);
+  select_many(t, ks.data(), n, 0, nodes.data());
+  std::vector<key_of<N>> keys(n);
+  for (size_t i = 0; i < n; i++) { keys[i] = nodes[i]->key; }
+  return keys;
+}
+
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <assert.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "lib/parlay/primitives.h"
+#include "lib/parlay/sequence.h"
+#include "lib/range_pieces.hpp"
+#include "node.hpp"
+#include "query.hpp"
+
+namespace treap {
+
+template <typename Key = uint64_t>
+struct basic_entry { Key key; uint64_t val; };
+
+using entry = basic_entry<>;
+
+// in-order cursor over the keys in [l, r] of a snapshot, it keeps the path on an explicit stack
+template <typename N = node_t>
+class basic_cursor {
+private:
+  using constnode_ptr = const N*;
+  using key_type = key_of<N>;
+
+  std::vector<constnode_ptr> path_;
+  key_type r_;
+
+  void push_left_(constnode_ptr t) {
+    for (; t != nullptr; t = t->lch) { path_.push_back(t); }
+  }
+
+public:
+  basic_cursor(constnode_ptr t, const key_type& l, const key_type& r) : r_(r) {
+    path_.reserve(64);
+    while (t != nullptr) {
+      if (!N::less(t->key, l)) {
+        path_.push_back(t);
+        t = t->lch; }
+      else /* l > t->key */ { t = t->rch; } }
+  }
+
+  inline bool valid() const { return !path_.empty() && !N::less(r_, path_.back()->key); }
+  inline const key_type& key() const { return path_.back()->key; }
+  inline uint64_t val() const { return path_.back()->val; }
+  inline constnode_ptr node() const { return path_.back(); } // e.g. to read its payload by value_of
+  inline basic_entry<key_type> get() const { return basic_entry<key_type>{key(), val()}; }
+
+  inline void next() {
+    assert(valid());
+    constnode_ptr t = path_.back();
+    path_.pop_back();
+    push_left_(t->rch);
+  }
+};
+
+using cursor = basic_cursor<>;
+
+// collects the keys in [l, r] of an augmented snapshot in order, the pieces are collected in parallel
+template <typename N>
+parlay::sequence<basic_entry<key_of<N>>> range_collect(const N* t, const key_of<N>& l, const key_of<N>& r,
+    uint64_t grain = 4096) {
+  using constnode_ptr = const N*;
+  using entry = basic_entry<key_of<N>>;
+  std::vector<std::pair<constnode_ptr, bool>> pieces;
+  range_pieces(t, l, r, RANGE_COVER::OPEN_OPEN, grain, pieces);
+  auto parts = parlay::tabulate(pieces.size(), [&pieces](size_t i) {
+    auto [t, whole] = pieces[i];
+    parlay::sequence<entry> part;
+    if (!whole) { part.push_back(entry{t->key, t->val}); }
+    else {
+      constnode_ptr t_min = t, t_max = t;
+      while (t_min->lch != nullptr) { t_min = t_min->lch; }
+      while (t_max->rch != nullptr) { t_max = t_max->rch; }
+      for (basic_cursor<N> it(t, t_min->key, t_max->key); it.valid(); it.next()) { part.push_back(it.get()); } }
+    return part; }, 1);
+  return parlay::flatten(std::move(parts));
+}
+
+}
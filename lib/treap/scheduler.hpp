@@ -1,17 +1,21 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <thread>
 #include <tuple>
 #include <type_traits>
+#include <utility>
 
 #include <mimalloc.h>
 #include <mimalloc-override.h>
 #include <mimalloc-new-delete.h>
 
 #include "utils/log.h"
+#include "utils/perf.h"
 #include "augment.hpp"
 #include "node.hpp"
 #include "search_delete.hpp"
@@ -19,8 +23,12 @@
 
 namespace treap {
 
-struct scheduler {
+template <typename Key = uint64_t, typename Compare = std::less<Key>, bool StorePriority = true>
+struct basic_scheduler {
 private:
+  using node_t = basic_node<Key, Compare, StorePriority>;
+  using node_ptr = node_t*;
+
   enum status     : uint8_t { ST_RUNNING, ST_DONE };
   enum operation  : uint8_t { OP_NONE, OP_INSERT, OP_DELETE };
   enum functor    : uint8_t { FN_SEARCH, FN_SETREF, FN_CONCAT };
@@ -37,11 +45,13 @@ private:
     node_ptr t_past = nullptr;
     size_t ver = 0;
     uint64_t pry = 0;
-    uint64_t key = 0;
+    Key key{ };
     node_ptr t_l = nullptr;
     node_ptr t_r = nullptr;
     alignas(64) std::atomic_size_t stage{0};
     node_ptr root = nullptr;
+    uint64_t cnt = 0;
+    uint64_t ref = ref_none;
     alignas(128) std::byte _[0];
 
     void done() {
@@ -69,13 +79,16 @@ private:
   aligned_counter* const tokens_;
   aligned_counter* const num_estimated_;
 
-  const size_t num_tasks_;
+  const size_t capacity_;
+  std::atomic_size_t num_tasks_; // the capacity, or the tasks issued once sealed
   context* const ctxs_;
+  const std::function<void(size_t)> on_commit_; // called by the collector with the versions committed so far
 
   alignas(128) size_t num_issued_;
   alignas(128) std::atomic_size_t num_submitted_;
   alignas(128) std::atomic_size_t num_fetched_;
   alignas(128) std::atomic_size_t num_committed_;
+  alignas(128) std::atomic_size_t num_augmented_;
 
   static inline void wait_task_() {
    //  std::this_thread::yield();
@@ -92,44 +105,45 @@ private:
     else if (ctx->t_r == nullptr) {
       *tp = ctx->t_l;
       ctx->done(); }
-    else if (ctx->t_l->pry > ctx->t_r->pry) {
+    else if (ctx->t_l->priority() > ctx->t_r->priority()) {
       *tp = make_weak_copy(ctx->t_l, ctx->ver);
       ctx->dir = DIR_RIGHT; }
-    else /* ctx->t_l->pry < ctx->t_r->pry */ {
+    else /* ctx->t_l->priority() < ctx->t_r->priority() */ {
       *tp = make_weak_copy(ctx->t_r, ctx->ver);
       ctx->dir = DIR_LEFT; }
   }
 
   void update_(node_ptr* tp, context* ctx) {
     if (ctx->t_past == nullptr) {
-      if (ctx->op == OP_INSERT) { *tp = make_node(ctx->ver, ctx->pry, ctx->key); }
+      if (ctx->op == OP_INSERT) { *tp = make_node<node_t>(ctx->ver, ctx->pry, ctx->key, std::max<uint64_t>(ctx->cnt, 1), ctx->ref); }
       else /* ctx->op == OP_DELETE */ { *tp = nullptr; }
       ctx->done(); }
-    else if (ctx->t_past->pry > ctx->pry) {
+    else if (ctx->t_past->priority() > ctx->pry) {
       *tp = make_weak_copy(ctx->t_past, ctx->ver);
-      ctx->dir = ctx->key < ctx->t_past->key ? DIR_LEFT : DIR_RIGHT; }
-    else if (ctx->t_past->key == ctx->key) {
+      ctx->dir = node_t::less(ctx->key, ctx->t_past->key) ? DIR_LEFT : DIR_RIGHT; }
+    else if (node_t::equal(ctx->t_past->key, ctx->key)) {
       if (ctx->op == OP_INSERT) {
         *tp = make_weak_copy(ctx->t_past, ctx->ver);
-        (*tp)->val++;
+        (*tp)->val += ctx->cnt;
+        if (ctx->ref != ref_none) { (*tp)->ref = ctx->ref; }
         ctx->fn = FN_SETREF; }
       else /* ctx->op == OP_DELETE */ {
-        if (ctx->t_past->val == 1) {
+        if (ctx->t_past->val <= ctx->cnt) {
           size_t vdep = ctx->t_past->ver;
           while (num_committed_.load(std::memory_order_acquire) < vdep) { wait_dependence_(); }
           ctx->t_l = ctx->t_past->lch;
           ctx->t_r = ctx->t_past->rch;
           ctx->fn = FN_CONCAT;
           concat_(tp, ctx); }
-        else /* ctx->t_past->val > 1 */ {
+        else /* ctx->t_past->val > ctx->cnt */ {
           *tp = make_weak_copy(ctx->t_past, ctx->ver);
-          (*tp)->val--;
+          (*tp)->val -= ctx->cnt;
           ctx->fn = FN_SETREF; } } }
-    else /* ctx->t_past->pry < ctx->pry */ {
+    else /* ctx->t_past->priority() < ctx->pry */ {
       if (ctx->op == OP_INSERT) {
         size_t vdep = ctx->t_past->ver;
         while (num_committed_.load(std::memory_order_acquire) < vdep) { wait_dependence_(); }
-        *tp = process_deploy(ctx->ver, ctx->t_past, ctx->pry, ctx->key); }
+        *tp = process_deploy(ctx->ver, ctx->t_past, ctx->pry, ctx->key, ctx->cnt, ctx->ref); }
       else /* ctx->op == OP_DELETE */ { *tp = ctx->t_past; }
       ctx->done(); }
   }
@@ -170,16 +184,16 @@ private:
         ctx->t_cur->rch = ctx->t_past->rch;
         ctx->t_past = ctx->t_past->lch;
         if (ctx->op == OP_INSERT) {
-          ctx->t_cur->lch = search_insert(ctx->ver, ctx->t_past, ctx->pry, ctx->key); }
+          ctx->t_cur->lch = search_insert(ctx->ver, ctx->t_past, ctx->pry, ctx->key, ctx->cnt, ctx->ref); }
         else /* ctx->op == OP_DELETE */ {
-          ctx->t_cur->lch = search_delete(ctx->ver, ctx->t_past, ctx->pry, ctx->key); } }
+          ctx->t_cur->lch = search_delete(ctx->ver, ctx->t_past, ctx->pry, ctx->key, ctx->cnt); } }
       else /* ctx->dir == DIR_RIGHT */ {
         ctx->t_cur->lch = ctx->t_past->lch;
         ctx->t_past = ctx->t_past->rch;
         if (ctx->op == OP_INSERT) {
-          ctx->t_cur->rch = search_insert(ctx->ver, ctx->t_past, ctx->pry, ctx->key); }
+          ctx->t_cur->rch = search_insert(ctx->ver, ctx->t_past, ctx->pry, ctx->key, ctx->cnt, ctx->ref); }
         else /* ctx->op == OP_DELETE */ {
-          ctx->t_cur->rch = search_delete(ctx->ver, ctx->t_past, ctx->pry, ctx->key); } } }
+          ctx->t_cur->rch = search_delete(ctx->ver, ctx->t_past, ctx->pry, ctx->key, ctx->cnt); } } }
     else if (ctx->fn == FN_SETREF) {
       ctx->t_cur->lch = ctx->t_past->lch;
       ctx->t_cur->rch = ctx->t_past->rch; }
@@ -198,9 +212,15 @@ private:
 
   void pipe_thread_(size_t id) {
     log_debug("start pipe %zu", id);
-    for (size_t pos = 1; pos <= num_tasks_; ++pos) {
+    utils::perf::thread_scope perf(utils::perf::PIPE);
+    for (size_t pos = 1; pos <= capacity_; ++pos) {
       size_t my_token = tokens_[id-1].data.fetch_sub(1, std::memory_order_acquire);
       if (my_token == 0) { std::atomic_wait(&tokens_[id-1].data, ~size_t{0}); }
+      // the token past the tasks sealed wakes every pipe in turn to stop
+      if (pos > num_tasks_.load(std::memory_order_acquire)) {
+        size_t next_token = 1+tokens_[id].data.fetch_add(1, std::memory_order_release);
+        if (next_token == 0) { tokens_[id].data.notify_one(); }
+        break; }
       log_trace("[pipe %zu] starts executing task %zu", id, pos);
       if (ctxs_[pos].st != ST_DONE) { execute_one_step_(&ctxs_[pos]); }
       log_trace("[pipe %zu] completes task %zu", id, pos);
@@ -211,22 +231,26 @@ private:
 
   void boarder_thread_() {
     log_debug("start boarder");
-    for (size_t local_submitted = 0; local_submitted < num_tasks_; ) {
+    utils::perf::thread_scope perf(utils::perf::BOARDER);
+    for (size_t local_submitted = 0; local_submitted < num_tasks_.load(std::memory_order_acquire); ) {
       size_t num_tokens = tokens_[num_pipes_].data.exchange(0, std::memory_order_acquire);
       if (num_tokens > 0) {
-        local_submitted += num_tokens;
+        local_submitted = std::min(local_submitted + num_tokens, num_tasks_.load(std::memory_order_acquire));
         log_trace("[boarder] submits task before %zu", local_submitted);
         num_submitted_.store(local_submitted, std::memory_order_release); } }
     log_debug("stop boarder");
   }
 
-  void work_update_(size_t id, size_t& task_id, size_t& cached_submit) {
+  // idle is called while the task fetched is not submitted yet, and returns whether it did some work instead
+  template <typename Idle>
+  void work_update_(size_t id, size_t& task_id, size_t& cached_submit, Idle&& idle) {
     task_id = 1+num_fetched_.fetch_add(1, std::memory_order_acquire);
-    if (task_id > num_tasks_) { return; }
+    if (task_id > num_tasks_.load(std::memory_order_acquire)) { return; }
     log_trace("[worker %zu] fetches task %zu", id, task_id);
     while (task_id > cached_submit) {
+      if (task_id > num_tasks_.load(std::memory_order_acquire)) { return; } // sealed before it
       cached_submit = num_submitted_.load(std::memory_order_acquire);
-      if (task_id > cached_submit) { wait_task_(); } }
+      if (task_id > cached_submit && !idle()) { wait_task_(); } }
     context* ctx = &ctxs_[task_id];
     for (size_t stage = 1; ctx->st != ST_DONE; stage++) {
       ctx->stage.store(stage, std::memory_order_release);
@@ -246,33 +270,56 @@ private:
 
   void worker_thread_(size_t id) {
     log_debug("start worker %zu", id);
+    utils::perf::thread_scope perf(utils::perf::WORKER);
     size_t task_id = 0;
     size_t cached_submit = 0;
     size_t block_count = 0;
     size_t block_start = (id-1) * block_size_ + 1;
-    size_t block_end = std::min(block_start+block_size_-1, num_tasks_);
-    while (task_id <= num_tasks_) {
-      work_update_(id, task_id, cached_submit);
+    size_t block_end = std::min(block_start+block_size_-1, capacity_);
+    // augments the next block of the worker, whose versions are all committed
+    auto estimate = [&]() {
+      work_estimate_(block_start, block_end);
+      block_count++;
+      block_start += num_workers_ * block_size_;
+      block_end = std::min(block_start+block_size_-1, num_tasks_.load(std::memory_order_acquire));
+      num_estimated_[id-1].data.store(block_count, std::memory_order_release); };
+    /* the tasks of a block may all be fetched by the other workers, e.g. when a flush pads it and no task comes
+     * after, so a worker waiting for a task augments its block as soon as the block is committed */
+    auto idle = [&]() {
+      if (block_start > num_tasks_.load(std::memory_order_acquire) ||
+          num_committed_.load(std::memory_order_acquire) < block_end) { return false; }
+      estimate();
+      return true; };
+    while (task_id <= num_tasks_.load(std::memory_order_acquire)) {
+      work_update_(id, task_id, cached_submit, idle);
+      if (task_id > num_tasks_.load(std::memory_order_acquire)) { break; }
       if (task_id >= block_end) {
-        work_estimate_(block_start, block_end);
-        block_count++;
-        block_start += num_workers_ * block_size_;
-        block_end = std::min(block_start+block_size_-1, num_tasks_);
-        num_estimated_[id-1].data.store(block_count, std::memory_order_release); } }
+        /* the other workers may still build the versions up to the block, which augment would cache sums over;
+         * they hold all of them already, so the wait is short, whereas skipping the block here would leave it
+         * unaugmented until the next task is submitted, e.g. after a flush */
+        while (num_committed_.load(std::memory_order_acquire) < block_end) { wait_dependence_(); }
+        estimate(); } }
+    // a worker moves one block per fetched task, so it may fall behind its blocks near the end (or the seal)
+    while (block_start <= num_tasks_.load(std::memory_order_acquire)) {
+      block_end = std::min(block_end, num_tasks_.load(std::memory_order_acquire));
+      while (num_committed_.load(std::memory_order_acquire) < block_end) { wait_dependence_(); }
+      estimate(); }
     log_debug("stop worker %zu", id);
   }
 
   void collector_thread_() {
     log_debug("start collector");
-    for (size_t local_committed = 0; local_committed < num_tasks_; ) {
+    utils::perf::thread_scope perf(utils::perf::COLLECTOR);
+    for (size_t local_committed = 0; local_committed < num_tasks_.load(std::memory_order_acquire); ) {
       size_t next_committable = local_committed;
-      while (next_committable < num_tasks_) {
+      while (next_committable < capacity_) {
         if (!ctxs_[next_committable+1].is_done()) { break; }
         ++next_committable; }
       if (next_committable > local_committed) {
         local_committed = next_committable;
         log_trace("[collector] commits task before %zu", local_committed);
-        num_committed_.store(local_committed, std::memory_order_release); } }
+        num_committed_.store(local_committed, std::memory_order_release);
+        if (on_commit_) { on_commit_(local_committed); } } }
     log_debug("stop collector");
   }
 
@@ -286,15 +333,17 @@ private:
     return p > 0 ? p : 1;
   }
 
-  inline void init_context_(operation op, uint64_t elem) {
+  inline void init_context_(operation op, const Key& elem, uint64_t cnt = 1, uint64_t ref = ref_none) {
     num_issued_++;
     log_trace("[master] receives task %zu", num_issued_);
     context* ctx = &ctxs_[num_issued_];
     ctx->op = op;
     ctx->ver = num_issued_;
     if (op != OP_NONE) {
-      ctx->pry = aes_hash::hash(elem);
+      ctx->pry = node_t::priority(elem);
       ctx->key = elem;
+      ctx->cnt = cnt;
+      ctx->ref = ref;
       ctx->t_past = ctxs_[num_issued_-1].root;
       update_(&ctx->root, ctx);
       ctx->t_cur = ctx->root; }
@@ -307,7 +356,8 @@ private:
   }
 
 public:
-  scheduler(size_t num_threads, size_t num_tasks, size_t block_size, node_ptr t0) :
+  basic_scheduler(size_t num_threads, size_t num_tasks, size_t block_size, node_ptr t0,
+      std::function<void(size_t)> on_commit = nullptr) :
     num_pipes_(decide_num_pipes_(num_threads)),
     num_workers_(decide_num_workers_(num_threads)),
     block_size_(block_size),
@@ -317,30 +367,44 @@ public:
     collector_(new std::thread[1]),
     tokens_(new aligned_counter[num_pipes_+1]),
     num_estimated_(new aligned_counter[num_workers_]),
+    capacity_(num_tasks),
     num_tasks_(num_tasks),
     ctxs_(new context[num_tasks+1]),
-    num_issued_(0), num_submitted_(0), num_fetched_(0), num_committed_(0)
+    on_commit_(std::move(on_commit)),
+    num_issued_(0), num_submitted_(0), num_fetched_(0), num_committed_(0), num_augmented_(0)
   {
     ctxs_[0].root = t0;
     ctxs_[0].done();
     for (size_t thread_id = 1; thread_id <= num_pipes_; ++thread_id) {
-      new (&pipes_[thread_id-1]) std::thread(&scheduler::pipe_thread_, this, thread_id); }
-    new (boarder_) std::thread(&scheduler::boarder_thread_, this);
+      new (&pipes_[thread_id-1]) std::thread(&basic_scheduler::pipe_thread_, this, thread_id); }
+    new (boarder_) std::thread(&basic_scheduler::boarder_thread_, this);
     for (size_t thread_id = 1; thread_id <= num_workers_; ++thread_id) {
-      new (&workers_[thread_id-1]) std::thread(&scheduler::worker_thread_, this, thread_id); }
-    new (collector_) std::thread(&scheduler::collector_thread_, this);
+      new (&workers_[thread_id-1]) std::thread(&basic_scheduler::worker_thread_, this, thread_id); }
+    new (collector_) std::thread(&basic_scheduler::collector_thread_, this);
   }
 
-  inline void insert_elem(uint64_t elem) {
+  inline void insert_elem(const Key& elem) {
     init_context_(OP_INSERT, elem);
   }
 
-  inline void delete_elem(uint64_t elem) {
+  inline void delete_elem(const Key& elem) {
     init_context_(OP_DELETE, elem);
   }
 
+  // add a signed delta to the counter of elem, the key is deleted once its counter reaches zero
+  inline void add_elem(const Key& elem, int64_t delta) {
+    if (delta > 0) { init_context_(OP_INSERT, elem, delta); }
+    else if (delta < 0) { init_context_(OP_DELETE, elem, -static_cast<uint64_t>(delta)); }
+    else { init_context_(OP_NONE, Key{ }); }
+  }
+
+  // attach a payload (see value.hpp) to elem, a new key is counted once
+  inline void put_elem(const Key& elem, uint64_t ref) {
+    init_context_(OP_INSERT, elem, 0, ref);
+  }
+
   inline size_t nop() {
-    init_context_(OP_NONE, 0);
+    init_context_(OP_NONE, Key{ });
     return num_issued_;
   }
 
@@ -351,18 +415,59 @@ public:
     collector_->join();
   }
 
-  inline node_ptr get_snapshot(size_t ver) {
-    if (ver > num_issued_) { return nullptr; }
-    size_t block_id = ver / block_size_;
+  // the i-th block of tasks (from 0) covers versions [i*block_size_+1, (i+1)*block_size_]
+  inline bool is_estimated_(size_t block_id) {
     size_t block_worker = block_id % num_workers_;
     size_t block_pos = block_id / num_workers_;
-    while (num_estimated_[block_worker].data.load(std::memory_order_acquire) <= block_pos) { wait_dependence_(); }
+    return num_estimated_[block_worker].data.load(std::memory_order_acquire) > block_pos;
+  }
+
+  inline node_ptr get_snapshot(size_t ver) {
+    if (ver > num_issued_) { return nullptr; }
+    if (ver > num_augmented_.load(std::memory_order_acquire)) {
+      while (!is_estimated_((ver-1) / block_size_)) { wait_dependence_(); } }
+    return ctxs_[ver].root;
+  }
+
+  /* the newest version whose snapshot is committed and augmented, so that reading it never waits,
+   * it is advanced by the readers over the blocks whose augmentation has completed in order,
+   * from a version inside a block (capped by the commits) only up to the end of that block */
+  inline size_t last_augmented() {
+    size_t ver = num_augmented_.load(std::memory_order_acquire);
+    size_t ver_new = ver;
+    size_t end = num_tasks_.load(std::memory_order_acquire);
+    while (ver_new < end && is_estimated_(ver_new / block_size_)) {
+      ver_new = std::min((ver_new / block_size_ + 1) * block_size_, end); }
+    ver_new = std::min(ver_new, num_committed_.load(std::memory_order_acquire));
+    while (ver < ver_new && !num_augmented_.compare_exchange_weak(ver, ver_new, std::memory_order_acq_rel)) { }
+    return std::max(ver, ver_new);
+  }
+
+  inline node_ptr get_augmented_snapshot(size_t ver) {
+    assert(ver <= num_augmented_.load(std::memory_order_relaxed));
     return ctxs_[ver].root;
   }
 
   inline size_t last_version() {
     return num_issued_;
   }
+
+  // the no-ops completing the block of the latest task, which is augmented only once the block is full
+  inline size_t block_padding() const {
+    size_t end = std::min((num_issued_ + block_size_ - 1) / block_size_ * block_size_, capacity_);
+    return end - num_issued_;
+  }
+
+  /* ends the pipeline at the tasks issued so far, no task may come after, so that it completes without spending the
+   * rest of the capacity; the token past them wakes the threads waiting for more */
+  inline void seal() {
+    if (num_issued_ == num_tasks_.load(std::memory_order_relaxed)) { return; }
+    num_tasks_.store(num_issued_, std::memory_order_release);
+    size_t next_token = 1+tokens_[0].data.fetch_add(1, std::memory_order_release);
+    if (next_token == 0) { tokens_[0].data.notify_one(); }
+  }
 };
 
+using scheduler = basic_scheduler<>;
+
 }
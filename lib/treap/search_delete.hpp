@@ -2,46 +2,71 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
 #include "node.hpp"
 
 namespace treap {
 
-node_ptr process_concat(size_t ver, node_ptr t_l, node_ptr t_r) {
+template <typename N>
+N* process_concat(size_t ver, N* t_l, N* t_r) {
+  using node_ptr = N*;
   if (t_l == nullptr) { return t_r; }
   if (t_r == nullptr) { return t_l; }
   node_ptr t_new;
-  if (t_l->pry > t_r->pry) {
+  if (t_l->priority() > t_r->priority()) {
     t_new = make_weak_copy(t_l, ver);
     t_new->lch = t_l->lch;
     t_new->rch = process_concat(ver, t_l->rch, t_r); }
-  else /* t_l->pry < t_r->pry */ {
+  else /* t_l->priority() < t_r->priority() */ {
     t_new = make_weak_copy(t_r, ver);
     t_new->rch = t_r->rch;
     t_new->lch = process_concat(ver, t_l, t_r->lch); }
   return t_new;
 }
 
-node_ptr search_delete(size_t ver, node_ptr t_past, uint64_t pry, uint64_t key) {
+// subtract cnt from the counter of key, the key is deleted once its counter reaches zero
+template <typename N>
+N* search_delete(size_t ver, N* t_past, uint64_t pry, const key_of<N>& key, uint64_t cnt = 1) {
+  using node_ptr = N*;
   if (t_past == nullptr) { return nullptr; }
-  else if (t_past->pry > pry) {
+  else if (t_past->priority() > pry) {
     node_ptr t_new = make_weak_copy(t_past, ver);
-    if (key < t_past->key) {
+    if (N::less(key, t_past->key)) {
       t_new->rch = t_past->rch;
-      t_new->lch = search_delete(ver, t_past->lch, pry, key); }
+      t_new->lch = search_delete(ver, t_past->lch, pry, key, cnt); }
     else /* key > t_past->key */ {
       t_new->lch = t_past->lch;
-      t_new->rch = search_delete(ver, t_past->rch, pry, key); }
+      t_new->rch = search_delete(ver, t_past->rch, pry, key, cnt); }
     return t_new; }
-  else if (t_past->key == key) {
-    if (t_past->val == 1) { return process_concat(ver, t_past->lch, t_past->rch); }
+  else if (N::equal(t_past->key, key)) {
+    if (t_past->val <= cnt) { return process_concat(ver, t_past->lch, t_past->rch); }
     else {
       node_ptr t_new = make_weak_copy(t_past, ver);
-      t_new->val--;
+      t_new->val -= cnt;
       t_new->lch = t_past->lch;
       t_new->rch = t_past->rch;
       return t_new; } }
-  else /* t_past->pry < pry */ { return t_past; }
+  else /* t_past->priority() < pry */ { return t_past; }
+}
+
+// the nodes of t that search_delete replaces by its copies, so that they are not reachable from its result
+template <typename N>
+void replaced_by_search_delete(N* t, uint64_t pry, const key_of<N>& key, uint64_t cnt, std::vector<N*>& out) {
+  for (; t != nullptr && t->priority() > pry; t = N::less(key, t->key) ? t->lch : t->rch) { out.push_back(t); }
+  if (t == nullptr || !N::equal(t->key, key)) { return; }
+  out.push_back(t);
+  if (t->val > cnt) { return; }
+  // process_concat copies the nodes it descends through until either side runs out
+  N* t_l = t->lch;
+  N* t_r = t->rch;
+  while (t_l != nullptr && t_r != nullptr) {
+    if (t_l->priority() > t_r->priority()) {
+      out.push_back(t_l);
+      t_l = t_l->rch; }
+    else {
+      out.push_back(t_r);
+      t_r = t_r->lch; } }
 }
 
 }
@@ -1,17 +1,21 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <tuple>
+#include <vector>
 
 #include "node.hpp"
 
 namespace treap {
 
-std::tuple<node_ptr, node_ptr> split_copy(size_t ver, node_ptr t, uint64_t key) {
+template <typename N>
+std::tuple<N*, N*> split_copy(size_t ver, N* t, const key_of<N>& key) {
+  using node_ptr = N*;
   node_ptr t_l, t_r;
   if (t == nullptr) { return std::make_tuple(nullptr, nullptr); }
-  else if (key < t->key) {
+  else if (N::less(key, t->key)) {
     t_r = make_weak_copy(t, ver);
     t_r->rch = t->rch;
     std::tie(t_l, t_r->lch) = split_copy(ver, t->lch, key); }
@@ -22,30 +26,49 @@ std::tuple<node_ptr, node_ptr> split_copy(size_t ver, node_ptr t, uint64_t key)
   return std::make_tuple(t_l, t_r);
 }
 
-static inline node_ptr process_deploy(size_t ver, node_ptr t_past, uint64_t pry, uint64_t key) {
-  node_ptr t_new = make_node(ver, pry, key);
+template <typename N>
+static inline N* process_deploy(size_t ver, N* t_past, uint64_t pry, const key_of<N>& key, uint64_t cnt = 1,
+    uint64_t ref = ref_none) {
+  N* t_new = make_node<N>(ver, pry, key, std::max<uint64_t>(cnt, 1), ref);
   std::tie(t_new->lch, t_new->rch) = split_copy(ver, t_past, key);
   return t_new;
 }
 
-node_ptr search_insert(size_t ver, node_ptr t_past, uint64_t pry, uint64_t key) {
-  if (t_past == nullptr) { return make_node(ver, pry, key); }
-  else if (t_past->pry > pry) {
+// add cnt to the counter of key, the key is inserted if absent,
+// a put (cnt = 0 with a payload) only replaces the payload of a present key and counts a new key once
+template <typename N>
+N* search_insert(size_t ver, N* t_past, uint64_t pry, const key_of<N>& key, uint64_t cnt = 1,
+    uint64_t ref = ref_none) {
+  using node_ptr = N*;
+  if (t_past == nullptr) { return make_node<N>(ver, pry, key, std::max<uint64_t>(cnt, 1), ref); }
+  else if (t_past->priority() > pry) {
     node_ptr t_new = make_weak_copy(t_past, ver);
-    if (key < t_past->key) {
+    if (N::less(key, t_past->key)) {
       t_new->rch = t_past->rch;
-      t_new->lch = search_insert(ver, t_past->lch, pry, key); }
+      t_new->lch = search_insert(ver, t_past->lch, pry, key, cnt, ref); }
     else /* key > t_past->key */ {
       t_new->lch = t_past->lch;
-      t_new->rch = search_insert(ver, t_past->rch, pry, key); }
+      t_new->rch = search_insert(ver, t_past->rch, pry, key, cnt, ref); }
     return t_new; }
-  else if (t_past->key == key) {
+  else if (N::equal(t_past->key, key)) {
     node_ptr t_new = make_weak_copy(t_past, ver);
-    t_new->val++;
+    t_new->val += cnt;
+    if (ref != ref_none) { t_new->ref = ref; }
     t_new->lch = t_past->lch;
     t_new->rch = t_past->rch;
     return t_new; }
-  else /* t_past->pry < pry */ { return process_deploy(ver, t_past, pry, key); }
+  else /* t_past->priority() < pry */ { return process_deploy(ver, t_past, pry, key, cnt, ref); }
+}
+
+// the nodes of t that search_insert replaces by its copies, so that they are not reachable from its result
+template <typename N>
+void replaced_by_search_insert(N* t, uint64_t pry, const key_of<N>& key, std::vector<N*>& out) {
+  for (; t != nullptr && t->priority() > pry; t = N::less(key, t->key) ? t->lch : t->rch) { out.push_back(t); }
+  if (t != nullptr && N::equal(t->key, key)) {
+    out.push_back(t);
+    return; }
+  // split_copy copies the rest of the search path
+  for (; t != nullptr; t = N::less(key, t->key) ? t->lch : t->rch) { out.push_back(t); }
 }
 
 }
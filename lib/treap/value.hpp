@@ -0,0 +1,65 @@
+#pragma once
+
+#include <assert.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "lib/arena.hpp"
+#include "node.hpp"
+
+namespace treap {
+
+/* The payload of a key is kept in node_t::ref.
+ * A value of at most 7 bytes is inlined: the lowest byte holds (len << 1) | 1 and the value follows it.
+ * A longer value is appended to a value arena, and ref holds the address of its record, whose lowest bit is 0. */
+
+constexpr size_t ref_inline_max = sizeof(uint64_t) - 1;
+
+struct value_record {
+  size_t len;
+  char data[0];
+};
+
+static inline bool ref_is_inline(uint64_t ref) {
+  return (ref & 1) != 0;
+}
+
+template <typename N>
+static inline std::string_view value_of(const N* t) {
+  if (t == nullptr || t->ref == ref_none) { return { }; }
+  if (ref_is_inline(t->ref)) {
+    // x86 is little-endian, the value starts at the second byte of ref
+    const char* p = reinterpret_cast<const char*>(&t->ref);
+    return { p + 1, static_cast<size_t>((t->ref & 0xff) >> 1) }; }
+  const value_record* rec = reinterpret_cast<const value_record*>(t->ref);
+  return { rec->data, rec->len };
+}
+
+// an append-only arena of values, see chunk_arena for the visibility of the records
+class value_arena {
+private:
+  chunk_arena records_;
+
+public:
+  // returns the ref of value
+  uint64_t append(std::string_view value) {
+    if (value.size() <= ref_inline_max) {
+      uint64_t ref = (value.size() << 1) | 1;
+      std::memcpy(reinterpret_cast<char*>(&ref) + 1, value.data(), value.size());
+      return ref; }
+    value_record* rec = reinterpret_cast<value_record*>(records_.allocate(sizeof(value_record) + value.size()));
+    rec->len = value.size();
+    std::memcpy(rec->data, value.data(), value.size());
+    assert(!ref_is_inline(reinterpret_cast<uint64_t>(rec)));
+    return reinterpret_cast<uint64_t>(rec);
+  }
+
+  inline size_t bytes() const {
+    return records_.bytes();
+  }
+};
+
+}
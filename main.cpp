@@ -1,34 +1,52 @@
 
 #include <cstring>
-#include <fstream>
 #include <iostream>
 #include <string>
-#include <thread>
+#include <vector>
 
+#include "utils/histogram.h"
 #include "utils/log.h"
+#include "utils/machine.h"
+#include "utils/perf.h"
 #include "utils/timer.h"
 
 #include "db/include/interface.hpp"
-#include "db/batch.hpp"
-#include "db/contreap.hpp"
-#include "db/sequential.hpp"
-#include "lib/pam/interface.hpp"
+#include "db/include/memory_stats.hpp"
+#include "db/include/query_processor.hpp"
+#include "db/include/workload.hpp"
+#include "db/factory.hpp"
 
 void ExitWithHint(const char* command) {
   std::cerr << "Usage: " << command << " <method> <workload> [options]" << std::endl;
-  std::cerr << "Methods: contreap, sequential, pam" << std::endl;
+  std::cerr << "Methods: contreap, sequential, pam, inplace (latest-only)" << std::endl;
   std::cerr << "Options:" << std::endl;
   std::cerr << "  -threads n: number of server side threads (default: number of CPU cores)" << std::endl;
   std::cerr << "  -clients n: number of client side threads (default: 1)" << std::endl;
   std::cerr << "  -batchsize b: specify the batch size (default: 1000)" << std::endl;
+  std::cerr << "  -group g: number of queries a client interleaves, not for pam (default: 1)" << std::endl;
+  std::cerr << "  -cache n: cache the results of up to n ranges, contreap and sequential only (default: 0, i.e. off)" << std::endl;
+  std::cerr << "  -keep-last n: versions kept in full by the retention of sequential (default: 1024)" << std::endl;
+  std::cerr << "  -keep-every k: older versions kept, every k-th or none if 0 (default: 1, i.e. keep all)" << std::endl;
+  std::cerr << "  -window s: drop versions older than s seconds (default: 0, i.e. no limit)" << std::endl;
+  std::cerr << "  -perf: count cycles, instructions, cache, TLB and branch misses per thread role (default: off)" << std::endl;
+  std::cerr << "  -memory: report the nodes and bytes spent per version and the peak RSS, not for inplace;" << std::endl;
+  std::cerr << "           pam needs a build with -DCOUNT_ALLOCS, which also adds the allocator counts (default: off)" << std::endl;
+  std::cerr << "  -rate r: issue r transactions per second in an open loop and report the latencies (default: 0, i.e. as fast as possible)" << std::endl;
+  std::cerr << "  -poisson: Poisson arrivals at that rate instead of evenly spaced ones (default: off)" << std::endl;
+  std::cerr << "  -submitters n: push the queries from n threads of their own instead of the replay, not with -rate (default: 0)" << std::endl;
+  std::cerr << "  -session s: queries a submitter issues on the version it pins before it pins the newest one (default: 1000)" << std::endl;
+  std::cerr << "  -latest: answer queries on the newest readable version without ordering them (default: off)" << std::endl;
   exit(0);
 }
 
 std::string dbname;
 std::string filename;
-size_t num_threads = std::thread::hardware_concurrency();
-size_t num_clients = 1;
-size_t batch_size = 1000;
+DB::options opts;
+bool query_latest = false;
+bool memory = false;
+DB::arrivals arrivals;
+size_t num_submitters = 0;
+size_t session = 1000;
 
 void ParseCommandLine(int argc, const char *argv[]) {
   if (argc < 3) { ExitWithHint(argv[0]); }
@@ -39,75 +57,158 @@ void ParseCommandLine(int argc, const char *argv[]) {
     if (strcmp(argv[argindex], "-threads") == 0) {
       argindex++;
       if (argindex >= argc) { ExitWithHint(argv[0]); }
-      num_threads = std::stoi(argv[argindex]);
+      opts.num_threads = std::stoi(argv[argindex]);
       argindex++; }
     else if (strcmp(argv[argindex], "-clients") == 0) {
       argindex++;
       if (argindex >= argc) { ExitWithHint(argv[0]); }
-      num_clients = std::stoi(argv[argindex]);
+      opts.num_clients = std::stoi(argv[argindex]);
       argindex++; }
     else if (strcmp(argv[argindex], "-batchsize") == 0) {
       argindex++;
       if (argindex >= argc) { ExitWithHint(argv[0]); }
-      batch_size = std::stoi(argv[argindex]);
-      if (batch_size == 0) { batch_size = 1; }
+      opts.batch_size = std::stoi(argv[argindex]);
+      if (opts.batch_size == 0) { opts.batch_size = 1; }
+      argindex++; }
+    else if (strcmp(argv[argindex], "-group") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      opts.query_group = std::stoi(argv[argindex]);
+      if (opts.query_group == 0) { opts.query_group = 1; }
+      argindex++; }
+    else if (strcmp(argv[argindex], "-cache") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      opts.cache_size = std::stoul(argv[argindex]);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-keep-last") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      opts.retention.keep_last = std::stoul(argv[argindex]);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-keep-every") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      opts.retention.keep_every = std::stoul(argv[argindex]);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-window") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      opts.retention.window = std::stod(argv[argindex]);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-latest") == 0) {
+      query_latest = true;
+      argindex++; }
+    else if (strcmp(argv[argindex], "-perf") == 0) {
+      utils::perf::Enable();
+      argindex++; }
+    else if (strcmp(argv[argindex], "-rate") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      arrivals.rate = std::stod(argv[argindex]);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-poisson") == 0) {
+      arrivals.poisson = true;
+      argindex++; }
+    else if (strcmp(argv[argindex], "-submitters") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      num_submitters = std::stoul(argv[argindex]);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-session") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      session = std::stoul(argv[argindex]);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-memory") == 0) {
+      memory = opts.track_memory = true;
       argindex++; }
     else {
       log_fatal("Unknown option '%s'", argv[argindex]);
       ExitWithHint(argv[0]); } }
-  if (argindex != argc) { ExitWithHint(argv[0]); }
+  if (argindex != argc || (num_submitters > 0 && arrivals.rate > 0)) { ExitWithHint(argv[0]); }
 }
 
-struct tx_context {
-  uint8_t type;
-  uint64_t arg0;
-  uint64_t arg1;
-};
-
 int main(int argc, const char *argv[]) {
   ParseCommandLine(argc, argv);
 
-  DB::Interface* db;
-  if (dbname == "sequential") { db = new DB::Sequential(num_threads, num_clients); }
-  else if (dbname == "contreap") { db = new DB::Contreap(num_threads, num_clients, batch_size); }
-  else if (dbname == "pam") { db = new DB::Batch<pam::interface>(num_threads, num_clients, batch_size); }
-  else {
+  DB::Interface* db = DB::Create(dbname, opts);
+  if (db == nullptr) {
     log_fatal("Unknown method '%s'", dbname.c_str());
     ExitWithHint(argv[0]); }
 
-  std::ifstream fs(filename, std::ios::binary);
-  size_t n, m;
-  fs.read((char*)&n, sizeof(n));
-  fs.read((char*)&m, sizeof(m));
-  uint64_t* elems = new uint64_t[n];
-  fs.read((char*)elems, n * sizeof(uint64_t));
-  std::cout << "# Loaded records:\t" << n << std::endl;
-  tx_context* txs = new tx_context[m];
-  fs.read((char*)txs, m * sizeof(tx_context));
-  std::cout << "# Loaded transactions:\t" << m << std::endl;
+  DB::Workload w;
+  if (!w.Load(filename)) {
+    log_fatal("Cannot load workload '%s'", filename.c_str());
+    return 1; }
+  std::cout << "# Loaded records:\t" << w.n << std::endl;
+  std::cout << "# Loaded transactions:\t" << w.m << std::endl;
+
+  bool open_loop = arrivals.rate > 0;
+  DB::QueryProcessor* query_processor = db->Processor();
+  if (open_loop && query_processor != nullptr) { query_processor->Measure(); }
+  if (num_submitters > 0) {
+    if (query_processor == nullptr) {
+      log_fatal("'%s' takes no queries from other threads", dbname.c_str());
+      return 1; }
+    query_processor->AddProducers(num_submitters); }
 
-  db->Init(n, m, elems);
+  db->Init(w.n, w.m, w.elems);
 
   Timer tmr;
   tmr.Start();
 
-  for (size_t i = 0; i < m; i++) {
-    switch (txs[i].type) {
-      case 0 /* QUERY */: db->Query(txs[i].arg0, txs[i].arg1); break;
-      case 1 /* INSERT */: db->Insert(txs[i].arg0); break;
-      case 2 /* DELETE */: db->Delete(txs[i].arg0); break;
-      default: log_fatal("Unknown Transaction Type %u", (unsigned)txs[i].type); } }
+  utils::Histogram update_latencies;
+  uint64_t max_lag = 0;
+  std::vector<DB::submitter_stats> submitters;
+  {
+    // the master thread issues the transactions, the backend threads count until they end in Close
+    utils::perf::thread_scope perf(utils::perf::MASTER);
+    if (open_loop) { max_lag = w.ReplayOpen(db, query_latest, arrivals, update_latencies); }
+    else if (num_submitters > 0) { submitters = w.ReplayConcurrent(db, num_submitters, session); }
+    else { w.Replay(db, query_latest); } }
   db->Close();
 
   double duration = tmr.End();
 
   std::cout << "# Time Used (S)" << std::endl;
-  std::cout << dbname << '\t' << filename << '\t' << num_threads << '\t';
+  std::cout << dbname << '\t' << filename << '\t' << opts.num_threads << '\t';
   std::cout << duration << std::endl;
 
   std::cout << "# Transaction throughput (KTPS)" << std::endl;
-  std::cout << dbname << '\t' << filename << '\t' << num_threads << '\t';
-  std::cout << m / duration / 1000 << std::endl;
+  std::cout << dbname << '\t' << filename << '\t' << opts.num_threads << '\t';
+  std::cout << w.m / duration / 1000 << std::endl;
+
+  if (open_loop) {
+    // from the intended send times: queries until answered, updates until their call returns
+    auto print = [](const char* kind, const utils::Histogram& h) {
+      std::cout << kind << '\t' << h.count() << '\t' << h.mean() / 1000 << '\t' << h.percentile(0.5) / 1000.0 << '\t'
+                << h.percentile(0.99) / 1000.0 << '\t' << h.percentile(0.999) / 1000.0 << '\t' << h.max() / 1000.0 << std::endl; };
+    std::cout << "# Open-loop latency at " << arrivals.rate << (arrivals.poisson ? " TPS, Poisson" : " TPS")
+              << " (kind, count, mean, p50, p99, p99.9, max in microseconds)" << std::endl;
+    if (query_processor != nullptr) { print("query", query_processor->Latencies()); }
+    print("update", update_latencies);
+    std::cout << "# Largest lag of a send behind schedule (ms)" << std::endl;
+    std::cout << max_lag / 1e6 << std::endl; }
+
+  if (num_submitters > 0) {
+    // the rate a submitter pushes at, while the answers are counted in the transaction throughput above
+    std::cout << "# Query submitters (submitter, queries, KQPS pushed; all: answered over the run)" << std::endl;
+    size_t num_queries = 0;
+    for (size_t id = 0; id < submitters.size(); id++) {
+      num_queries += submitters[id].num_queries;
+      std::cout << id << '\t' << submitters[id].num_queries << '\t'
+                << submitters[id].num_queries / submitters[id].seconds / 1000 << std::endl; }
+    std::cout << "all\t" << num_queries << '\t' << num_queries / duration / 1000 << std::endl; }
+
+  utils::perf::Report(std::cout, w.m);
+
+  if (memory) {
+    DB::memory_stats stats;
+    if (db->MemoryStats(stats)) { stats.Print(std::cout); }
+    else { std::cout << "# Memory accounting is not supported by " << dbname << " in this build" << std::endl; }
+    std::cout << "# Peak RSS (MB)" << std::endl;
+    std::cout << utils::PeakRSS() / double(1 << 20) << std::endl; }
 
   return 0;
 }
@@ -0,0 +1,688 @@
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/log.h"
+#include "utils/perf.h"
+#include "utils/timer.h"
+
+#include "db/include/interface.hpp"
+#include "db/include/protocol.hpp"
+#include "db/include/query_processor.hpp"
+#include "db/include/shm_ring.hpp"
+#include "db/include/workload.hpp"
+#include "db/factory.hpp"
+#include "lib/moodycamel/concurrentqueue.h"
+
+void ExitWithHint(const char* command) {
+  std::cerr << "Usage: " << command << " <method> <workload> <socket> [options]" << std::endl;
+  std::cerr << "Serves the records of the workload by the method over the Unix domain socket, until interrupted" << std::endl;
+  std::cerr << "Methods: contreap, sequential, pam, inplace (latest-only)" << std::endl;
+  std::cerr << "Options:" << std::endl;
+  std::cerr << "  -threads n: number of server side threads (default: number of CPU cores)" << std::endl;
+  std::cerr << "  -clients n: number of query client threads (default: 1)" << std::endl;
+  std::cerr << "  -batchsize b: specify the batch size (default: 1000)" << std::endl;
+  std::cerr << "  -group g: number of queries a client interleaves, not for pam (default: 1)" << std::endl;
+  std::cerr << "  -cache n: cache the results of up to n ranges, contreap and sequential only (default: 0, i.e. off)" << std::endl;
+  std::cerr << "  -capacity m: versions the backend is built for, beyond which requests fail (default: transactions of the workload)" << std::endl;
+  exit(0);
+}
+
+std::string dbname;
+std::string filename;
+std::string socket_path;
+DB::options opts;
+size_t capacity = 0;
+
+void ParseCommandLine(int argc, const char *argv[]) {
+  if (argc < 4) { ExitWithHint(argv[0]); }
+  dbname = argv[1];
+  filename = argv[2];
+  socket_path = argv[3];
+  size_t argindex = 4;
+  while (argindex < argc && strncmp(argv[argindex], "-", 1) == 0) {
+    if (strcmp(argv[argindex], "-threads") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      opts.num_threads = std::stoi(argv[argindex]);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-clients") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      opts.num_clients = std::stoi(argv[argindex]);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-batchsize") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      opts.batch_size = std::stoi(argv[argindex]);
+      if (opts.batch_size == 0) { opts.batch_size = 1; }
+      argindex++; }
+    else if (strcmp(argv[argindex], "-group") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      opts.query_group = std::stoi(argv[argindex]);
+      if (opts.query_group == 0) { opts.query_group = 1; }
+      argindex++; }
+    else if (strcmp(argv[argindex], "-cache") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      opts.cache_size = std::stoul(argv[argindex]);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-capacity") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      capacity = std::stoul(argv[argindex]);
+      argindex++; }
+    else {
+      log_fatal("Unknown option '%s'", argv[argindex]);
+      ExitWithHint(argv[0]); } }
+  if (argindex != argc) { ExitWithHint(argv[0]); }
+}
+
+/* Serves a backend over a Unix domain socket (see db/include/protocol.hpp).
+ * An epoll loop accepts the connections, reads the requests and writes the responses. It queues the requests to
+ * a single writer thread, which issues them to the backend in the order they arrived, as the backends take their
+ * transactions from one thread. The updates are answered by the writer, the queries by the query clients of the
+ * backend as they return; both append to the output of the connection and wake the loop up to flush it.
+ * A connection may attach shared-memory rings (see db/include/shm_ring.hpp), which the writer reads itself
+ * and the responders write to directly, so that neither the loop nor a system call is on the way. */
+class Server {
+private:
+  static constexpr size_t max_connections_ = 1024;
+  static constexpr size_t read_size_ = 1 << 16;
+
+  // a request with the connection it came from, which tags its responses
+  struct op {
+    uint64_t tag; // the generation and the slot of the connection, above the 32 bits of the id
+    DB::protocol::request req;
+    DB::protocol::range* batch; // the ranges of a QUERY_BATCH or a QUERY_AT, owned
+  };
+
+  struct alignas(128) connection {
+    std::mutex mutex; // guards the fields below against the responders
+    int fd = -1;
+    uint16_t gen = 0; // bumped on close, so that the responses to a closed connection are dropped
+    bool flushing = false; // queued to the loop to be flushed
+    std::vector<uint8_t> out; // the responses that the completion ring had no room for, once attached
+    DB::shm::region* ring = nullptr;
+    uint32_t ring_capacity = 0;
+    std::atomic_bool overflowed{false}; // out holds responses for the ring, moved by the writer
+    // the loop only
+    bool waiting_out = false; // polled for writability, while out is not fully written
+    std::vector<uint8_t> in;
+    int passed_fd = -1; // received for an ATTACH
+  };
+
+  // the rings of a connection, attached or detached by the loop and read by the writer
+  struct attachment {
+    uint16_t slot;
+    uint64_t tag;
+    DB::shm::region* ring; // unmapped by the writer on detach
+    size_t size;
+    uint32_t capacity;
+    bool detach;
+  };
+
+  DB::Interface* const db_;
+  DB::QueryProcessor* const query_processor_;
+  const size_t capacity_;
+  size_t num_issued_; // the versions issued, the writer only
+
+  int listen_fd_;
+  int epoll_fd_;
+  int event_fd_;
+  int signal_fd_;
+
+  connection* const conns_;
+  std::vector<uint16_t> free_;
+  size_t num_requests_;
+  bool reading_; // false once interrupted, the requests received are answered but no more are read
+
+  moodycamel::ConcurrentQueue<op> ops_;
+  moodycamel::ProducerToken ops_token_;
+  moodycamel::ConcurrentQueue<uint16_t> ready_; // the connections to flush
+  alignas(128) std::atomic_bool woken_;
+  std::atomic_bool writing_;
+  std::thread writer_;
+
+  int doorbell_fd_;
+  DB::shm::doorbell* doorbell_; // the writer sleeps on it, for the requests of the loop and the rings alike
+  moodycamel::ConcurrentQueue<attachment> attaching_;
+  std::vector<attachment> rings_; // the writer only
+  std::vector<DB::protocol::range> ring_batch_; // the writer only
+  size_t num_ring_requests_; // the writer only
+
+  static constexpr uint64_t listen_key_ = ~uint64_t{0};
+  static constexpr uint64_t event_key_ = ~uint64_t{1};
+  static constexpr uint64_t signal_key_ = ~uint64_t{2};
+
+  static inline uint64_t tag_of_(uint16_t slot, uint16_t gen) {
+    return uint64_t{gen} << 48 | uint64_t{slot} << 32;
+  }
+
+  void watch_(int fd, uint64_t key, uint32_t events, int cmd = EPOLL_CTL_ADD) {
+    epoll_event ev;
+    ev.events = events;
+    ev.data.u64 = key;
+    if (epoll_ctl(epoll_fd_, cmd, fd, &ev) != 0) { log_error("epoll_ctl failed: %s", strerror(errno)); }
+  }
+
+  // called by the writer and the query clients
+  void respond_(uint64_t tag, uint8_t status, uint64_t value) {
+    uint16_t slot = (tag >> 32) & 0xffff;
+    connection& c = conns_[slot];
+    DB::protocol::response res{ static_cast<uint32_t>(tag), status, {}, value };
+    {
+      std::lock_guard<std::mutex> lock(c.mutex);
+      if (c.fd < 0 || c.gen != static_cast<uint16_t>(tag >> 48)) { return; }
+      if (c.ring != nullptr) {
+        if (DB::shm::push(c.ring->completions, DB::shm::completion_slots(c.ring, c.ring_capacity), c.ring_capacity, &res, 1)) {
+          DB::shm::notify(c.ring->completions);
+          return; }
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&res);
+        c.out.insert(c.out.end(), bytes, bytes + sizeof(res));
+        c.overflowed.store(true, std::memory_order_release);
+        return; }
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&res);
+      c.out.insert(c.out.end(), bytes, bytes + sizeof(res));
+      if (c.flushing) { return; }
+      c.flushing = true; }
+    ready_.enqueue(slot);
+    if (!woken_.exchange(true, std::memory_order_acq_rel)) {
+      uint64_t one = 1;
+      if (write(event_fd_, &one, sizeof(one)) != sizeof(one)) { log_error("cannot wake the loop up"); } }
+  }
+
+  void issue_(const op& o) {
+    using namespace DB::protocol;
+    const request& req = o.req;
+    uint64_t tag = o.tag | req.id;
+    size_t n = has_ranges(req) ? num_ranges(req) : 1;
+    if (req.op != QUERY_LATEST && req.op != QUERY_AT && num_issued_ >= capacity_) {
+      for (size_t i = 0; i < n; i++) { respond_(o.tag | static_cast<uint32_t>(req.id + i), FULL, 0); }
+      return; }
+    switch (req.op) {
+      case QUERY:
+        num_issued_++;
+        query_processor_->Tag(tag);
+        if (db_->Query(req.arg0, req.arg1) != 0) { respond_(tag, ERROR, 0); }
+        break;
+      case QUERY_LATEST:
+        query_processor_->Tag(tag);
+        if (db_->QueryLatest(req.arg0, req.arg1) != 0) { respond_(tag, ERROR, 0); }
+        break;
+      case QUERY_BATCH:
+      case QUERY_AT: {
+        // the first query takes a version, or looks it up by the time, which the others read too
+        if (req.op == QUERY_BATCH) { num_issued_++; }
+        query_processor_->Tag(tag);
+        int ret = req.op == QUERY_BATCH ? db_->Query(o.batch[0].l, o.batch[0].r) :
+          db_->QueryAt(req.arg0, o.batch[0].l, o.batch[0].r);
+        if (ret != 0) { respond_(tag, ERROR, 0); }
+        for (size_t i = 1; i < n; i++) {
+          uint64_t tag_i = o.tag | static_cast<uint32_t>(req.id + i);
+          query_processor_->Tag(tag_i);
+          if (ret != 0 || query_processor_->Push(query_processor_->LastPushed(), o.batch[i].l, o.batch[i].r) != 0) {
+            respond_(tag_i, ERROR, 0); } }
+        break; }
+      case INSERT:
+        num_issued_++;
+        respond_(tag, db_->Insert(req.arg0) == 0 ? OK : ERROR, 0);
+        break;
+      case DELETE:
+        num_issued_++;
+        respond_(tag, db_->Delete(req.arg0) == 0 ? OK : ERROR, 0);
+        break;
+      case ADD:
+        num_issued_++;
+        respond_(tag, db_->Add(req.arg0, static_cast<int64_t>(req.arg1)) == 0 ? OK : ERROR, 0);
+        break;
+      default:
+        respond_(tag, ERROR, 0); }
+  }
+
+  // takes the rings attached and detached by the loop
+  void attach_rings_() {
+    attachment a;
+    while (attaching_.try_dequeue(a)) {
+      if (!a.detach) {
+        rings_.push_back(a);
+        continue; }
+      for (size_t i = 0; i < rings_.size(); i++) {
+        if (rings_[i].ring != a.ring) { continue; }
+        munmap(rings_[i].ring, rings_[i].size);
+        rings_[i] = rings_.back();
+        rings_.pop_back();
+        break; } }
+  }
+
+  // issues up to bulk requests from every ring, and returns how many
+  size_t poll_rings_(size_t bulk) {
+    using namespace DB::protocol;
+    size_t num_issued = 0;
+    for (const attachment& a : rings_) {
+      DB::shm::ring_header& h = a.ring->requests;
+      const request* slots = DB::shm::request_slots(a.ring);
+      const uint32_t mask = a.capacity - 1;
+      uint32_t head = h.head.load(std::memory_order_relaxed);
+      uint32_t tail = h.tail.load(std::memory_order_acquire);
+      for (size_t n = 0; head != tail && n < bulk; n++) {
+        request req = slots[head++ & mask];
+        num_ring_requests_++;
+        range* batch = nullptr;
+        if (has_ranges(req)) {
+          size_t m = num_ranges(req);
+          if (m == 0 || m > max_batch || m > tail - head) {
+            respond_(a.tag | req.id, ERROR, 0);
+            continue; }
+          ring_batch_.resize(m);
+          for (range& q : ring_batch_) {
+            const request& slot = slots[head++ & mask];
+            q = range{ slot.arg0, slot.arg1 }; }
+          batch = ring_batch_.data(); }
+        issue_(op{ a.tag, req, batch });
+        num_issued++; }
+      h.head.store(head, std::memory_order_release); }
+    return num_issued;
+  }
+
+  // moves the responses that found a completion ring full into it, as room allows
+  void drain_overflows_() {
+    for (const attachment& a : rings_) {
+      connection& c = conns_[a.slot];
+      if (!c.overflowed.load(std::memory_order_acquire)) { continue; }
+      std::lock_guard<std::mutex> lock(c.mutex);
+      if (c.ring != a.ring) { continue; }
+      size_t n = std::min<size_t>(c.out.size() / sizeof(DB::protocol::response),
+        DB::shm::free_slots(c.ring->completions, c.ring_capacity));
+      if (n == 0) { continue; }
+      DB::shm::push(c.ring->completions, DB::shm::completion_slots(c.ring, c.ring_capacity), c.ring_capacity,
+        reinterpret_cast<const DB::protocol::response*>(c.out.data()), n);
+      DB::shm::notify(c.ring->completions);
+      c.out.erase(c.out.begin(), c.out.begin() + n * sizeof(DB::protocol::response));
+      if (c.out.empty()) { c.overflowed.store(false, std::memory_order_relaxed); } }
+  }
+
+  bool rings_pending_() const {
+    for (const attachment& a : rings_) {
+      if (a.ring->requests.tail.load(std::memory_order_acquire) != a.ring->requests.head.load(std::memory_order_relaxed)) {
+        return true; } }
+    return false;
+  }
+
+  // sleeps until rung or a millisecond has passed, which bounds the delay of a wakeup lost to a race
+  void sleep_() {
+    doorbell_->sleeping.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint32_t seq = doorbell_->seq.load(std::memory_order_relaxed);
+    if (ops_.size_approx() == 0 && attaching_.size_approx() == 0 && !rings_pending_()) {
+      DB::shm::futex_wait(&doorbell_->seq, seq, 1000000); }
+    doorbell_->sleeping.store(0, std::memory_order_relaxed);
+  }
+
+  /* issues the requests until stopped and drained, then closes the backend. Once idle, it flushes the backend if
+   * versions were issued since the last flush, since the queries of a client waiting for them may otherwise wait for
+   * the updates filling a batch; requests taking no version spend no capacity on padding.
+   * The rings are not read any more once stopped, as the sockets are not. */
+  void writer_thread_() {
+    utils::perf::thread_scope perf(utils::perf::MASTER);
+    constexpr size_t bulk = 256;
+    op ops[bulk];
+    size_t flushed = 0; // the versions issued at the last flush
+    for (bool writing = true; ; ) {
+      attach_rings_();
+      size_t n = ops_.try_dequeue_bulk(ops, bulk);
+      for (size_t i = 0; i < n; i++) {
+        issue_(ops[i]);
+        delete[] ops[i].batch; }
+      if (writing) { n += poll_rings_(bulk); }
+      drain_overflows_();
+      if (n == 0) {
+        if (!writing) { break; }
+        if (flushed < num_issued_) {
+          num_issued_ += db_->Flush();
+          flushed = num_issued_; }
+        else { sleep_(); } }
+      writing = writing_.load(std::memory_order_acquire); }
+    db_->Close();
+    log_debug("writer stopped after %zu versions", num_issued_);
+  }
+
+  void accept_() {
+    for (;;) {
+      int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) {
+        if (errno == EINTR) { continue; }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) { log_warn("accept failed: %s", strerror(errno)); }
+        return; }
+      if (free_.empty()) {
+        log_warn("too many connections, refuse one");
+        close(fd);
+        continue; }
+      uint16_t slot = free_.back();
+      free_.pop_back();
+      connection& c = conns_[slot];
+      {
+        std::lock_guard<std::mutex> lock(c.mutex);
+        c.fd = fd;
+        c.flushing = false;
+        c.out.clear(); }
+      c.waiting_out = false;
+      c.in.clear();
+      watch_(fd, slot, EPOLLIN | EPOLLRDHUP);
+      log_debug("connection %u opened", (unsigned)slot); }
+  }
+
+  void close_(uint16_t slot) {
+    connection& c = conns_[slot];
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, c.fd, nullptr);
+    {
+      std::lock_guard<std::mutex> lock(c.mutex);
+      close(c.fd);
+      c.fd = -1;
+      c.gen++;
+      c.out.clear();
+      if (c.ring != nullptr) {
+        attaching_.enqueue(attachment{ slot, 0, c.ring, 0, 0, true });
+        c.ring = nullptr;
+        c.overflowed.store(false, std::memory_order_relaxed); } }
+    c.in.clear();
+    if (c.passed_fd >= 0) {
+      close(c.passed_fd);
+      c.passed_fd = -1; }
+    free_.push_back(slot);
+    log_debug("connection %u closed", (unsigned)slot);
+  }
+
+  /* maps the region passed with an ATTACH and hands its rings to the writer, then answers with the doorbell attached.
+   * It is refused while responses are waiting to be written to the socket, false if the connection is lost */
+  bool attach_(uint16_t slot, const DB::protocol::request& req) {
+    using namespace DB::protocol;
+    connection& c = conns_[slot];
+    uint64_t tag = tag_of_(slot, c.gen);
+    int fd = c.passed_fd;
+    c.passed_fd = -1;
+    DB::shm::region* ring = nullptr;
+    size_t size = 0;
+    uint32_t capacity = 0;
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(DB::shm::region)) {
+      size = st.st_size;
+      void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (p != MAP_FAILED) {
+        ring = static_cast<DB::shm::region*>(p);
+        capacity = ring->capacity;
+        if (ring->magic != DB::shm::magic || capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+            DB::shm::region_size(capacity) > size) {
+          munmap(p, size);
+          ring = nullptr; } } }
+    if (fd >= 0) { close(fd); }
+    bool attached = false;
+    {
+      std::lock_guard<std::mutex> lock(c.mutex);
+      if (ring != nullptr && c.ring == nullptr && c.out.empty()) {
+        c.ring = ring;
+        c.ring_capacity = capacity;
+        attached = true; } }
+    if (!attached) {
+      if (ring != nullptr) { munmap(ring, size); }
+      log_warn("cannot attach rings to connection %u", (unsigned)slot);
+      respond_(tag | req.id, ERROR, 0);
+      return true; }
+    attaching_.enqueue(attachment{ slot, tag, ring, size, capacity, false });
+    DB::shm::ring(*doorbell_);
+    response res{ req.id, OK, {}, 0 };
+    if (DB::shm::send_fd(c.fd, &res, sizeof(res), doorbell_fd_) != sizeof(res)) { return false; }
+    log_debug("connection %u attached rings of %u slots", (unsigned)slot, capacity);
+    return true;
+  }
+
+  // queues the whole requests read so far, false on a malformed one
+  bool parse_(uint16_t slot) {
+    using namespace DB::protocol;
+    connection& c = conns_[slot];
+    size_t pos = 0;
+    while (c.in.size() - pos >= sizeof(request)) {
+      request req;
+      memcpy(&req, c.in.data() + pos, sizeof(req));
+      size_t len = sizeof(req);
+      range* batch = nullptr;
+      if (has_ranges(req)) {
+        size_t n = num_ranges(req);
+        if (n == 0 || n > max_batch) { return false; }
+        len += n * sizeof(range);
+        if (c.in.size() - pos < len) { break; }
+        batch = new range[n];
+        memcpy(batch, c.in.data() + pos + sizeof(req), n * sizeof(range)); }
+      pos += len;
+      num_requests_++;
+      if (req.op == ATTACH) {
+        if (!attach_(slot, req)) { return false; }
+        continue; }
+      ops_.enqueue(ops_token_, op{ tag_of_(slot, c.gen), req, batch }); }
+    c.in.erase(c.in.begin(), c.in.begin() + pos);
+    DB::shm::ring(*doorbell_);
+    return true;
+  }
+
+  void read_(uint16_t slot) {
+    connection& c = conns_[slot];
+    for (;;) {
+      size_t size = c.in.size();
+      c.in.resize(size + read_size_);
+      int fd;
+      ssize_t r = DB::shm::recv_fd(c.fd, c.in.data() + size, read_size_, &fd);
+      c.in.resize(size + std::max<ssize_t>(r, 0));
+      if (fd >= 0) {
+        if (c.passed_fd >= 0) { close(c.passed_fd); }
+        c.passed_fd = fd; }
+      if (r > 0) {
+        if (!parse_(slot)) {
+          log_warn("malformed request on connection %u", (unsigned)slot);
+          return close_(slot); }
+        continue; }
+      if (r < 0 && errno == EINTR) { continue; }
+      if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { return; }
+      return close_(slot); }
+  }
+
+  // writes out what the socket takes, and polls for writability while some is left
+  void flush_(uint16_t slot) {
+    connection& c = conns_[slot];
+    bool failed = false;
+    {
+      std::lock_guard<std::mutex> lock(c.mutex);
+      c.flushing = false;
+      if (c.fd < 0) { return; }
+      size_t done = 0;
+      while (done < c.out.size()) {
+        ssize_t w = send(c.fd, c.out.data() + done, c.out.size() - done, MSG_NOSIGNAL);
+        if (w > 0) { done += w; }
+        else if (w < 0 && errno == EINTR) { continue; }
+        else {
+          failed = errno != EAGAIN && errno != EWOULDBLOCK;
+          break; } }
+      c.out.erase(c.out.begin(), c.out.begin() + done);
+      if (!failed && c.out.empty() == c.waiting_out) {
+        c.waiting_out = !c.out.empty();
+        uint32_t events = (reading_ ? static_cast<uint32_t>(EPOLLIN | EPOLLRDHUP) : 0) |
+          (c.waiting_out ? static_cast<uint32_t>(EPOLLOUT) : 0);
+        watch_(c.fd, slot, events, EPOLL_CTL_MOD); } }
+    if (failed) { close_(slot); }
+  }
+
+  void flush_ready_() {
+    woken_.store(false, std::memory_order_release);
+    uint64_t count;
+    if (read(event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN) { log_error("cannot read the eventfd"); }
+    uint16_t slot;
+    while (ready_.try_dequeue(slot)) { flush_(slot); }
+  }
+
+  bool pending_() {
+    for (size_t slot = 0; slot < max_connections_; slot++) {
+      std::lock_guard<std::mutex> lock(conns_[slot].mutex);
+      if (conns_[slot].fd >= 0 && conns_[slot].ring == nullptr && !conns_[slot].out.empty()) { return true; } }
+    return false;
+  }
+
+  // one round of the loop, false once interrupted
+  bool poll_(int timeout_ms) {
+    epoll_event evs[64];
+    int n = epoll_wait(epoll_fd_, evs, 64, timeout_ms);
+    if (n < 0 && errno != EINTR) { log_error("epoll_wait failed: %s", strerror(errno)); }
+    bool running = true;
+    for (int i = 0; i < n; i++) {
+      uint64_t key = evs[i].data.u64;
+      if (key == listen_key_) { accept_(); }
+      else if (key == event_key_) { flush_ready_(); }
+      else if (key == signal_key_) { running = false; }
+      else {
+        uint16_t slot = key;
+        if (conns_[slot].fd < 0) { continue; }
+        if (evs[i].events & EPOLLOUT) { flush_(slot); }
+        if (conns_[slot].fd < 0) { continue; }
+        if (reading_ && (evs[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) { read_(slot); }
+        else if (evs[i].events & (EPOLLHUP | EPOLLERR)) { close_(slot); } } }
+    return running;
+  }
+
+public:
+  // called before the backend is initialized, which starts its query clients
+  Server(DB::Interface* db, const std::string& path, size_t capacity) :
+    db_(db),
+    query_processor_(db->Processor()),
+    capacity_(capacity),
+    num_issued_(0),
+    conns_(new connection[max_connections_]),
+    num_requests_(0),
+    reading_(true),
+    ops_(),
+    ops_token_(ops_),
+    woken_(false),
+    writing_(false),
+    num_ring_requests_(0) {
+    query_processor_->OnResult([this](uint64_t tag, uint64_t ret) { respond_(tag, DB::protocol::OK, ret); });
+    for (size_t slot = max_connections_; slot > 0; slot--) { free_.push_back(slot-1); }
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) { log_fatal("socket path too long: %s", path.c_str()); exit(1); }
+    strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0 || bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd_, 128) != 0) {
+      log_fatal("cannot listen on %s: %s", path.c_str(), strerror(errno));
+      exit(1); }
+
+    // SIGINT and SIGTERM are blocked by the caller before any thread starts, and read here
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    signal_fd_ = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (signal_fd_ < 0 || event_fd_ < 0 || epoll_fd_ < 0) { log_fatal("cannot set the loop up: %s", strerror(errno)); exit(1); }
+    doorbell_fd_ = memfd_create("contreap-doorbell", MFD_CLOEXEC);
+    void* p = doorbell_fd_ < 0 || ftruncate(doorbell_fd_, sizeof(DB::shm::doorbell)) != 0 ? MAP_FAILED :
+      mmap(nullptr, sizeof(DB::shm::doorbell), PROT_READ | PROT_WRITE, MAP_SHARED, doorbell_fd_, 0);
+    if (p == MAP_FAILED) { log_fatal("cannot set the doorbell up: %s", strerror(errno)); exit(1); }
+    doorbell_ = new (p) DB::shm::doorbell();
+    watch_(listen_fd_, listen_key_, EPOLLIN);
+    watch_(event_fd_, event_key_, EPOLLIN);
+    watch_(signal_fd_, signal_key_, EPOLLIN);
+  }
+
+  // serves until interrupted, then answers the requests received and flushes the responses for up to a second
+  void Run() {
+    writing_.store(true, std::memory_order_release);
+    writer_ = std::thread(&Server::writer_thread_, this);
+    while (poll_(-1)) { }
+    log_info("interrupted, draining %zu requests received", num_requests_);
+    reading_ = false;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, listen_fd_, nullptr);
+    close(listen_fd_);
+    writing_.store(false, std::memory_order_release);
+    // the connections are not read any more, but flushed while the writer drains
+    for (size_t slot = 0; slot < max_connections_; slot++) {
+      if (conns_[slot].fd < 0) { continue; }
+      watch_(conns_[slot].fd, slot, conns_[slot].waiting_out ? static_cast<uint32_t>(EPOLLOUT) : 0, EPOLL_CTL_MOD); }
+    std::atomic_bool drained{false};
+    std::thread joiner([this, &drained]() {
+      writer_.join();
+      drained.store(true, std::memory_order_release);
+      uint64_t one = 1;
+      if (write(event_fd_, &one, sizeof(one)) != sizeof(one)) { log_error("cannot wake the loop up"); } });
+    while (!drained.load(std::memory_order_acquire)) { poll_(100); }
+    joiner.join();
+    Timer tmr;
+    tmr.Start();
+    flush_ready_();
+    while (pending_() && tmr.End() < 1) { poll_(100); }
+    for (size_t slot = 0; slot < max_connections_; slot++) { if (conns_[slot].fd >= 0) { close_(slot); } }
+  }
+
+  // the requests received, over the sockets and the rings, once run
+  inline size_t NumRequests() const {
+    return num_requests_ + num_ring_requests_;
+  }
+};
+
+int main(int argc, const char *argv[]) {
+  ParseCommandLine(argc, argv);
+
+  // blocked in every thread, the server reads them from a signalfd
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  DB::Interface* db = DB::Create(dbname, opts);
+  if (db == nullptr) {
+    log_fatal("Unknown method '%s'", dbname.c_str());
+    ExitWithHint(argv[0]); }
+
+  DB::Workload w;
+  if (!w.Load(filename)) {
+    log_fatal("Cannot load workload '%s'", filename.c_str());
+    return 1; }
+  if (capacity == 0) { capacity = w.m; }
+  std::cout << "# Loaded records:\t" << w.n << std::endl;
+  std::cout << "# Capacity (versions):\t" << capacity << std::endl;
+
+  Server server(db, socket_path, capacity);
+  db->Init(w.n, capacity, w.elems);
+  std::cout << "# Listening on:\t" << socket_path << std::endl;
+
+  Timer tmr;
+  tmr.Start();
+  server.Run();
+  double duration = tmr.End();
+  unlink(socket_path.c_str());
+
+  std::cout << "# Requests served" << std::endl;
+  std::cout << dbname << '\t' << socket_path << '\t' << server.NumRequests() << std::endl;
+  std::cout << "# Time Used (S)" << std::endl;
+  std::cout << dbname << '\t' << socket_path << '\t' << duration << std::endl;
+
+  return 0;
+}
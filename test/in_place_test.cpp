@@ -0,0 +1,92 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/log.h"
+
+#include "db/factory.hpp"
+#include "db/include/query_processor.hpp"
+#include "lib/treap/build.hpp"
+#include "lib/treap/in_place.hpp"
+#include "lib/treap/query.hpp"
+#include "reference.hpp"
+
+/* Checks that a query of the latest-only backend (db/in_place.hpp) sees a prefix of the updates while they are
+ * applied in place. The updates move a counter between two keys of a range, adding to the lower key first and then
+ * subtracting from the higher one, so that the range holds its total or one more after every prefix; a traversal
+ * which counted the later subtraction but not the earlier addition would find one less. A read of the two halves of
+ * the range with such moves written between them must first be retried by treap::in_place_seq, then the backend is
+ * queried while the moves are applied. Exits 1 on a count which is not of a prefix. */
+
+constexpr size_t num_keys = 4096;
+constexpr uint64_t key_gap = 16;
+constexpr uint64_t initial = 1000; // the counter of every key, which the moves keep positive
+constexpr size_t num_moves = 400000;
+constexpr size_t query_every = 4;
+
+int main(int argc, const char *argv[]) {
+  std::mt19937_64 rng(argc > 1 ? std::stoul(argv[1]) : 2024);
+
+  std::vector<uint64_t> elems;
+  for (size_t i = 0; i < num_keys; i++) { elems.push_back(i * key_gap); }
+  // the lower half of the keys, split between the subtrees of several nodes
+  const uint64_t l = 0, r = (num_keys / 2) * key_gap - 1;
+  const uint64_t total = num_keys / 2 * initial;
+
+  // the moves written in the middle of the first reads, which must be retried until one sees none
+  treap::node_ptr t = treap::build_parallel(elems.size(), elems.data());
+  treap::in_place_seq seq;
+  const uint64_t m = (num_keys / 4) * key_gap;
+  size_t num_reads = 0;
+  uint64_t ret;
+  seq.read([&]() {
+    ret = treap::range_estimate(t, l, m - 1);
+    if (++num_reads <= 3) {
+      seq.begin_write();
+      treap::add_in_place(t, uint64_t{0}, 1);
+      seq.end_write();
+      seq.begin_write();
+      treap::add_in_place(t, m, -1);
+      seq.end_write(); }
+    ret += treap::range_estimate(t, m, r); });
+  if (ret != num_keys / 2 || num_reads != 4) {
+    log_error("the read overlapping the moves found %lu after %zu reads, %lu after 4 expected", ret, num_reads,
+      num_keys / 2);
+    return 1; }
+  treap::release_tree(t);
+
+  DB::options opts;
+  opts.num_clients = 2;
+  DB::Interface* db = DB::Create("inplace", opts);
+  db->Processor()->OnResult([total](uint64_t tag, uint64_t ret) {
+    num_checked++;
+    if (ret == total || ret == total + 1) { return; }
+    num_failures++;
+    log_error("query %lu on [%lu, %lu]: %lu or %lu expected, %lu found", tag, l, r, total, total + 1, ret); });
+  db->Init(elems.size(), num_moves * 2, elems.data());
+  for (uint64_t key : elems) { db->Add(key, initial - 1); }
+
+  size_t num_queries = 0;
+  for (size_t i = 0; i < num_moves; i++) {
+    uint64_t a = rng() % (num_keys / 2), b = rng() % (num_keys / 2);
+    if (a == b) { continue; }
+    if (a > b) { std::swap(a, b); }
+    db->Add(a * key_gap, 1);
+    db->Add(b * key_gap, -1);
+    if (i % query_every != 0) { continue; }
+    db->Processor()->Tag(num_queries);
+    while (db->Query(l, r) != 0) { std::this_thread::yield(); }
+    num_queries++; }
+  db->Close();
+  delete db;
+
+  if (num_failures > 0 || num_checked != num_queries) {
+    log_error("%zu of %zu queries differ, %zu answered", num_failures.load(), num_queries, num_checked.load());
+    return 1; }
+  log_info("%zu queries during %zu moves, all saw a prefix of the updates", num_queries, num_moves);
+  return 0;
+}
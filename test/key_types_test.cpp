@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "utils/log.h"
+
+#include "lib/arena.hpp"
+#include "lib/composite_key.hpp"
+#include "lib/pam/interface.hpp"
+#include "lib/string_key.hpp"
+#include "lib/treap/augment.hpp"
+#include "lib/treap/build.hpp"
+#include "lib/treap/query.hpp"
+#include "lib/treap/rank.hpp"
+#include "lib/treap/search_delete.hpp"
+#include "lib/treap/search_insert.hpp"
+#include "reference.hpp"
+
+/* Checks treap and PAM instantiated on other key types and orders than uint64_t and std::less: 32-bit, descending,
+ * composite and string keys, the latter inlined when short and tying on long prefixes otherwise, and treaps that
+ * hash their keys for the priorities instead of storing them. The reference model counts key indices, the key of
+ * index i coming i-th in the order of every instantiation, so that the same updates and probes of find,
+ * range_estimate, rank and select apply to all of them. Exits 1 on a mismatch. */
+
+constexpr size_t num_keys = 2000;
+constexpr uint64_t key_range = 10000;
+constexpr size_t num_batches = 8;
+constexpr size_t batch_size = 200;
+constexpr size_t num_probes = 32;
+constexpr size_t sample_every = 29;
+
+// keys holds the key of every index in [0, key_range], ascending in the order of Compare,
+// without StorePriority the treap nodes hash their keys for the priority instead (PAM always stores it)
+template <typename Key, typename Compare, bool StorePriority = true>
+void run(const char* type, const std::vector<Key>& keys, uint64_t seed) {
+  using node_t = treap::basic_node<Key, Compare, StorePriority>;
+  using P = pam::basic_interface<Key, Compare>;
+  std::mt19937_64 rng(seed);
+
+  multiset model = make_model(rng, num_keys, key_range);
+  std::vector<Key> elems;
+  for (uint64_t i : keys_of(model)) { elems.push_back(keys[i]); }
+
+  // the index of the key of a node, or key_range for none
+  auto index_of = [&keys](const auto* t) -> uint64_t {
+    if (t == nullptr) { return key_range; }
+    for (size_t i = 0; i < key_range; i++) { if (node_t::equal(keys[i], t->key)) { return i; } }
+    return key_range + 1; };
+
+  // a treap snapshot per version and a PAM tree per batch, which answers every version of its batch
+  const size_t num_versions = num_batches * batch_size;
+  std::vector<node_t*> roots(num_versions + 1);
+  std::vector<typename P::node_ptr> trees(num_batches + 1);
+  roots[0] = treap::build_parallel<Key, Compare, StorePriority>(elems.size(), elems.data());
+  trees[0] = P::build(elems.size(), elems.data());
+  std::map<size_t, multiset> samples{ { 0, model } };
+
+  for (size_t b = 0; b < num_batches; b++) {
+    // insert batches, which may repeat a key, alternate with delete batches of distinct present keys
+    bool inserting = b % 2 == 0;
+    std::vector<uint64_t> ids = make_batch(rng, model, batch_size, key_range, inserting);
+
+    std::vector<Key> batch;
+    for (size_t j = 0; j < batch_size; j++) {
+      size_t ver = b * batch_size + j + 1;
+      const Key& key = keys[ids[j]];
+      batch.push_back(key);
+      apply(model, ids[j], inserting);
+      roots[ver] = inserting ?
+        treap::search_insert(ver, roots[ver-1], node_t::priority(key), key) :
+        treap::search_delete(ver, roots[ver-1], node_t::priority(key), key, 1);
+      treap::augment(roots[ver]);
+      if (ver % sample_every == 0 || j == 0 || j + 1 == batch_size) { samples[ver] = model; } }
+
+    trees[b+1] = inserting ?
+      P::inserted(trees[b], b * batch_size + 1, batch_size, batch.data()) :
+      P::deleted(trees[b], b * batch_size + 1, batch_size, batch.data()); }
+
+  for (const auto& [ver, m] : samples) {
+    node_t* root = roots[ver];
+    typename P::node_ptr tree = trees[ver == 0 ? 0 : (ver - 1) / batch_size + 1];
+    uint64_t total = total_of(m);
+    for (size_t j = 0; j < num_probes; j++) {
+      uint64_t i = rng() % key_range;
+      uint64_t l = rng() % key_range;
+      uint64_t r = std::min(l + rng() % (key_range / 4), key_range - 1);
+      uint64_t k = rng() % (total + total / 16 + 1); // a few beyond the total
+      uint64_t cnt = m.count(i) ? m.at(i) : 0;
+      const node_t* found = treap::find<node_t>(root, keys[i]);
+      check(cnt, found == nullptr ? 0 : found->val, "%s: treap find at version %zu for %lu", type, ver, i);
+      check(cnt, P::find(tree, ver, keys[i]), "%s: pam find at version %zu for %lu", type, ver, i);
+      uint64_t range = expected_range(m, l, r);
+      check(range, treap::range_estimate<node_t>(root, keys[l], keys[r]),
+        "%s: treap range at version %zu on [%lu, %lu]", type, ver, l, r);
+      check(range, P::range_estimate(tree, ver, keys[l], keys[r]),
+        "%s: pam range at version %zu on [%lu, %lu]", type, ver, l, r);
+      uint64_t rank = expected_rank(m, i);
+      check(rank, treap::rank<node_t>(root, keys[i]), "%s: treap rank at version %zu for %lu", type, ver, i);
+      check(rank, P::rank(tree, ver, keys[i]), "%s: pam rank at version %zu for %lu", type, ver, i);
+      uint64_t selected = expected_select(m, k, key_range);
+      check(selected, index_of(treap::select<node_t>(root, k)), "%s: treap select at version %zu for %lu", type, ver,
+        k);
+      check(selected, index_of(P::select(tree, ver, k)), "%s: pam select at version %zu for %lu", type, ver, k); } }
+}
+
+int main(int argc, const char *argv[]) {
+  uint64_t seed = argc > 1 ? std::stoul(argv[1]) : 2024;
+
+  std::vector<uint32_t> narrow;
+  std::vector<uint64_t> wide;
+  std::vector<uint64_t> descending;
+  std::vector<composite_key> composite;
+  std::vector<string_key> strings;
+  chunk_arena arena;
+  for (uint64_t i = 0; i <= key_range; i++) {
+    narrow.push_back(static_cast<uint32_t>(i * 3 + 1));
+    wide.push_back(i * 1000003);
+    descending.push_back(~uint64_t{0} - i * 1000003);
+    composite.push_back(composite_key{ i / 64, (i % 64) << 40 });
+    // short keys kept inline first, then long ones whose prefixes tie
+    char buf[16];
+    snprintf(buf, sizeof(buf), i < 100 ? "a%02lu" : "sku-%08lu", i);
+    strings.push_back(string_key::make(buf, arena)); }
+
+  run<uint32_t, std::less<uint32_t>>("uint32_t", narrow, seed);
+  run<uint64_t, std::greater<uint64_t>>("uint64_t descending", descending, seed);
+  run<composite_key, std::less<composite_key>>("composite_key", composite, seed);
+  run<string_key, std::less<string_key>>("string_key", strings, seed);
+  run<uint64_t, std::less<uint64_t>, false>("uint64_t without priorities", wide, seed);
+  run<composite_key, std::less<composite_key>, false>("composite_key without priorities", composite, seed);
+
+  if (num_failures > 0) {
+    log_error("%zu of %zu queries differ", num_failures.load(), num_checked.load());
+    return 1; }
+  log_info("%zu queries checked on every key type, all agree", num_checked.load());
+  return 0;
+}
@@ -0,0 +1,302 @@
+// count the nodes every primitive allocates, see lib/alloc_count.hpp
+#define COUNT_ALLOCS
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/log.h"
+
+#include "ycsbc/core/scrambled_zipfian_generator.h"
+
+#include "lib/alloc_count.hpp"
+#include "lib/parlay/parallel.h"
+
+#include "lib/treap/augment.hpp"
+#include "lib/treap/build.hpp"
+#include "lib/treap/node.hpp"
+#include "lib/treap/query.hpp"
+#include "lib/treap/search_delete.hpp"
+#include "lib/treap/search_insert.hpp"
+
+#include "lib/pam/interface.hpp"
+
+/* Microbenchmarks of the treap and PAM primitives, in isolation from the schedulers and the backends.
+ * A tree of size n holds the keys 2, 4, ..., 2n, so that the operation keys drawn from [0, 2n+2) hit about half.
+ * The per-operation primitives run on a persistent tree of version 0 from every thread at once, the copies they
+ * make are released between chunks of operations outside the timing. The bulk primitives run on parlay workers.
+ * Every line reports the nanoseconds per unit (an operation, or a key of the tree or the batch) and the nodes
+ * (and PAM histories) allocated per unit. */
+
+void ExitWithHint(const char* command) {
+  std::cerr << "Usage: " << command << " [options]" << std::endl;
+  std::cerr << "Options:" << std::endl;
+  std::cerr << "  -sizes n,...: tree sizes (default: 1000,100000,1000000)" << std::endl;
+  std::cerr << "  -dists d,...: distributions of the operation keys, uniform, zipfian or sequential (default: all)" << std::endl;
+  std::cerr << "  -threads n,...: numbers of threads (default: 1)" << std::endl;
+  std::cerr << "  -ops n: operations per thread for the per-operation primitives (default: 100000)" << std::endl;
+  std::cerr << "  -batch b: keys per batch of copy_merge and copy_subtract (default: 1000)" << std::endl;
+  std::cerr << "  -range w: width of the ranges estimated, in keys of the tree (default: 1000)" << std::endl;
+  std::cerr << "  -only p,...: run these primitives only (default: all)" << std::endl;
+  exit(0);
+}
+
+std::vector<size_t> sizes = { 1000, 100000, 1000000 };
+std::vector<std::string> dists = { "uniform", "zipfian", "sequential" };
+std::vector<size_t> threads_list = { 1 };
+size_t num_ops = 100000;
+size_t batch_size = 1000;
+size_t range_width = 1000;
+std::vector<std::string> only;
+
+std::vector<std::string> Split(const char* list) {
+  std::vector<std::string> items;
+  std::string s(list);
+  for (size_t start = 0; start <= s.size(); ) {
+    size_t end = s.find(',', start);
+    if (end == std::string::npos) { end = s.size(); }
+    if (end > start) { items.push_back(s.substr(start, end-start)); }
+    start = end+1; }
+  return items;
+}
+
+std::vector<size_t> SplitSizes(const char* list) {
+  std::vector<size_t> values;
+  for (const std::string& item : Split(list)) { values.push_back(std::stoul(item)); }
+  return values;
+}
+
+void ParseCommandLine(int argc, const char *argv[]) {
+  size_t argindex = 1;
+  while (argindex < argc && strncmp(argv[argindex], "-", 1) == 0) {
+    if (argindex+1 >= argc) { ExitWithHint(argv[0]); }
+    const char* value = argv[argindex+1];
+    if (strcmp(argv[argindex], "-sizes") == 0) { sizes = SplitSizes(value); }
+    else if (strcmp(argv[argindex], "-dists") == 0) { dists = Split(value); }
+    else if (strcmp(argv[argindex], "-threads") == 0) { threads_list = SplitSizes(value); }
+    else if (strcmp(argv[argindex], "-ops") == 0) { num_ops = std::max<size_t>(std::stoul(value), 1); }
+    else if (strcmp(argv[argindex], "-batch") == 0) { batch_size = std::max<size_t>(std::stoul(value), 1); }
+    else if (strcmp(argv[argindex], "-range") == 0) { range_width = std::stoul(value); }
+    else if (strcmp(argv[argindex], "-only") == 0) { only = Split(value); }
+    else {
+      log_fatal("Unknown option '%s'", argv[argindex]);
+      ExitWithHint(argv[0]); }
+    argindex += 2; }
+  if (argindex != argc) { ExitWithHint(argv[0]); }
+  for (const std::string& dist : dists) {
+    if (dist != "uniform" && dist != "zipfian" && dist != "sequential") {
+      log_fatal("Unknown distribution '%s'", dist.c_str());
+      ExitWithHint(argv[0]); } }
+}
+
+bool Selected(const char* primitive) {
+  return only.empty() || std::find(only.begin(), only.end(), primitive) != only.end();
+}
+
+// m keys drawn from [0, 2n+2) by dist
+std::vector<uint64_t> GenerateKeys(const std::string& dist, size_t n, size_t m, uint64_t seed) {
+  std::vector<uint64_t> keys(m);
+  uint64_t space = 2*n + 2;
+  std::mt19937_64 rng(seed);
+  if (dist == "uniform") { for (uint64_t& k : keys) { k = rng() % space; } }
+  else if (dist == "zipfian") {
+    ycsbc::ScrambledZipfianGenerator gen(space);
+    for (uint64_t& k : keys) { k = gen.Next(); } }
+  else /* sequential */ {
+    uint64_t start = rng() % space;
+    for (size_t i = 0; i < m; i++) { keys[i] = (start + i) % space; } }
+  return keys;
+}
+
+void Report(const char* primitive, const std::string& dist, size_t n, size_t num_threads, const char* unit,
+    double ns, double allocs) {
+  printf("%s\t%s\t%zu\t%zu\t%s\t%.2lf\t%.3lf\n", primitive, dist.c_str(), n, num_threads, unit, ns, allocs);
+  fflush(stdout);
+}
+
+using clock_type = std::chrono::steady_clock;
+
+static inline double ElapsedNs(clock_type::time_point start) {
+  return std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+}
+
+// the nodes an update made at version ver on top of a tree of older versions
+template <typename N>
+void ReleaseVersion(N* t, size_t ver) {
+  if (t == nullptr || t->ver != ver) { return; }
+  ReleaseVersion(t->lch, ver);
+  ReleaseVersion(t->rch, ver);
+  treap::release_node(t);
+}
+
+std::atomic_uint64_t sink{0};
+
+/* runs op(keys, i, made, acc) for i < num_ops on every thread, each with its own keys, and releases the roots in
+ * made (of version 1) after every chunk of operations; the results summed into acc reach sink once the thread ends */
+template <typename F>
+void PerOp(const char* primitive, const std::string& dist, size_t n, size_t num_threads,
+    const std::vector<std::vector<uint64_t>>& keys, F op) {
+  if (!Selected(primitive)) { return; }
+  constexpr size_t chunk = 256;
+  std::vector<double> elapsed(num_threads, 0);
+  alloc_count::counts before = alloc_count::read();
+  std::vector<std::thread> threads;
+  for (size_t id = 0; id < num_threads; id++) {
+    threads.emplace_back([&, id]() {
+      std::vector<treap::node_ptr> made;
+      made.reserve(2*chunk);
+      uint64_t acc = 0;
+      for (size_t i = 0; i < num_ops; i += chunk) {
+        size_t end = std::min(i + chunk, num_ops);
+        clock_type::time_point start = clock_type::now();
+        for (size_t j = i; j < end; j++) { op(keys[id], j, made, acc); }
+        elapsed[id] += ElapsedNs(start);
+        for (treap::node_ptr t : made) { ReleaseVersion(t, 1); }
+        made.clear(); }
+      sink.fetch_add(acc, std::memory_order_relaxed); }); }
+  for (std::thread& thread : threads) { thread.join(); }
+  alloc_count::counts diff = alloc_count::read() - before;
+  double total_ops = double(num_ops) * num_threads;
+  double ns = 0;
+  for (double e : elapsed) { ns += e; }
+  Report(primitive, dist, n, num_threads, "op", ns / total_ops, diff.n[alloc_count::NODE_MADE] / total_ops);
+}
+
+void RunTreapPerOp(treap::node_ptr t, size_t n, const std::string& dist, size_t num_threads) {
+  using node_t = treap::node_t;
+  using node_ptr = treap::node_ptr;
+  std::vector<std::vector<uint64_t>> keys(num_threads);
+  for (size_t id = 0; id < num_threads; id++) { keys[id] = GenerateKeys(dist, n, num_ops, 42 + id); }
+  // the keys present, for delete and concat
+  std::vector<std::vector<uint64_t>> present(num_threads);
+  for (size_t id = 0; id < num_threads; id++) {
+    present[id] = keys[id];
+    for (uint64_t& k : present[id]) { k = std::clamp<uint64_t>(k & ~uint64_t{1}, 2, 2*n); } }
+
+  PerOp("find", dist, n, num_threads, keys,
+    [t](const std::vector<uint64_t>& ks, size_t i, std::vector<node_ptr>&, uint64_t& acc) {
+      acc += treap::find(t, ks[i]) != nullptr; });
+  PerOp("range_estimate", dist, n, num_threads, keys,
+    [t](const std::vector<uint64_t>& ks, size_t i, std::vector<node_ptr>&, uint64_t& acc) {
+      acc += treap::range_estimate(t, ks[i], ks[i] + 2*range_width); });
+  PerOp("split_copy", dist, n, num_threads, keys,
+    [t](const std::vector<uint64_t>& ks, size_t i, std::vector<node_ptr>& made, uint64_t&) {
+      auto [t_l, t_r] = treap::split_copy(1, t, ks[i]);
+      made.push_back(t_l);
+      made.push_back(t_r); });
+  PerOp("process_deploy", dist, n, num_threads, keys,
+    [t](const std::vector<uint64_t>& ks, size_t i, std::vector<node_ptr>& made, uint64_t&) {
+      made.push_back(treap::process_deploy(1, t, node_t::priority(ks[i]), ks[i])); });
+  PerOp("search_insert", dist, n, num_threads, keys,
+    [t](const std::vector<uint64_t>& ks, size_t i, std::vector<node_ptr>& made, uint64_t&) {
+      made.push_back(treap::search_insert(1, t, node_t::priority(ks[i]), ks[i])); });
+  PerOp("search_delete", dist, n, num_threads, present,
+    [t](const std::vector<uint64_t>& ks, size_t i, std::vector<node_ptr>& made, uint64_t&) {
+      made.push_back(treap::search_delete(1, t, node_t::priority(ks[i]), ks[i])); });
+  // concatenates the children of the node of a present key, as a delete does
+  std::vector<std::vector<uint64_t>> nodes(num_threads);
+  for (size_t id = 0; id < num_threads; id++) {
+    for (uint64_t k : present[id]) { nodes[id].push_back(reinterpret_cast<uint64_t>(treap::find(t, k))); } }
+  PerOp("process_concat", dist, n, num_threads, nodes,
+    [](const std::vector<uint64_t>& ts, size_t i, std::vector<node_ptr>& made, uint64_t&) {
+      node_ptr t_x = reinterpret_cast<node_ptr>(ts[i]);
+      made.push_back(treap::process_concat(1, t_x->lch, t_x->rch)); });
+}
+
+// runs f on num_threads parlay workers, and reports the time and the allocations per unit
+template <typename F>
+void Bulk(const char* primitive, const std::string& dist, size_t n, size_t num_threads, const char* unit,
+    size_t num_units, F f) {
+  double ns = 0;
+  alloc_count::counts before = alloc_count::read();
+  parlay::execute_with_scheduler([&]() { ns = f(); }, num_threads);
+  alloc_count::counts diff = alloc_count::read() - before;
+  Report(primitive, dist, n, num_threads, unit, ns / num_units, double(diff.allocations()) / num_units);
+}
+
+void RunTreapBulk(const std::vector<uint64_t>& elems, size_t num_threads) {
+  size_t n = elems.size();
+  if (Selected("build") || Selected("augment_parallel")) {
+    treap::node_ptr t = nullptr;
+    Bulk("build", "-", n, num_threads, "key", n, [&]() {
+      clock_type::time_point start = clock_type::now();
+      t = treap::build(n, elems.data());
+      return ElapsedNs(start); });
+    if (Selected("augment_parallel")) {
+      Bulk("augment_parallel", "-", n, num_threads, "key", n, [&]() {
+        clock_type::time_point start = clock_type::now();
+        treap::augment_parallel(t);
+        return ElapsedNs(start); }); }
+    treap::release_tree(t); }
+  if (Selected("merge")) {
+    // the even and the odd positions, i.e. two interleaving halves
+    std::vector<uint64_t> halves[2];
+    for (size_t i = 0; i < n; i++) { halves[i % 2].push_back(elems[i]); }
+    treap::node_ptr t_0 = nullptr, t_1 = nullptr, t = nullptr;
+    parlay::execute_with_scheduler([&]() {
+      t_0 = treap::build(halves[0].size(), halves[0].data());
+      t_1 = treap::build(halves[1].size(), halves[1].data()); }, num_threads);
+    Bulk("merge", "-", n, num_threads, "key", n, [&]() {
+      clock_type::time_point start = clock_type::now();
+      t = treap::merge(t_0, t_1);
+      return ElapsedNs(start); });
+    treap::release_tree(t); }
+}
+
+// copy_merge and copy_subtract of batches drawn by dist into a PAM tree of version 0
+void RunPamBatches(pam::interface::node_ptr t, size_t n, const std::string& dist, size_t num_threads) {
+  using node_t = pam::interface::node_t;
+  using node_ptr = pam::interface::node_ptr;
+  size_t num_batches = std::max<size_t>(num_ops / batch_size, 1);
+  std::vector<uint64_t> keys = GenerateKeys(dist, n, num_batches * batch_size, 42);
+  for (const char* primitive : { "copy_merge", "copy_subtract" }) {
+    if (!Selected(primitive)) { continue; }
+    bool subtract = strcmp(primitive, "copy_subtract") == 0;
+    std::vector<uint64_t> batch(batch_size);
+    Bulk(primitive, dist, n, num_threads, "key", num_batches * batch_size, [&]() {
+      double ns = 0;
+      for (size_t b = 0; b < num_batches; b++) {
+        std::copy(keys.begin() + b * batch_size, keys.begin() + (b+1) * batch_size, batch.begin());
+        if (subtract) { for (uint64_t& k : batch) { k = std::clamp<uint64_t>(k & ~uint64_t{1}, 2, 2*n); } }
+        std::sort(batch.begin(), batch.end());
+        // the batch tree is built outside the timing, as the backend builds it while the previous batch merges
+        node_ptr t_det = pam::build_versioned<uint64_t>(1, batch_size, batch.data());
+        clock_type::time_point start = clock_type::now();
+        node_ptr t_new = subtract ? pam::copy_subtract<node_t>(t, t_det) : pam::copy_merge<node_t>(t, t_det);
+        ns += ElapsedNs(start);
+        pam::release_unshared(t_new, t); }
+      return ns; }); }
+}
+
+int main(int argc, const char *argv[]) {
+  ParseCommandLine(argc, argv);
+  printf("# primitive\tdist\tsize\tthreads\tunit\tns/unit\tallocs/unit\n");
+
+  for (size_t n : sizes) {
+    std::vector<uint64_t> elems(n);
+    for (size_t i = 0; i < n; i++) { elems[i] = 2*i + 2; }
+
+    for (size_t num_threads : threads_list) { RunTreapBulk(elems, num_threads); }
+
+    treap::node_ptr t = treap::build_parallel(n, elems.data());
+    for (const std::string& dist : dists) {
+      for (size_t num_threads : threads_list) { RunTreapPerOp(t, n, dist, num_threads); } }
+    treap::release_tree(t);
+
+    if (Selected("copy_merge") || Selected("copy_subtract")) {
+      pam::interface::node_ptr t_pam = pam::interface::build(n, elems.data());
+      for (const std::string& dist : dists) {
+        for (size_t num_threads : threads_list) { RunPamBatches(t_pam, n, dist, num_threads); } }
+      pam::release_tree(t_pam); } }
+
+  log_debug("sink %lu", sink.load());
+  return 0;
+}
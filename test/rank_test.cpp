@@ -0,0 +1,101 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "utils/log.h"
+
+#include "lib/pam/interface.hpp"
+#include "lib/treap/augment.hpp"
+#include "lib/treap/build.hpp"
+#include "lib/treap/rank.hpp"
+#include "lib/treap/search_delete.hpp"
+#include "lib/treap/search_insert.hpp"
+#include "reference.hpp"
+
+/* Checks the order statistics (lib/treap/rank.hpp, lib/pam/rank.hpp): rank of random and of present keys, select
+ * of counters up to a little beyond the total (which finds no key), and the quantiles one at a time and in one pass
+ * against the counter indices they round to. Treap snapshots and PAM trees are probed at sampled versions after
+ * alternating insert and delete batches, the versions inside a PAM batch included. Exits 1 on a mismatch. */
+
+constexpr size_t num_keys = 4000;
+constexpr uint64_t key_range = 20000;
+constexpr size_t num_batches = 16;
+constexpr size_t batch_size = 250;
+constexpr size_t num_probes = 64;
+constexpr size_t sample_every = 41;
+
+template <typename N>
+uint64_t key_or_end(const N* t) {
+  return t == nullptr ? key_range : t->key;
+}
+
+int main(int argc, const char *argv[]) {
+  std::mt19937_64 rng(argc > 1 ? std::stoul(argv[1]) : 2024);
+
+  multiset model = make_model(rng, num_keys, key_range);
+  std::vector<uint64_t> elems = keys_of(model);
+
+  // a treap snapshot per version and a PAM tree per batch, which answers every version of its batch
+  const size_t num_versions = num_batches * batch_size;
+  std::vector<treap::node_ptr> roots(num_versions + 1);
+  std::vector<pam::interface::node_ptr> trees(num_batches + 1);
+  roots[0] = treap::build_parallel(elems.size(), elems.data());
+  trees[0] = pam::interface::build(elems.size(), elems.data());
+  // the nodes a PAM batch drains are removed by the next one
+  pam::interface::drained_list drained;
+  std::map<size_t, multiset> samples{ { 0, model } };
+
+  for (size_t b = 0; b < num_batches; b++) {
+    // insert batches, which may repeat a key, alternate with delete batches of distinct present keys
+    bool inserting = b % 2 == 0;
+    std::vector<uint64_t> keys = make_batch(rng, model, batch_size, key_range, inserting);
+
+    for (size_t i = 0; i < batch_size; i++) {
+      size_t ver = b * batch_size + i + 1;
+      uint64_t key = keys[i];
+      apply(model, key, inserting);
+      roots[ver] = inserting ?
+        treap::search_insert(ver, roots[ver-1], treap::node_t::priority(key), key) :
+        treap::search_delete(ver, roots[ver-1], treap::node_t::priority(key), key, 1);
+      treap::augment(roots[ver]);
+      if (ver % sample_every == 0 || i == 0 || i + 1 == batch_size) { samples[ver] = model; } }
+
+    trees[b+1] = inserting ?
+      pam::interface::inserted(trees[b], b * batch_size + 1, batch_size, keys.data(), nullptr, &drained) :
+      pam::interface::deleted(trees[b], b * batch_size + 1, batch_size, keys.data(), nullptr, &drained); }
+
+  const std::vector<double> qs{ 0, 0.01, 0.25, 0.5, 0.75, 0.9, 0.99, 1 };
+  for (const auto& [ver, m] : samples) {
+    treap::node_ptr root = roots[ver];
+    pam::interface::node_ptr tree = trees[ver == 0 ? 0 : (ver - 1) / batch_size + 1];
+    uint64_t total = total_of(m);
+    for (size_t i = 0; i < num_probes; i++) {
+      // a random key or a present one
+      uint64_t key = rng() % (key_range + 1);
+      if (i % 2 == 1 && m.lower_bound(key) != m.end()) { key = m.lower_bound(key)->first; }
+      uint64_t k = rng() % (total + total / 16 + 1); // a few beyond the total
+      uint64_t rank = expected_rank(m, key);
+      uint64_t selected = expected_select(m, k, key_range);
+      check(rank, treap::rank(root, key), "treap rank at version %zu for %lu", ver, key);
+      check(rank, pam::interface::rank(tree, ver, key), "pam rank at version %zu for %lu", ver, key);
+      check(selected, key_or_end(treap::select(root, k)), "treap select at version %zu for %lu", ver, k);
+      check(selected, key_or_end(pam::select(tree, ver, k)), "pam select at version %zu for %lu", ver, k); }
+    std::vector<uint64_t> treap_keys = treap::quantiles(root, qs.data(), qs.size());
+    std::vector<uint64_t> pam_keys = pam::interface::quantiles(tree, ver, qs.data(), qs.size());
+    for (size_t i = 0; i < qs.size(); i++) {
+      uint64_t want = expected_select(m, treap::quantile_rank(total, qs[i]), key_range);
+      check(want, treap::quantile(root, qs[i]), "treap quantile at version %zu for %.2f", ver, qs[i]);
+      check(want, treap_keys[i], "treap quantiles at version %zu for %.2f", ver, qs[i]);
+      check(want, pam::quantile(tree, ver, qs[i]), "pam quantile at version %zu for %.2f", ver, qs[i]);
+      check(want, pam_keys[i], "pam quantiles at version %zu for %.2f", ver, qs[i]); } }
+
+  if (num_failures > 0) {
+    log_error("%zu of %zu queries differ", num_failures.load(), num_checked.load());
+    return 1; }
+  log_info("%zu queries checked on %zu versions, all agree", num_checked.load(), samples.size());
+  return 0;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "utils/log.h"
+
+/* The reference model of the tests: a multiset of keys, kept as the counter of every present key, which the trees
+ * are checked against, with the answers expected of it and a count of the checks and mismatches. */
+
+using multiset = std::map<uint64_t, uint64_t>;
+
+// counted across the threads of a test
+inline std::atomic_size_t num_checked{0};
+inline std::atomic_size_t num_failures{0};
+
+// n distinct keys below key_range, each counted once
+inline multiset make_model(std::mt19937_64& rng, size_t n, uint64_t key_range) {
+  multiset model;
+  while (model.size() < n) { model[rng() % key_range] = 1; }
+  return model;
+}
+
+// the present keys in order, each once
+inline std::vector<uint64_t> keys_of(const multiset& model) {
+  std::vector<uint64_t> keys;
+  for (const auto& [key, cnt] : model) { keys.push_back(key); }
+  return keys;
+}
+
+// [0, key_range] and n-1 random ranges of up to a quarter of it
+inline std::vector<std::pair<uint64_t, uint64_t>> make_ranges(std::mt19937_64& rng, size_t n, uint64_t key_range) {
+  std::vector<std::pair<uint64_t, uint64_t>> ranges{ { 0, key_range } };
+  for (size_t i = 1; i < n; i++) {
+    uint64_t l = rng() % key_range;
+    ranges.emplace_back(l, l + rng() % (key_range / 4)); }
+  return ranges;
+}
+
+// the first present key from key on, wrapping around, the model must not be empty
+inline uint64_t present_key(const multiset& model, uint64_t key) {
+  auto it = model.lower_bound(key);
+  return it == model.end() ? model.begin()->first : it->first;
+}
+
+// n keys below key_range to insert, which may repeat, or n distinct present keys to delete
+inline std::vector<uint64_t> make_batch(std::mt19937_64& rng, const multiset& model, size_t n, uint64_t key_range,
+    bool inserting) {
+  std::vector<uint64_t> keys;
+  multiset left = model;
+  while (keys.size() < n) {
+    uint64_t key = rng() % key_range;
+    if (!inserting) {
+      key = present_key(left, key);
+      left.erase(key); }
+    keys.push_back(key); }
+  return keys;
+}
+
+// inserts a key, or deletes one occurrence of a present key
+inline void apply(multiset& model, uint64_t key, bool inserting) {
+  if (inserting) { model[key]++; }
+  else if (--model[key] == 0) { model.erase(key); }
+}
+
+inline uint64_t expected_range(const multiset& model, uint64_t l, uint64_t r) {
+  uint64_t ret = 0;
+  for (auto it = model.lower_bound(l); it != model.end() && it->first <= r; ++it) { ret += it->second; }
+  return ret;
+}
+
+// the counters of the keys less than key
+inline uint64_t expected_rank(const multiset& model, uint64_t key) {
+  uint64_t ret = 0;
+  for (auto it = model.begin(); it != model.end() && it->first < key; ++it) { ret += it->second; }
+  return ret;
+}
+
+// the key holding the k-th counter, or none if k is out of range
+inline uint64_t expected_select(const multiset& model, uint64_t k, uint64_t none) {
+  for (const auto& [key, cnt] : model) {
+    if (k < cnt) { return key; }
+    k -= cnt; }
+  return none;
+}
+
+inline uint64_t total_of(const multiset& model) {
+  uint64_t total = 0;
+  for (const auto& [key, cnt] : model) { total += cnt; }
+  return total;
+}
+
+// the keys in [l, r] with their counters, in order
+inline std::vector<std::pair<uint64_t, uint64_t>> expected_entries(const multiset& model, uint64_t l, uint64_t r) {
+  std::vector<std::pair<uint64_t, uint64_t>> out;
+  for (auto it = model.lower_bound(l); it != model.end() && it->first <= r; ++it) { out.push_back(*it); }
+  return out;
+}
+
+/* counts a check of got against want, a mismatch is counted and logged after the check described by the printf
+ * format fmt and args, with the values if they are numbers and their sizes otherwise */
+template <typename T, typename... Args>
+inline bool check(const T& want, const T& got, const char* fmt, Args... args) {
+  num_checked++;
+  if (want == got) { return true; }
+  num_failures++;
+  char what[256];
+  snprintf(what, sizeof(what), fmt, args...);
+  if constexpr (std::is_integral_v<T>) {
+    log_error("%s: %lu expected, %lu found", what, static_cast<uint64_t>(want), static_cast<uint64_t>(got)); }
+  else { log_error("%s: %zu entries expected, %zu found", what, want.size(), got.size()); }
+  return false;
+}
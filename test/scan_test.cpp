@@ -0,0 +1,131 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "utils/log.h"
+
+#include "lib/pam/interface.hpp"
+#include "lib/treap/augment.hpp"
+#include "lib/treap/build.hpp"
+#include "lib/treap/scan.hpp"
+#include "lib/treap/search_delete.hpp"
+#include "lib/treap/search_insert.hpp"
+#include "reference.hpp"
+
+/* Checks the ordered range scans (lib/treap/scan.hpp, lib/pam/scan.hpp): every key and counter in a range, in order,
+ * from the cursors and from range_collect, the latter also cut into small pieces collected in parallel. Only once
+ * every version is built are the sampled ones scanned, so that an update leaking into an older treap snapshot or into
+ * an earlier version of a PAM batch shows up. Every key is then drained from PAM, whose trees must shrink with it.
+ * Exits 1 on a mismatch. */
+
+constexpr size_t num_keys = 4000;
+constexpr uint64_t key_range = 20000;
+constexpr size_t num_batches = 16;
+constexpr size_t batch_size = 250;
+constexpr size_t num_ranges = 9;
+constexpr size_t sample_every = 37;
+
+using entries = std::vector<std::pair<uint64_t, uint64_t>>;
+
+template <typename Seq>
+entries of_sequence(const Seq& seq) {
+  entries out;
+  for (const auto& e : seq) { out.emplace_back(e.key, e.val); }
+  return out;
+}
+
+template <typename Cursor>
+entries of_cursor(Cursor it) {
+  entries out;
+  for (; it.valid(); it.next()) { out.emplace_back(it.key(), it.val()); }
+  return out;
+}
+
+int main(int argc, const char *argv[]) {
+  std::mt19937_64 rng(argc > 1 ? std::stoul(argv[1]) : 2024);
+
+  multiset model = make_model(rng, num_keys, key_range);
+  std::vector<uint64_t> elems = keys_of(model);
+  std::vector<std::pair<uint64_t, uint64_t>> ranges = make_ranges(rng, num_ranges, key_range);
+
+  // a treap snapshot per version and a PAM tree per batch, which answers every version of its batch
+  const size_t num_versions = num_batches * batch_size;
+  std::vector<treap::node_ptr> roots(num_versions + 1);
+  std::vector<pam::interface::node_ptr> trees(num_batches + 1);
+  roots[0] = treap::build_parallel(elems.size(), elems.data());
+  trees[0] = pam::interface::build(elems.size(), elems.data());
+  // the nodes a PAM batch drains are removed by the next one
+  pam::interface::drained_list drained;
+
+  std::vector<std::vector<entries>> want(num_versions + 1);
+  want[0].reserve(ranges.size());
+  for (auto [l, r] : ranges) { want[0].push_back(expected_entries(model, l, r)); }
+
+  for (size_t b = 0; b < num_batches; b++) {
+    // insert batches, which may repeat a key, alternate with delete batches of distinct present keys
+    bool inserting = b % 2 == 0;
+    std::vector<uint64_t> keys = make_batch(rng, model, batch_size, key_range, inserting);
+
+    for (size_t i = 0; i < batch_size; i++) {
+      size_t ver = b * batch_size + i + 1;
+      uint64_t key = keys[i];
+      apply(model, key, inserting);
+      roots[ver] = inserting ?
+        treap::search_insert(ver, roots[ver-1], treap::node_t::priority(key), key) :
+        treap::search_delete(ver, roots[ver-1], treap::node_t::priority(key), key, 1);
+      treap::augment(roots[ver]);
+      if (ver % sample_every == 0 || i == 0 || i + 1 == batch_size) {
+        want[ver].reserve(ranges.size());
+        for (auto [l, r] : ranges) { want[ver].push_back(expected_entries(model, l, r)); } } }
+
+    trees[b+1] = inserting ?
+      pam::interface::inserted(trees[b], b * batch_size + 1, batch_size, keys.data(), nullptr, &drained) :
+      pam::interface::deleted(trees[b], b * batch_size + 1, batch_size, keys.data(), nullptr, &drained); }
+
+  // checked only once every version is built, so that the old snapshots are checked for persistence
+  size_t num_scanned = 0;
+  for (size_t ver = 0; ver <= num_versions; ver++) {
+    if (want[ver].empty()) { continue; }
+    pam::interface::node_ptr tree = trees[ver == 0 ? 0 : (ver - 1) / batch_size + 1];
+    for (size_t i = 0; i < ranges.size(); i++) {
+      auto [l, r] = ranges[i];
+      const entries& e = want[ver][i];
+      check(e, of_cursor(treap::cursor(roots[ver], l, r)), "treap cursor at version %zu on [%lu, %lu]", ver, l, r);
+      check(e, of_sequence(treap::range_collect(roots[ver], l, r)),
+        "treap range_collect at version %zu on [%lu, %lu]", ver, l, r);
+      check(e, of_sequence(treap::range_collect(roots[ver], l, r, 64)),
+        "treap range_collect in pieces at version %zu on [%lu, %lu]", ver, l, r);
+      check(e, of_cursor(pam::interface::scan(tree, ver, l, r)), "pam cursor at version %zu on [%lu, %lu]", ver, l, r);
+      check(e, of_sequence(pam::interface::range_collect(tree, ver, l, r)),
+        "pam range_collect at version %zu on [%lu, %lu]", ver, l, r);
+      check(e, of_sequence(pam::range_collect(tree, ver, l, r, 64)),
+        "pam range_collect in pieces at version %zu on [%lu, %lu]", ver, l, r);
+      num_scanned++; } }
+
+  // draining every key, a PAM tree keeps the nodes its batch drained besides the present keys, down to none
+  pam::interface::node_ptr tree = trees[num_batches];
+  size_t ver = num_versions;
+  while (!model.empty()) {
+    std::vector<uint64_t> keys, cnts;
+    for (auto it = model.begin(); it != model.end() && keys.size() < batch_size; it = model.erase(it)) {
+      keys.push_back(it->first);
+      cnts.push_back(it->second); }
+    tree = pam::interface::deleted(tree, ver + 1, keys.size(), keys.data(), cnts.data(), &drained);
+    ver += keys.size();
+    check(model.size() + keys.size(), pam::interface::count_nodes(tree), "pam nodes after draining to version %zu", ver);
+    check(expected_range(model, 0, key_range), pam::interface::range_estimate(tree, ver, 0, key_range),
+      "pam range after draining to version %zu", ver); }
+  uint64_t key = key_range / 2;
+  tree = pam::interface::inserted(tree, ver + 1, 1, &key, nullptr, &drained);
+  check(size_t{1}, pam::interface::count_nodes(tree), "pam nodes after inserting at version %zu", ver + 1);
+
+  if (num_failures > 0) {
+    log_error("%zu of %zu scans differ", num_failures.load(), num_checked.load());
+    return 1; }
+  log_info("%zu ranges checked on %zu versions, all scans agree", num_scanned, num_versions + 1);
+  return 0;
+}
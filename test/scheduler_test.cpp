@@ -0,0 +1,143 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "utils/log.h"
+#include "utils/timer.h"
+
+#include "lib/treap/build.hpp"
+#include "lib/treap/query.hpp"
+#include "lib/treap/scheduler.hpp"
+#include "reference.hpp"
+
+/* Checks the snapshots of the pipelined scheduler (lib/treap/scheduler.hpp) by their range counters, with a
+ * capacity that ends in a partial block. A reader takes the latest augmented snapshot over and over while the tasks
+ * are issued, blocks of different workers padded with no-ops (as a flush does) must be augmented before any more
+ * task comes, the augmented snapshot of the last version is taken once the partial final block is done, and then
+ * every snapshot is checked. A pipeline sealed inside a block must then complete at the tasks issued. Exits 1 on a
+ * mismatch, or if a padded block is not augmented or the sealed pipeline does not complete within a few seconds. */
+
+constexpr size_t num_keys = 2000;
+constexpr uint64_t key_range = 10000;
+constexpr size_t block_size = 64;
+constexpr size_t num_tasks = 40 * block_size + 17; // the final block holds 17 tasks
+// the blocks of these versions are padded once they are issued, the two workers of 4 threads own one each
+constexpr size_t flushed[] = { 20 * block_size + 5, 31 * block_size + 9 };
+constexpr size_t num_ranges = 4;
+constexpr size_t num_threads = 4;
+
+bool is_padding(size_t ver) {
+  for (size_t f : flushed) { if (ver > f && ver <= (f / block_size + 1) * block_size) { return true; } }
+  return false;
+}
+
+int main(int argc, const char *argv[]) {
+  std::mt19937_64 rng(argc > 1 ? std::stoul(argv[1]) : 2024);
+
+  multiset model = make_model(rng, num_keys, key_range);
+  std::vector<uint64_t> elems = keys_of(model);
+  std::vector<std::pair<uint64_t, uint64_t>> ranges = make_ranges(rng, num_ranges, key_range);
+
+  // the tasks are drawn up front, with the counters in every range at every version: an insert or a delete of a
+  // present key, or a no-op now and then
+  enum { NOP, INSERT, DELETE };
+  std::vector<std::pair<int, uint64_t>> tasks(num_tasks + 1);
+  std::vector<std::vector<uint64_t>> want(num_tasks + 1);
+  for (auto [l, r] : ranges) { want[0].push_back(expected_range(model, l, r)); }
+  for (size_t ver = 1; ver <= num_tasks; ver++) {
+    uint64_t key = rng() % key_range;
+    if (rng() % 8 == 0 || is_padding(ver)) { tasks[ver] = { NOP, 0 }; }
+    else if (rng() % 2 == 0 || model.empty()) {
+      apply(model, key, true);
+      tasks[ver] = { INSERT, key }; }
+    else {
+      key = present_key(model, key);
+      apply(model, key, false);
+      tasks[ver] = { DELETE, key }; }
+    for (auto [l, r] : ranges) { want[ver].push_back(expected_range(model, l, r)); } }
+
+  treap::scheduler s(num_threads, num_tasks, block_size, treap::build_parallel(elems.size(), elems.data()));
+
+  auto check_snapshot = [&](const char* what, size_t ver, treap::constnode_ptr t) {
+    for (size_t i = 0; i < ranges.size(); i++) {
+      auto [l, r] = ranges[i];
+      check(want[ver][i], treap::range_estimate(t, l, r), "%s at version %zu on [%lu, %lu]", what, ver, l, r); } };
+
+  // the latest augmented version never goes back or beyond the capacity, and is readable at once
+  std::atomic_bool issuing{true};
+  size_t num_reads = 0;
+  std::thread reader([&]() {
+    size_t last = 0;
+    while (issuing.load(std::memory_order_acquire)) {
+      size_t ver = s.last_augmented();
+      if (ver < last || ver > num_tasks) {
+        log_error("latest augmented version %zu after %zu", ver, last);
+        num_failures++; }
+      check_snapshot("latest augmented snapshot", ver, s.get_augmented_snapshot(ver));
+      last = ver;
+      num_reads++; } });
+
+  for (size_t ver = 1; ver <= num_tasks; ver++) {
+    auto [op, key] = tasks[ver];
+    if (op == INSERT) { s.insert_elem(key); }
+    else if (op == DELETE) { s.delete_elem(key); }
+    else { s.nop(); }
+    if (!is_padding(ver + 1)) { continue; }
+    size_t padding = s.block_padding();
+    for (size_t i = 0; i < padding; i++) { s.nop(); }
+    ver += padding;
+    Timer tmr;
+    tmr.Start();
+    while (s.last_augmented() < ver) {
+      if (tmr.End() > 5) {
+        log_error("the block padded up to version %zu is not augmented", ver);
+        exit(1); }
+      std::this_thread::yield(); } }
+  issuing.store(false, std::memory_order_release);
+  reader.join();
+
+  // the partial final block completes without being padded
+  treap::constnode_ptr last = s.get_snapshot(num_tasks);
+  check_snapshot("last snapshot", num_tasks, last);
+  while (s.last_augmented() < num_tasks) { std::this_thread::yield(); }
+  check_snapshot("last augmented snapshot", num_tasks, s.get_augmented_snapshot(num_tasks));
+  s.process();
+  for (size_t ver = 0; ver <= num_tasks; ver++) { check_snapshot("snapshot", ver, s.get_snapshot(ver)); }
+
+  // sealed inside a block, the pipeline completes at the tasks issued without issuing the rest of the capacity
+  constexpr size_t sealed = 9 * block_size + 30;
+  treap::scheduler s2(num_threads, num_tasks, block_size, treap::build_parallel(elems.size(), elems.data()));
+  for (size_t ver = 1; ver <= sealed; ver++) {
+    auto [op, key] = tasks[ver];
+    if (op == INSERT) { s2.insert_elem(key); }
+    else if (op == DELETE) { s2.delete_elem(key); }
+    else { s2.nop(); } }
+  s2.seal();
+  std::atomic_bool joined{false};
+  std::thread joiner([&]() { s2.process(); joined.store(true, std::memory_order_release); });
+  Timer tmr;
+  tmr.Start();
+  while (!joined.load(std::memory_order_acquire)) {
+    if (tmr.End() > 5) {
+      log_error("the pipeline sealed at version %zu does not complete", sealed);
+      exit(1); }
+    std::this_thread::yield(); }
+  joiner.join();
+  if (s2.last_version() != sealed || s2.last_augmented() != sealed) {
+    log_error("sealed at version %zu, %zu issued and %zu augmented", sealed, s2.last_version(), s2.last_augmented());
+    num_failures++; }
+  for (size_t ver = 0; ver <= sealed; ver++) { check_snapshot("sealed snapshot", ver, s2.get_augmented_snapshot(ver)); }
+
+  if (num_failures > 0) {
+    log_error("%zu mismatches", num_failures.load());
+    return 1; }
+  log_info("%zu versions, %zu reads of the latest and %zu sealed versions checked, all agree", num_tasks + 1, num_reads,
+    sealed + 1);
+  return 0;
+}
@@ -0,0 +1,277 @@
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/histogram.h"
+#include "utils/log.h"
+#include "utils/timer.h"
+
+#include "db/include/protocol.hpp"
+#include "db/include/query_processor.hpp"
+#include "db/include/shm_ring.hpp"
+#include "db/include/workload.hpp"
+#include "db/sequential.hpp"
+
+/* Replays the transactions of a workload against a server (server.cpp) over its socket, or the shared-memory rings
+ * attached through it, with up to a window of requests in flight, and reports the throughput and the latencies of
+ * the requests from send to response. The server is started on the records of the same workload. With -verify, the
+ * transactions the server accepted are then replayed on a local sequential backend, which every query result must
+ * match: the server issues the requests of a connection in order, so that a query reads the same version there. */
+
+void ExitWithHint(const char* command) {
+  std::cerr << "Usage: " << command << " <workload> <socket> [options]" << std::endl;
+  std::cerr << "Options:" << std::endl;
+  std::cerr << "  -window w: requests in flight at most, i.e. pipelined (default: 1024)" << std::endl;
+  std::cerr << "  -batch b: send up to b consecutive queries as one batch, read on the same version, at most the window"
+               " (default: 1)" << std::endl;
+  std::cerr << "  -latest: query the newest readable version instead (default: off)" << std::endl;
+  std::cerr << "  -shm: send the requests and take the responses through shared-memory rings (default: off)" << std::endl;
+  std::cerr << "  -verify: check the query results against a sequential backend, exiting 1 on a mismatch, not with -latest"
+               " (default: off)" << std::endl;
+  exit(0);
+}
+
+std::string filename;
+std::string socket_path;
+size_t window = 1024;
+size_t batch = 1;
+bool query_latest = false;
+bool use_shm = false;
+bool verify = false;
+
+void ParseCommandLine(int argc, const char *argv[]) {
+  if (argc < 3) { ExitWithHint(argv[0]); }
+  filename = argv[1];
+  socket_path = argv[2];
+  size_t argindex = 3;
+  while (argindex < argc && strncmp(argv[argindex], "-", 1) == 0) {
+    if (strcmp(argv[argindex], "-window") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      window = std::max<size_t>(std::stoul(argv[argindex]), 1);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-batch") == 0) {
+      argindex++;
+      if (argindex >= argc) { ExitWithHint(argv[0]); }
+      batch = std::clamp<size_t>(std::stoul(argv[argindex]), 1, DB::protocol::max_batch);
+      argindex++; }
+    else if (strcmp(argv[argindex], "-latest") == 0) {
+      query_latest = true;
+      argindex++; }
+    else if (strcmp(argv[argindex], "-shm") == 0) {
+      use_shm = true;
+      argindex++; }
+    else if (strcmp(argv[argindex], "-verify") == 0) {
+      verify = true;
+      argindex++; }
+    else {
+      log_fatal("Unknown option '%s'", argv[argindex]);
+      ExitWithHint(argv[0]); } }
+  // the latest version is not known to the client, and a batch beyond the window would never be sent
+  if (argindex != argc || (verify && query_latest)) { ExitWithHint(argv[0]); }
+  batch = std::min(batch, window);
+}
+
+bool WriteAll(int fd, const std::vector<uint8_t>& buf) {
+  for (size_t done = 0; done < buf.size(); ) {
+    ssize_t w = send(fd, buf.data() + done, buf.size() - done, MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR) { continue; }
+    if (w <= 0) { return false; }
+    done += w; }
+  return true;
+}
+
+/* attaches a region of rings with room for the window, so that the completion ring never overflows,
+ * and maps the doorbell of the server */
+DB::shm::region* Attach(int fd, uint32_t& capacity, DB::shm::doorbell*& bell) {
+  using namespace DB::protocol;
+  capacity = 64;
+  while (capacity < std::max(window, batch + 1)) { capacity *= 2; }
+  size_t size = DB::shm::region_size(capacity);
+  int mfd = memfd_create("contreap-client", MFD_CLOEXEC);
+  void* p = mfd < 0 || ftruncate(mfd, size) != 0 ? MAP_FAILED :
+    mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mfd, 0);
+  if (p == MAP_FAILED) { log_fatal("cannot map the rings: %s", strerror(errno)); exit(1); }
+  DB::shm::region* ring = new (p) DB::shm::region();
+  ring->magic = DB::shm::magic;
+  ring->capacity = capacity;
+  request req{ 0, ATTACH, {}, 0, 0 };
+  if (DB::shm::send_fd(fd, &req, sizeof(req), mfd) != sizeof(req)) { log_fatal("cannot attach: %s", strerror(errno)); exit(1); }
+  close(mfd);
+  response res;
+  int bell_fd = -1;
+  if (DB::shm::recv_fd(fd, &res, sizeof(res), &bell_fd) != sizeof(res) || res.status != OK || bell_fd < 0) {
+    log_fatal("the server refused the rings");
+    exit(1); }
+  p = mmap(nullptr, sizeof(DB::shm::doorbell), PROT_READ | PROT_WRITE, MAP_SHARED, bell_fd, 0);
+  if (p == MAP_FAILED) { log_fatal("cannot map the doorbell: %s", strerror(errno)); exit(1); }
+  close(bell_fd);
+  bell = static_cast<DB::shm::doorbell*>(p);
+  return ring;
+}
+
+int main(int argc, const char *argv[]) {
+  using namespace DB::protocol;
+  ParseCommandLine(argc, argv);
+
+  DB::Workload w;
+  if (!w.Load(filename)) {
+    log_fatal("Cannot load workload '%s'", filename.c_str());
+    return 1; }
+
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+    log_fatal("cannot connect to %s: %s", socket_path.c_str(), strerror(errno));
+    return 1; }
+  uint32_t capacity = 0;
+  DB::shm::doorbell* bell = nullptr;
+  DB::shm::region* ring = use_shm ? Attach(fd, capacity, bell) : nullptr;
+
+  // the id of a request is the index of its transaction, a batch takes the ids of its queries
+  std::vector<uint64_t> sent(w.m);
+  std::vector<uint8_t> statuses(verify ? w.m : 0);
+  std::vector<uint64_t> results(verify ? w.m : 0);
+  std::atomic_size_t num_answered{0};
+  size_t num_errors = 0;
+  size_t num_full = 0;
+  utils::Histogram latencies;
+
+  Timer tmr;
+  tmr.Start();
+
+  auto receive = [&](const response* res, size_t n) {
+    uint64_t now = DB::QueryProcessor::Now();
+    for (size_t i = 0; i < n; i++) {
+      latencies.record(now - sent[res[i].id]);
+      if (verify) {
+        statuses[res[i].id] = res[i].status;
+        results[res[i].id] = res[i].value; }
+      if (res[i].status == ERROR) { num_errors++; }
+      else if (res[i].status == FULL) { num_full++; } }
+    num_answered.fetch_add(n, std::memory_order_release); };
+
+  std::thread receiver([&]() {
+    std::vector<response> buf(1024);
+    if (ring != nullptr) {
+      response* slots = DB::shm::completion_slots(ring, capacity);
+      while (num_answered.load(std::memory_order_relaxed) < w.m) {
+        size_t n = DB::shm::pop(ring->completions, slots, capacity, buf.data(), buf.size());
+        if (n > 0) {
+          receive(buf.data(), n);
+          continue; }
+        DB::shm::wait(ring->completions, 1000000);
+        uint8_t b;
+        if (recv(fd, &b, 1, MSG_PEEK | MSG_DONTWAIT) == 0) {
+          log_error("connection lost after %zu responses", num_answered.load());
+          exit(1); } }
+      return; }
+    size_t partial = 0; // bytes of a response read in part
+    while (num_answered.load(std::memory_order_relaxed) < w.m) {
+      ssize_t r = read(fd, reinterpret_cast<uint8_t*>(buf.data()) + partial, buf.size() * sizeof(response) - partial);
+      if (r < 0 && errno == EINTR) { continue; }
+      if (r <= 0) {
+        log_error("connection lost after %zu responses", num_answered.load());
+        exit(1); }
+      size_t n = (partial + r) / sizeof(response);
+      receive(buf.data(), n);
+      partial = (partial + r) % sizeof(response);
+      memmove(buf.data(), reinterpret_cast<uint8_t*>(buf.data()) + n * sizeof(response), partial); } });
+
+  // the requests go to out for the socket, or to reqs for the request ring, where a range takes a slot
+  std::vector<uint8_t> out;
+  std::vector<request> reqs;
+  auto append = [&out, &reqs, ring](const void* p, size_t size) {
+    if (ring != nullptr) {
+      request slot;
+      if (size == sizeof(range)) { slot = request{ 0, 0, {}, static_cast<const range*>(p)->l, static_cast<const range*>(p)->r }; }
+      else { memcpy(&slot, p, sizeof(slot)); }
+      reqs.push_back(slot);
+      return; }
+    out.insert(out.end(), static_cast<const uint8_t*>(p), static_cast<const uint8_t*>(p) + size); };
+  for (size_t i = 0; i < w.m; ) {
+    // the queries from i on, up to a batch
+    size_t n = 1;
+    if (batch > 1 && w.txs[i].type == 0 /* QUERY */) {
+      while (n < batch && i + n < w.m && w.txs[i+n].type == 0) { n++; } }
+    if (i + n - num_answered.load(std::memory_order_acquire) > window) {
+      if (!WriteAll(fd, out)) { log_fatal("send failed: %s", strerror(errno)); return 1; }
+      out.clear();
+      while (i + n - num_answered.load(std::memory_order_acquire) > window) { std::this_thread::yield(); } }
+    uint64_t now = DB::QueryProcessor::Now();
+    for (size_t j = 0; j < n; j++) { sent[i+j] = now; }
+    request req = from_tx(i, w.txs[i]);
+    if (n > 1) {
+      req = request{ static_cast<uint32_t>(i), QUERY_BATCH, {}, n, 0 };
+      append(&req, sizeof(req));
+      for (size_t j = 0; j < n; j++) {
+        range q{ w.txs[i+j].arg0, w.txs[i+j].arg1 };
+        append(&q, sizeof(q)); } }
+    else {
+      if (req.op == QUERY && query_latest) { req.op = QUERY_LATEST; }
+      append(&req, sizeof(req)); }
+    i += n;
+    if (ring != nullptr) {
+      while (!DB::shm::push(ring->requests, DB::shm::request_slots(ring), capacity, reqs.data(), reqs.size())) {
+        std::this_thread::yield(); }
+      DB::shm::ring(*bell);
+      reqs.clear(); }
+    else if (out.size() >= (1 << 16)) {
+      if (!WriteAll(fd, out)) { log_fatal("send failed: %s", strerror(errno)); return 1; }
+      out.clear(); } }
+  if (!WriteAll(fd, out)) { log_fatal("send failed: %s", strerror(errno)); return 1; }
+  receiver.join();
+  double duration = tmr.End();
+  close(fd);
+
+  std::cout << "# Requests (transactions, errors, refused as full)" << std::endl;
+  std::cout << w.m << '\t' << num_errors << '\t' << num_full << std::endl;
+  std::cout << "# Transaction throughput (KTPS)" << std::endl;
+  std::cout << w.m / duration / 1000 << std::endl;
+  std::cout << "# Latency (mean, p50, p99, p99.9, max in microseconds)" << std::endl;
+  std::cout << latencies.mean() / 1000 << '\t' << latencies.percentile(0.5) / 1000.0 << '\t'
+            << latencies.percentile(0.99) / 1000.0 << '\t' << latencies.percentile(0.999) / 1000.0 << '\t'
+            << latencies.max() / 1000.0 << std::endl;
+  if (!verify) { return 0; }
+
+  // a transaction refused by the server is skipped, as it changed nothing there either
+  std::vector<uint64_t> want(w.m);
+  DB::Sequential ref(std::thread::hardware_concurrency(), 1);
+  ref.Processor()->OnResult([&want](uint64_t tag, uint64_t ret) { want[tag] = ret; });
+  ref.Init(w.n, w.m, w.elems);
+  for (size_t i = 0; i < w.m; i++) {
+    const DB::tx_context& tx = w.txs[i];
+    if (statuses[i] != OK) { continue; }
+    switch (tx.type) {
+      case 0 /* QUERY */: ref.Processor()->Tag(i); ref.Query(tx.arg0, tx.arg1); break;
+      case 1 /* INSERT */: ref.Insert(tx.arg0); break;
+      case 2 /* DELETE */: ref.Delete(tx.arg0); break;
+      case 3 /* ADD */: ref.Add(tx.arg0, static_cast<int64_t>(tx.arg1)); break; } }
+  ref.Close();
+  size_t num_checked = 0;
+  size_t num_mismatches = 0;
+  for (size_t i = 0; i < w.m; i++) {
+    if (w.txs[i].type != 0 /* QUERY */ || statuses[i] != OK) { continue; }
+    num_checked++;
+    if (results[i] == want[i]) { continue; }
+    if (num_mismatches++ < 10) {
+      log_error("query %zu on [%lu, %lu]: %lu expected, %lu found", i, w.txs[i].arg0, w.txs[i].arg1, want[i],
+        results[i]); } }
+  std::cout << "# Verified (queries checked, mismatches)" << std::endl;
+  std::cout << num_checked << '\t' << num_mismatches << std::endl;
+  return num_mismatches > 0 ? 1 : 0;
+}
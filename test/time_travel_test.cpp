@@ -0,0 +1,144 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "utils/log.h"
+#include "utils/timer.h"
+
+#include "db/factory.hpp"
+#include "db/include/query_processor.hpp"
+#include "db/include/time_index.hpp"
+#include "reference.hpp"
+
+/* Checks the queries as of a time (QueryAt, db/include/time_index.hpp) on the backends keeping every version. The
+ * same phases of updates go to each backend; a phase ends with a query of every range and a flush, and once those
+ * are answered, every version of the phase is committed and the time is taken between two sleeps longer than a tick
+ * of the coarse clock. The ranges are then read as of the time of every phase, which must answer as the reference
+ * model did at the end of the phase. Exits 1 on a mismatch, or if the queries are not answered within a few
+ * seconds. */
+
+constexpr size_t num_keys = 2000;
+constexpr uint64_t key_range = 10000;
+constexpr size_t num_phases = 6;
+constexpr size_t phase_size = 300;
+constexpr size_t num_ranges = 4;
+constexpr size_t block_size = 64;
+constexpr size_t num_threads = 4;
+
+// the answers of the queries tagged so far, by tag
+class answers {
+private:
+  std::mutex mutex_;
+  std::map<uint64_t, uint64_t> rets_;
+
+public:
+  void put(uint64_t tag, uint64_t ret) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rets_[tag] = ret;
+  }
+
+  // waits for the answers of the tags below n, exits if they do not come
+  std::map<uint64_t, uint64_t> wait(const std::string& method, size_t n) {
+    Timer tmr;
+    tmr.Start();
+    for (;;) {
+      size_t answered;
+      { std::lock_guard<std::mutex> lock(mutex_);
+        if (rets_.size() >= n) { return rets_; }
+        answered = rets_.size(); }
+      if (tmr.End() > 5) {
+        log_error("%s: %zu of %zu queries are not answered", method.c_str(), n - answered, n);
+        exit(1); }
+      std::this_thread::yield(); }
+  }
+};
+
+void run(const std::string& method, const std::vector<uint64_t>& elems,
+    const std::vector<std::pair<bool, uint64_t>>& updates,
+    const std::vector<std::pair<uint64_t, uint64_t>>& ranges, const std::vector<std::vector<uint64_t>>& want) {
+  DB::options opts;
+  opts.num_threads = num_threads;
+  opts.num_clients = 2;
+  opts.batch_size = block_size;
+  DB::Interface* db = DB::Create(method, opts);
+  answers got;
+  db->Processor()->OnResult([&got](uint64_t tag, uint64_t ret) { got.put(tag, ret); });
+  // the updates, the queries and the flush of every phase
+  size_t capacity = num_phases * (phase_size + num_ranges + block_size);
+  std::vector<uint64_t> keys(elems);
+  db->Init(keys.size(), capacity, keys.data());
+
+  auto mark = []() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    uint64_t ts = DB::TimeIndex::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return ts; };
+
+  std::vector<uint64_t> times{ mark() };
+  uint64_t tag = 0;
+  for (size_t p = 1; p <= num_phases; p++) {
+    for (size_t i = (p-1) * phase_size; i < p * phase_size; i++) {
+      if (updates[i].first) { db->Insert(updates[i].second); }
+      else { db->Delete(updates[i].second); } }
+    for (auto [l, r] : ranges) {
+      db->Processor()->Tag(tag++);
+      db->Query(l, r); }
+    db->Flush();
+    std::map<uint64_t, uint64_t> rets = got.wait(method, tag);
+    for (size_t i = 0; i < ranges.size(); i++) {
+      check(want[p][i], rets[tag - ranges.size() + i], "%s: query of phase %zu on [%lu, %lu]", method.c_str(), p,
+        ranges[i].first, ranges[i].second); }
+    times.push_back(mark()); }
+
+  uint64_t first = tag;
+  for (size_t p = 0; p <= num_phases; p++) {
+    for (auto [l, r] : ranges) {
+      db->Processor()->Tag(tag++);
+      if (db->QueryAt(times[p], l, r) == 0) { continue; }
+      log_error("%s: reading as of phase %zu is not supported", method.c_str(), p);
+      exit(1); } }
+  std::map<uint64_t, uint64_t> rets = got.wait(method, tag);
+  for (size_t p = 0; p <= num_phases; p++) {
+    for (size_t i = 0; i < ranges.size(); i++) {
+      check(want[p][i], rets[first + p * ranges.size() + i], "%s: reading as of phase %zu on [%lu, %lu]",
+        method.c_str(), p, ranges[i].first, ranges[i].second); } }
+  db->Close();
+  delete db;
+}
+
+int main(int argc, const char *argv[]) {
+  std::mt19937_64 rng(argc > 1 ? std::stoul(argv[1]) : 2024);
+
+  multiset model = make_model(rng, num_keys, key_range);
+  std::vector<uint64_t> elems = keys_of(model);
+  std::vector<std::pair<uint64_t, uint64_t>> ranges = make_ranges(rng, num_ranges, key_range);
+
+  // the updates are drawn up front, inserts or deletes of present keys, with the counters at the end of every phase
+  std::vector<std::pair<bool, uint64_t>> updates;
+  std::vector<std::vector<uint64_t>> want(num_phases + 1);
+  for (auto [l, r] : ranges) { want[0].push_back(expected_range(model, l, r)); }
+  for (size_t p = 1; p <= num_phases; p++) {
+    for (size_t i = 0; i < phase_size; i++) {
+      uint64_t key = rng() % key_range;
+      bool inserting = rng() % 2 == 0 || model.empty();
+      if (!inserting) { key = present_key(model, key); }
+      apply(model, key, inserting);
+      updates.emplace_back(inserting, key); }
+    for (auto [l, r] : ranges) { want[p].push_back(expected_range(model, l, r)); } }
+
+  for (const char* method : { "sequential", "contreap" }) { run(method, elems, updates, ranges, want); }
+
+  if (num_failures > 0) {
+    log_error("%zu of %zu queries differ", num_failures.load(), num_checked.load());
+    return 1; }
+  log_info("%zu phases read as of their times on every backend, all agree", num_phases + 1);
+  return 0;
+}
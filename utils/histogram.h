@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace utils {
+
+/* A log-linear histogram of nonnegative values (e.g. latencies in nanoseconds).
+ * Values below 64 are exact, larger ones fall into 32 buckets per power of two, i.e. within about 3%.
+ * Recording is a shift and an increment, and is not thread-safe: keep one per thread and merge them. */
+class Histogram {
+private:
+  static constexpr size_t sub_bits_ = 5;
+  static constexpr size_t sub_ = size_t{1} << sub_bits_;
+  static constexpr size_t num_buckets_ = (64 - sub_bits_ + 1) * sub_; // up to the octave of 2^63
+
+  std::vector<uint64_t> counts_;
+  uint64_t total_;
+  uint64_t max_;
+  double sum_;
+
+  static inline size_t bucket_(uint64_t v) {
+    if (v < 2*sub_) { return v; }
+    size_t shift = 63 - __builtin_clzll(v) - sub_bits_;
+    return (shift+1) * sub_ + ((v >> shift) - sub_);
+  }
+
+  // the largest value in bucket i
+  static inline uint64_t upper_(size_t i) {
+    if (i < 2*sub_) { return i; }
+    size_t shift = i / sub_ - 1;
+    return ((i % sub_ + sub_) << shift) + ((uint64_t{1} << shift) - 1);
+  }
+
+public:
+  Histogram() : counts_(num_buckets_, 0), total_(0), max_(0), sum_(0) { }
+
+  inline void record(uint64_t v) {
+    counts_[bucket_(v)]++;
+    total_++;
+    if (v > max_) { max_ = v; }
+    sum_ += v;
+  }
+
+  void merge(const Histogram& other) {
+    for (size_t i = 0; i < num_buckets_; i++) { counts_[i] += other.counts_[i]; }
+    total_ += other.total_;
+    if (other.max_ > max_) { max_ = other.max_; }
+    sum_ += other.sum_;
+  }
+
+  inline uint64_t count() const { return total_; }
+  inline uint64_t max() const { return max_; }
+  inline double mean() const { return total_ == 0 ? 0 : sum_ / total_; }
+
+  // an upper bound of the p-th quantile (0 <= p <= 1), 0 if empty
+  uint64_t percentile(double p) const {
+    if (total_ == 0) { return 0; }
+    uint64_t rank = p * total_;
+    if (rank >= total_) { rank = total_-1; }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < num_buckets_; i++) {
+      seen += counts_[i];
+      if (seen > rank) { return upper_(i) < max_ ? upper_(i) : max_; } }
+    return max_;
+  }
+};
+
+}
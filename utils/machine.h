@@ -0,0 +1,65 @@
+#pragma once
+
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+
+namespace utils {
+
+/* The configuration of the machine a benchmark runs on, recorded along with its results. */
+struct Machine {
+  std::string host;
+  std::string cpu;
+  size_t num_cpus;
+  uint64_t memory; // bytes
+  std::string kernel;
+  std::string compiler;
+  std::string date; // UTC, ISO 8601
+
+  static Machine Probe() {
+    Machine m;
+    char host[256] = {};
+    gethostname(host, sizeof(host) - 1);
+    m.host = host;
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    for (std::string line; std::getline(cpuinfo, line); ) {
+      if (line.rfind("model name", 0) != 0) { continue; }
+      size_t colon = line.find(':');
+      if (colon != std::string::npos) { m.cpu = line.substr(line.find_first_not_of(' ', colon+1)); }
+      break; }
+    m.num_cpus = std::thread::hardware_concurrency();
+    m.memory = uint64_t(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE);
+    struct utsname uts;
+    if (uname(&uts) == 0) { m.kernel = std::string(uts.sysname) + " " + uts.release; }
+    m.compiler = __VERSION__;
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    m.date = date;
+    return m;
+  }
+};
+
+// the resident set size of this process in bytes
+inline uint64_t CurrentRSS() {
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size = 0, resident = 0;
+  statm >> size >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+// the peak resident set size of this process in bytes
+inline uint64_t PeakRSS() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return uint64_t(usage.ru_maxrss) * 1024;
+}
+
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+#include "utils/log.h"
+
+/* Hardware performance counters per thread role, opt-in through Enable().
+ * A thread opens a counter group (user space only) for its lifetime by a thread_scope of its role,
+ * and adds the counts to the totals of the role when the scope ends; the counts are scaled up if the kernel
+ * multiplexed the group. An event the machine or the permissions (perf_event_paranoid) do not allow is left out,
+ * and if none is allowed the scopes count nothing after a single warning. */
+namespace utils::perf {
+
+enum role : size_t { MASTER, PIPE, BOARDER, WORKER, COLLECTOR, CLIENT, NUM_ROLES };
+
+static inline const char* role_name(size_t r) {
+  static const char* names[NUM_ROLES] = { "master", "pipe", "boarder", "worker", "collector", "client" };
+  return names[r];
+}
+
+enum event : size_t { CYCLES, INSTRUCTIONS, LLC_MISSES, DTLB_MISSES, BRANCH_MISSES, NUM_EVENTS };
+
+struct totals {
+  size_t num_threads = 0;
+  uint64_t counts[NUM_EVENTS] = {};
+  bool available[NUM_EVENTS] = {};
+};
+
+inline std::atomic_bool enabled{false};
+inline std::atomic_bool warned{false};
+inline std::mutex totals_mutex;
+inline totals role_totals[NUM_ROLES];
+
+// called before the threads to count are started
+static inline void Enable() {
+  enabled.store(true, std::memory_order_release);
+}
+
+class thread_scope {
+private:
+  const role role_;
+  int fds_[NUM_EVENTS];
+  int leader_;
+
+  static int open_(size_t e, int group_fd) {
+    static const uint32_t types[NUM_EVENTS] = {
+      PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+    static const uint64_t configs[NUM_EVENTS] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+      PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      PERF_COUNT_HW_BRANCH_MISSES };
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = types[e];
+    attr.config = configs[e];
+    attr.disabled = group_fd == -1; // the members follow the leader
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0 /* this thread */, -1 /* any cpu */, group_fd, 0);
+  }
+
+public:
+  explicit thread_scope(role r) : role_(r), leader_(-1) {
+    for (size_t e = 0; e < NUM_EVENTS; e++) { fds_[e] = -1; }
+    if (!enabled.load(std::memory_order_acquire)) { return; }
+    int err = 0;
+    for (size_t e = 0; e < NUM_EVENTS; e++) {
+      fds_[e] = open_(e, leader_);
+      if (fds_[e] < 0) { err = errno; }
+      else if (leader_ < 0) { leader_ = fds_[e]; } }
+    if (leader_ < 0) {
+      if (!warned.exchange(true)) {
+        log_warn("hardware counters are not available (%s), see /proc/sys/kernel/perf_event_paranoid", strerror(err)); }
+      return; }
+    ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  thread_scope(const thread_scope&) = delete;
+  thread_scope& operator=(const thread_scope&) = delete;
+
+  ~thread_scope() {
+    if (leader_ < 0) { return; }
+    ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    // { nr, time_enabled, time_running, values of the opened events in order }
+    uint64_t buf[3 + NUM_EVENTS] = {};
+    bool ok = read(leader_, buf, sizeof(buf)) > 0;
+    for (size_t e = 0; e < NUM_EVENTS; e++) { if (fds_[e] >= 0) { close(fds_[e]); } }
+    if (!ok) { return; }
+    double scale = buf[2] > 0 ? double(buf[1]) / buf[2] : 0;
+    std::lock_guard<std::mutex> lock(totals_mutex);
+    totals& t = role_totals[role_];
+    t.num_threads++;
+    for (size_t e = 0, i = 0; e < NUM_EVENTS; e++) {
+      if (fds_[e] < 0) { continue; }
+      t.counts[e] += uint64_t(buf[3 + i++] * scale);
+      t.available[e] = true; }
+  }
+};
+
+// print the counts of every role that ran per operation, after its threads have ended
+static inline void Report(std::ostream& os, uint64_t num_ops) {
+  if (!enabled.load(std::memory_order_acquire)) { return; }
+  static const char* names[NUM_EVENTS] = { "cycles", "instructions", "LLC-misses", "dTLB-misses", "branch-misses" };
+  os << "# Hardware counters per operation (role, threads";
+  for (size_t e = 0; e < NUM_EVENTS; e++) { os << ", " << names[e]; }
+  os << ", IPC)" << std::endl;
+  std::lock_guard<std::mutex> lock(totals_mutex);
+  for (size_t r = 0; r < NUM_ROLES; r++) {
+    const totals& t = role_totals[r];
+    if (t.num_threads == 0) { continue; }
+    os << role_name(r) << '\t' << t.num_threads;
+    for (size_t e = 0; e < NUM_EVENTS; e++) {
+      if (t.available[e]) { os << '\t' << double(t.counts[e]) / num_ops; }
+      else { os << "\tn/a"; } }
+    if (t.available[CYCLES] && t.available[INSTRUCTIONS] && t.counts[CYCLES] > 0) {
+      os << '\t' << double(t.counts[INSTRUCTIONS]) / t.counts[CYCLES]; }
+    else { os << "\tn/a"; }
+    os << std::endl; }
+  if (warned.load()) { os << "# (hardware counters were not available, nothing was counted)" << std::endl; }
+}
+
+}
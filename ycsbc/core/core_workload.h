@@ -11,6 +11,7 @@
 
 #include <vector>
 #include <string>
+#include <atomic>
 #include "db.h"
 #include "properties.h"
 #include "generator.h"
@@ -20,6 +21,8 @@
 #include "zipfian_generator.h"
 #include "scrambled_zipfian_generator.h"
 #include "skewed_latest_generator.h"
+#include "hotspot_generator.h"
+#include "sequential_generator.h"
 #include "const_generator.h"
 #include "utils.h"
 
@@ -107,10 +110,38 @@ class CoreWorkload {
   
   /// 
   /// The name of the property for the the distribution of request keys.
-  /// Options are "uniform", "zipfian" and "latest".
+  /// Options are "uniform", "zipfian", "latest", "hotspot", "movinghotspot"
+  /// and "sequential" (keys in order, wrapping around).
   ///
   static const std::string REQUEST_DISTRIBUTION_PROPERTY;
   static const std::string REQUEST_DISTRIBUTION_DEFAULT;
+
+  ///
+  /// The names of the properties for the fraction of the keys in the hot set
+  /// and the fraction of the requests to it, for the hotspot distributions.
+  ///
+  static const std::string HOTSPOT_DATA_FRACTION_PROPERTY;
+  static const std::string HOTSPOT_DATA_FRACTION_DEFAULT;
+  static const std::string HOTSPOT_OPN_FRACTION_PROPERTY;
+  static const std::string HOTSPOT_OPN_FRACTION_DEFAULT;
+
+  ///
+  /// The names of the properties for how many requests the moving hot set
+  /// stays before it moves (default: a tenth of the operations of the phase),
+  /// and by which fraction of the keys (default: the size of the hot set).
+  ///
+  static const std::string HOTSPOT_MOVE_INTERVAL_PROPERTY;
+  static const std::string HOTSPOT_MOVE_STEP_PROPERTY;
+
+  ///
+  /// The name of the property for the number of phases of the transactions.
+  /// Phase i (from 1) runs with the properties prefixed by "phase<i>." in place
+  /// of the unprefixed ones, e.g. phase1.operationcount, phase1.readproportion
+  /// or phase1.requestdistribution, one after another. 0 for a single phase
+  /// with the unprefixed properties. Every phase needs its own operationcount.
+  ///
+  static const std::string PHASE_COUNT_PROPERTY;
+  static const std::string PHASE_COUNT_DEFAULT;
   
   ///
   /// The name of the property for adding zero padding to record numbers in order to match 
@@ -145,11 +176,27 @@ class CoreWorkload {
   static const std::string RECORD_COUNT_PROPERTY;
   static const std::string OPERATION_COUNT_PROPERTY;
 
+  ///
+  /// The name of the property for the operations of all the phases together,
+  /// set by ResolvePhases.
+  ///
+  static const std::string TOTAL_OPERATION_COUNT_PROPERTY;
+
   ///
   /// Initialize the scenario.
   /// Called once, in the main client thread, before any operations are started.
   ///
   virtual void Init(const utils::Properties &p);
+
+  ///
+  /// The properties of phase i (from 1), see PHASE_COUNT_PROPERTY.
+  ///
+  static utils::Properties PhaseProperties(const utils::Properties &p, int i);
+
+  ///
+  /// Set the total operation count, that of the phases if there are any.
+  ///
+  static void ResolvePhases(utils::Properties &p);
   
   virtual void BuildValues(std::vector<ycsbc::DB::KVPair> &values);
   virtual void BuildUpdate(std::vector<ycsbc::DB::KVPair> &update);
@@ -157,30 +204,49 @@ class CoreWorkload {
   virtual std::string NextTable() { return table_name_; }
   virtual std::string NextSequenceKey(); /// Used for loading data
   virtual std::string NextTransactionKey(); /// Used for transactions
-  virtual Operation NextOperation() { return op_chooser_.Next(); }
+  virtual Operation NextOperation();
   virtual std::string NextFieldName();
-  virtual size_t NextScanLength() { return scan_len_chooser_->Next(); }
+  virtual size_t NextScanLength() { return phases_[phase_].scan_len_chooser->Next(); }
   
   bool read_all_fields() const { return read_all_fields_; }
   bool write_all_fields() const { return write_all_fields_; }
 
   CoreWorkload() :
       field_count_(0), read_all_fields_(false), write_all_fields_(false),
-      field_len_generator_(NULL), key_generator_(NULL), key_chooser_(NULL),
-      field_chooser_(NULL), scan_len_chooser_(NULL), insert_key_sequence_(3),
+      field_len_generator_(NULL), key_generator_(NULL), field_chooser_(NULL),
+      phase_(0), num_operations_(0), insert_key_sequence_(3),
       ordered_inserts_(true), record_count_(0) {
   }
   
   virtual ~CoreWorkload() {
     if (field_len_generator_) delete field_len_generator_;
     if (key_generator_) delete key_generator_;
-    if (key_chooser_) delete key_chooser_;
     if (field_chooser_) delete field_chooser_;
-    if (scan_len_chooser_) delete scan_len_chooser_;
+    for (Phase &phase : phases_) {
+      delete phase.op_chooser;
+      delete phase.key_chooser;
+      delete phase.scan_len_chooser;
+    }
   }
   
  protected:
+  ///
+  /// The choosers of a phase, which runs until end operations in total.
+  ///
+  struct Phase {
+    uint64_t end;
+    DiscreteGenerator<Operation> *op_chooser;
+    Generator<uint64_t> *key_chooser;
+    Generator<uint64_t> *scan_len_chooser;
+  };
+
   static Generator<uint64_t> *GetFieldLenGenerator(const utils::Properties &p);
+  ///
+  /// The operation count of phase i, which must be given for the phase itself:
+  /// the unprefixed one is that of a single phase.
+  ///
+  static uint64_t PhaseOperationCount(const utils::Properties &p, int i);
+  Phase BuildPhase(const utils::Properties &p, uint64_t end);
   std::string BuildKeyName(uint64_t key_num);
 
   std::string table_name_;
@@ -189,10 +255,10 @@ class CoreWorkload {
   bool write_all_fields_;
   Generator<uint64_t> *field_len_generator_;
   Generator<uint64_t> *key_generator_;
-  DiscreteGenerator<Operation> op_chooser_;
-  Generator<uint64_t> *key_chooser_;
   Generator<uint64_t> *field_chooser_;
-  Generator<uint64_t> *scan_len_chooser_;
+  std::vector<Phase> phases_;
+  std::atomic<size_t> phase_;
+  std::atomic<uint64_t> num_operations_;
   CounterGenerator insert_key_sequence_;
   bool ordered_inserts_;
   size_t record_count_;
@@ -235,6 +301,18 @@ const std::string CoreWorkload::READMODIFYWRITE_PROPORTION_DEFAULT = "0.0";
 const std::string CoreWorkload::REQUEST_DISTRIBUTION_PROPERTY = "requestdistribution";
 const std::string CoreWorkload::REQUEST_DISTRIBUTION_DEFAULT = "uniform";
 
+const std::string CoreWorkload::HOTSPOT_DATA_FRACTION_PROPERTY = "hotspotdatafraction";
+const std::string CoreWorkload::HOTSPOT_DATA_FRACTION_DEFAULT = "0.2";
+
+const std::string CoreWorkload::HOTSPOT_OPN_FRACTION_PROPERTY = "hotspotopnfraction";
+const std::string CoreWorkload::HOTSPOT_OPN_FRACTION_DEFAULT = "0.8";
+
+const std::string CoreWorkload::HOTSPOT_MOVE_INTERVAL_PROPERTY = "hotspotmoveinterval";
+const std::string CoreWorkload::HOTSPOT_MOVE_STEP_PROPERTY = "hotspotmovestep";
+
+const std::string CoreWorkload::PHASE_COUNT_PROPERTY = "phasecount";
+const std::string CoreWorkload::PHASE_COUNT_DEFAULT = "0";
+
 const std::string CoreWorkload::ZERO_PADDING_PROPERTY = "zeropadding";
 const std::string CoreWorkload::ZERO_PADDING_DEFAULT = "1";
 
@@ -252,6 +330,7 @@ const std::string CoreWorkload::INSERT_START_DEFAULT = "0";
 
 const std::string CoreWorkload::RECORD_COUNT_PROPERTY = "recordcount";
 const std::string CoreWorkload::OPERATION_COUNT_PROPERTY = "operationcount";
+const std::string CoreWorkload::TOTAL_OPERATION_COUNT_PROPERTY = "totaloperationcount";
 
 void CoreWorkload::Init(const utils::Properties &p) {
   table_name_ = p.GetProperty(TABLENAME_PROPERTY,TABLENAME_DEFAULT);
@@ -260,25 +339,8 @@ void CoreWorkload::Init(const utils::Properties &p) {
                                          FIELD_COUNT_DEFAULT));
   field_len_generator_ = GetFieldLenGenerator(p);
   
-  double read_proportion = std::stod(p.GetProperty(READ_PROPORTION_PROPERTY,
-                                                   READ_PROPORTION_DEFAULT));
-  double update_proportion = std::stod(p.GetProperty(UPDATE_PROPORTION_PROPERTY,
-                                                     UPDATE_PROPORTION_DEFAULT));
-  double insert_proportion = std::stod(p.GetProperty(INSERT_PROPORTION_PROPERTY,
-                                                     INSERT_PROPORTION_DEFAULT));
-  double scan_proportion = std::stod(p.GetProperty(SCAN_PROPORTION_PROPERTY,
-                                                   SCAN_PROPORTION_DEFAULT));
-  double readmodifywrite_proportion = std::stod(p.GetProperty(
-      READMODIFYWRITE_PROPORTION_PROPERTY, READMODIFYWRITE_PROPORTION_DEFAULT));
-  
   record_count_ = std::stoi(p.GetProperty(RECORD_COUNT_PROPERTY));
-  std::string request_dist = p.GetProperty(REQUEST_DISTRIBUTION_PROPERTY,
-                                           REQUEST_DISTRIBUTION_DEFAULT);
   zero_padding_ = std::stoi(p.GetProperty(ZERO_PADDING_PROPERTY, ZERO_PADDING_DEFAULT));
-  int max_scan_len = std::stoi(p.GetProperty(MAX_SCAN_LENGTH_PROPERTY,
-                                             MAX_SCAN_LENGTH_DEFAULT));
-  std::string scan_len_dist = p.GetProperty(SCAN_LENGTH_DISTRIBUTION_PROPERTY,
-                                            SCAN_LENGTH_DISTRIBUTION_DEFAULT);
   int insert_start = std::stoi(p.GetProperty(INSERT_START_PROPERTY,
                                              INSERT_START_DEFAULT));
   
@@ -295,26 +357,100 @@ void CoreWorkload::Init(const utils::Properties &p) {
   
   key_generator_ = new CounterGenerator(insert_start);
   
+  insert_key_sequence_.Set(record_count_);
+  
+  field_chooser_ = new UniformGenerator(0, field_count_ - 1);
+
+  int phase_count = std::stoi(p.GetProperty(PHASE_COUNT_PROPERTY,
+                                            PHASE_COUNT_DEFAULT));
+  if (phase_count <= 0) {
+    phases_.push_back(BuildPhase(p, std::stoull(p.GetProperty(OPERATION_COUNT_PROPERTY))));
+  }
+  uint64_t end = 0;
+  for (int i = 1; i <= phase_count; ++i) {
+    end += PhaseOperationCount(p, i);
+    phases_.push_back(BuildPhase(PhaseProperties(p, i), end));
+  }
+}
+
+utils::Properties CoreWorkload::PhaseProperties(const utils::Properties &p, int i) {
+  const std::string prefix = "phase" + std::to_string(i) + ".";
+  utils::Properties phase;
+  for (const auto &property : p.properties()) {
+    if (property.first.compare(0, 5, "phase") != 0) {
+      phase.SetProperty(property.first, property.second);
+    }
+  }
+  for (const auto &property : p.properties()) {
+    if (property.first.compare(0, prefix.size(), prefix) == 0) {
+      phase.SetProperty(property.first.substr(prefix.size()), property.second);
+    }
+  }
+  return phase;
+}
+
+void CoreWorkload::ResolvePhases(utils::Properties &p) {
+  int phase_count = std::stoi(p.GetProperty(PHASE_COUNT_PROPERTY,
+                                            PHASE_COUNT_DEFAULT));
+  if (phase_count <= 0) {
+    p.SetProperty(TOTAL_OPERATION_COUNT_PROPERTY, p.GetProperty(OPERATION_COUNT_PROPERTY));
+    return;
+  }
+  uint64_t total = 0;
+  for (int i = 1; i <= phase_count; ++i) {
+    total += PhaseOperationCount(p, i);
+  }
+  p.SetProperty(TOTAL_OPERATION_COUNT_PROPERTY, std::to_string(total));
+}
+
+uint64_t CoreWorkload::PhaseOperationCount(const utils::Properties &p, int i) {
+  std::string count = p.GetProperty("phase" + std::to_string(i) + "." + OPERATION_COUNT_PROPERTY);
+  if (count.empty()) {
+    throw utils::Exception("No operation count for phase " + std::to_string(i));
+  }
+  return std::stoull(count);
+}
+
+CoreWorkload::Phase CoreWorkload::BuildPhase(const utils::Properties &p, uint64_t end) {
+  Phase phase{end, new DiscreteGenerator<Operation>, NULL, NULL};
+
+  double read_proportion = std::stod(p.GetProperty(READ_PROPORTION_PROPERTY,
+                                                   READ_PROPORTION_DEFAULT));
+  double update_proportion = std::stod(p.GetProperty(UPDATE_PROPORTION_PROPERTY,
+                                                     UPDATE_PROPORTION_DEFAULT));
+  double insert_proportion = std::stod(p.GetProperty(INSERT_PROPORTION_PROPERTY,
+                                                     INSERT_PROPORTION_DEFAULT));
+  double scan_proportion = std::stod(p.GetProperty(SCAN_PROPORTION_PROPERTY,
+                                                   SCAN_PROPORTION_DEFAULT));
+  double readmodifywrite_proportion = std::stod(p.GetProperty(
+      READMODIFYWRITE_PROPORTION_PROPERTY, READMODIFYWRITE_PROPORTION_DEFAULT));
+  
+  std::string request_dist = p.GetProperty(REQUEST_DISTRIBUTION_PROPERTY,
+                                           REQUEST_DISTRIBUTION_DEFAULT);
+  int max_scan_len = std::stoi(p.GetProperty(MAX_SCAN_LENGTH_PROPERTY,
+                                             MAX_SCAN_LENGTH_DEFAULT));
+  std::string scan_len_dist = p.GetProperty(SCAN_LENGTH_DISTRIBUTION_PROPERTY,
+                                            SCAN_LENGTH_DISTRIBUTION_DEFAULT);
+  uint64_t op_count = std::stoull(p.GetProperty(OPERATION_COUNT_PROPERTY));
+  
   if (read_proportion > 0) {
-    op_chooser_.AddValue(READ, read_proportion);
+    phase.op_chooser->AddValue(READ, read_proportion);
   }
   if (update_proportion > 0) {
-    op_chooser_.AddValue(UPDATE, update_proportion);
+    phase.op_chooser->AddValue(UPDATE, update_proportion);
   }
   if (insert_proportion > 0) {
-    op_chooser_.AddValue(INSERT, insert_proportion);
+    phase.op_chooser->AddValue(INSERT, insert_proportion);
   }
   if (scan_proportion > 0) {
-    op_chooser_.AddValue(SCAN, scan_proportion);
+    phase.op_chooser->AddValue(SCAN, scan_proportion);
   }
   if (readmodifywrite_proportion > 0) {
-    op_chooser_.AddValue(READMODIFYWRITE, readmodifywrite_proportion);
+    phase.op_chooser->AddValue(READMODIFYWRITE, readmodifywrite_proportion);
   }
   
-  insert_key_sequence_.Set(record_count_);
-  
   if (request_dist == "uniform") {
-    key_chooser_ = new UniformGenerator(0, record_count_ - 1);
+    phase.key_chooser = new UniformGenerator(0, record_count_ - 1);
     
   } else if (request_dist == "zipfian") {
     // If the number of keys changes, we don't want to change popular keys.
@@ -322,27 +458,44 @@ void CoreWorkload::Init(const utils::Properties &p) {
     // that is larger than what exists at the beginning of the test.
     // If the generator picks a key that is not inserted yet, we just ignore it
     // and pick another key.
-    int op_count = std::stoi(p.GetProperty(OPERATION_COUNT_PROPERTY));
     int new_keys = (int)(op_count * insert_proportion * 2); // a fudge factor
-    key_chooser_ = new ScrambledZipfianGenerator(record_count_ + new_keys);
+    phase.key_chooser = new ScrambledZipfianGenerator(record_count_ + new_keys);
     
   } else if (request_dist == "latest") {
-    key_chooser_ = new SkewedLatestGenerator(insert_key_sequence_);
+    phase.key_chooser = new SkewedLatestGenerator(insert_key_sequence_);
+    
+  } else if (request_dist == "hotspot" || request_dist == "movinghotspot") {
+    double hot_data_fraction = std::stod(p.GetProperty(
+        HOTSPOT_DATA_FRACTION_PROPERTY, HOTSPOT_DATA_FRACTION_DEFAULT));
+    double hot_opn_fraction = std::stod(p.GetProperty(
+        HOTSPOT_OPN_FRACTION_PROPERTY, HOTSPOT_OPN_FRACTION_DEFAULT));
+    uint64_t move_interval = 0;
+    uint64_t move_step = 0;
+    if (request_dist == "movinghotspot") {
+      move_interval = std::stoull(p.GetProperty(HOTSPOT_MOVE_INTERVAL_PROPERTY,
+          std::to_string(std::max<uint64_t>(op_count / 10, 1))));
+      move_step = record_count_ * std::stod(p.GetProperty(
+          HOTSPOT_MOVE_STEP_PROPERTY, std::to_string(hot_data_fraction)));
+    }
+    phase.key_chooser = new HotspotGenerator(0, record_count_ - 1,
+        hot_data_fraction, hot_opn_fraction, move_interval, move_step);
+    
+  } else if (request_dist == "sequential") {
+    phase.key_chooser = new SequentialGenerator(0, record_count_ - 1);
     
   } else {
     throw utils::Exception("Unknown request distribution: " + request_dist);
   }
   
-  field_chooser_ = new UniformGenerator(0, field_count_ - 1);
-  
   if (scan_len_dist == "uniform") {
-    scan_len_chooser_ = new UniformGenerator(1, max_scan_len);
+    phase.scan_len_chooser = new UniformGenerator(1, max_scan_len);
   } else if (scan_len_dist == "zipfian") {
-    scan_len_chooser_ = new ZipfianGenerator(1, max_scan_len);
+    phase.scan_len_chooser = new ZipfianGenerator(1, max_scan_len);
   } else {
     throw utils::Exception("Distribution not allowed for scan length: " +
         scan_len_dist);
   }
+  return phase;
 }
 
 ycsbc::Generator<uint64_t> *CoreWorkload::GetFieldLenGenerator(
@@ -384,10 +537,21 @@ inline std::string CoreWorkload::NextSequenceKey() {
   return BuildKeyName(key_num);
 }
 
+inline Operation CoreWorkload::NextOperation() {
+  // the key and the scan length of the operation are chosen in its phase too
+  uint64_t n = num_operations_.fetch_add(1);
+  size_t phase = phase_.load();
+  while (phase + 1 < phases_.size() && n >= phases_[phase].end) {
+    ++phase;
+  }
+  phase_.store(phase);
+  return phases_[phase].op_chooser->Next();
+}
+
 inline std::string CoreWorkload::NextTransactionKey() {
   uint64_t key_num;
   do {
-    key_num = key_chooser_->Next();
+    key_num = phases_[phase_].key_chooser->Next();
   } while (key_num > insert_key_sequence_.Last());
   return BuildKeyName(key_num);
 }
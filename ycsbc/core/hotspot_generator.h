@@ -0,0 +1,72 @@
+//
+//  hotspot_generator.h
+//  YCSB-C
+//
+
+#ifndef YCSB_C_HOTSPOT_GENERATOR_H_
+#define YCSB_C_HOTSPOT_GENERATOR_H_
+
+#include "generator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <random>
+
+namespace ycsbc {
+
+//
+// Keys in [min, max], of which a hot set of hot_data_fraction of them takes
+// hot_op_fraction of the requests, uniformly within the hot and the cold set.
+// The hot set starts at min and, if move_interval is not 0, moves up by
+// move_step keys (wrapping around) every move_interval requests.
+//
+class HotspotGenerator : public Generator<uint64_t> {
+ public:
+  HotspotGenerator(uint64_t min, uint64_t max, double hot_data_fraction,
+                   double hot_op_fraction, uint64_t move_interval = 0,
+                   uint64_t move_step = 0) :
+      min_(min), num_keys_(max - min + 1),
+      num_hot_(std::clamp<uint64_t>(num_keys_ * hot_data_fraction, 1, num_keys_)),
+      hot_op_fraction_(hot_op_fraction), move_interval_(move_interval),
+      move_step_(move_step % num_keys_), num_requests_(0), last_(min) {
+  }
+
+  uint64_t Next();
+  uint64_t Last() { return last_; }
+
+ private:
+  const uint64_t min_;
+  const uint64_t num_keys_;
+  const uint64_t num_hot_;
+  const double hot_op_fraction_;
+  const uint64_t move_interval_;
+  const uint64_t move_step_;
+  uint64_t num_requests_;
+  std::mt19937_64 generator_;
+  std::uniform_real_distribution<double> chooser_;
+  std::atomic<uint64_t> last_;
+  std::mutex mutex_;
+};
+
+inline uint64_t HotspotGenerator::Next() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t offset = 0;
+  if (move_interval_ > 0) {
+    // (moves * step) mod keys, without overflowing
+    uint64_t moves = num_requests_++ / move_interval_ % num_keys_;
+    offset = static_cast<uint64_t>((unsigned __int128)moves * move_step_ % num_keys_);
+  }
+  uint64_t key;
+  if (num_hot_ == num_keys_ || chooser_(generator_) < hot_op_fraction_) {
+    key = std::uniform_int_distribution<uint64_t>(0, num_hot_ - 1)(generator_);
+  } else {
+    key = std::uniform_int_distribution<uint64_t>(num_hot_, num_keys_ - 1)(generator_);
+  }
+  return last_ = min_ + (key + offset) % num_keys_;
+}
+
+} // ycsbc
+
+#endif // YCSB_C_HOTSPOT_GENERATOR_H_
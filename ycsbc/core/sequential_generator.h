@@ -0,0 +1,38 @@
+//
+//  sequential_generator.h
+//  YCSB-C
+//
+
+#ifndef YCSB_C_SEQUENTIAL_GENERATOR_H_
+#define YCSB_C_SEQUENTIAL_GENERATOR_H_
+
+#include "generator.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace ycsbc {
+
+//
+// Keys in [min, max] in order, starting over from min after max, so that
+// consecutive scans sweep the key space.
+//
+class SequentialGenerator : public Generator<uint64_t> {
+ public:
+  SequentialGenerator(uint64_t min, uint64_t max) :
+      min_(min), num_keys_(max - min + 1), counter_(0), last_(min) {
+  }
+
+  uint64_t Next() { return last_ = min_ + counter_.fetch_add(1) % num_keys_; }
+  uint64_t Last() { return last_; }
+
+ private:
+  const uint64_t min_;
+  const uint64_t num_keys_;
+  std::atomic<uint64_t> counter_;
+  std::atomic<uint64_t> last_;
+};
+
+} // ycsbc
+
+#endif // YCSB_C_SEQUENTIAL_GENERATOR_H_
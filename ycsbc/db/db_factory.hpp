@@ -27,7 +27,7 @@ public:
         return new Export(
           "export/" + props["filename"] + ".data",
           std::stoi(props.GetProperty(CoreWorkload::RECORD_COUNT_PROPERTY, "0")),
-          std::stoi(props.GetProperty(CoreWorkload::OPERATION_COUNT_PROPERTY, "0")),
+          std::stoi(props.GetProperty(CoreWorkload::TOTAL_OPERATION_COUNT_PROPERTY, "0")),
           props.GetProperty("updatedelete", "false") == "true"); } 
       else return NULL; }
     catch (const std::string &message) {
@@ -0,0 +1,45 @@
+recordcount=100000000
+workload=com.yahoo.ycsb.workloads.CoreWorkload
+
+readallfields=false
+fieldcount=0
+fieldlength=0
+
+readproportion=0
+insertproportion=0
+
+insertorder=ordered
+
+maxscanlength=10000000
+scanlengthdistribution=uniform
+
+# a day in phases, which run one after another in the exported trace
+phasecount=4
+
+# night: few updates, scans all over the key space
+phase1.operationcount=2000000
+phase1.updateproportion=0.1
+phase1.scanproportion=0.9
+phase1.requestdistribution=uniform
+
+# morning: the updates pick up on a hot set that drifts through the key space
+phase2.operationcount=3000000
+phase2.updateproportion=0.5
+phase2.scanproportion=0.5
+phase2.requestdistribution=movinghotspot
+phase2.hotspotdatafraction=0.01
+phase2.hotspotopnfraction=0.9
+phase2.hotspotmoveinterval=100000
+
+# peak: update heavy and skewed
+phase3.operationcount=3000000
+phase3.updateproportion=0.9
+phase3.scanproportion=0.1
+phase3.requestdistribution=zipfian
+
+# evening: reports sweeping the key space in order
+phase4.operationcount=2000000
+phase4.updateproportion=0.3
+phase4.scanproportion=0.7
+phase4.requestdistribution=sequential
+phase4.maxscanlength=100000
@@ -0,0 +1,24 @@
+recordcount=100000000
+operationcount=10000000
+workload=com.yahoo.ycsb.workloads.CoreWorkload
+
+readallfields=false
+fieldcount=0
+fieldlength=0
+
+readproportion=0
+updateproportion=0.5
+scanproportion=0.5
+insertproportion=0
+
+insertorder=ordered
+
+maxscanlength=10000000
+scanlengthdistribution=uniform
+
+# the hot set moves to the next 1% of the keys every 100000 operations
+requestdistribution=movinghotspot
+hotspotdatafraction=0.01
+hotspotopnfraction=0.9
+hotspotmoveinterval=100000
+hotspotmovestep=0.01
@@ -0,0 +1,19 @@
+recordcount=100000000
+operationcount=10000000
+workload=com.yahoo.ycsb.workloads.CoreWorkload
+
+readallfields=false
+fieldcount=0
+fieldlength=0
+
+readproportion=0
+updateproportion=0
+scanproportion=1
+insertproportion=0
+
+insertorder=ordered
+
+maxscanlength=10000
+scanlengthdistribution=uniform
+
+requestdistribution=sequential
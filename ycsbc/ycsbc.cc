@@ -42,6 +42,7 @@ int DelegateClient(ycsbc::DB *db, ycsbc::CoreWorkload *wl, const int num_ops,
 int main(const int argc, const char *argv[]) {
   utils::Properties props;
   string file_name = ParseCommandLine(argc, argv, props);
+  ycsbc::CoreWorkload::ResolvePhases(props);
 
   ycsbc::DB *db = ycsbc::DBFactory::CreateDB(props);
   if (!db) {
@@ -72,7 +73,7 @@ int main(const int argc, const char *argv[]) {
 
   // Peforms transactions
   actual_ops.clear();
-  total_ops = stoi(props[ycsbc::CoreWorkload::OPERATION_COUNT_PROPERTY]);
+  total_ops = stoi(props[ycsbc::CoreWorkload::TOTAL_OPERATION_COUNT_PROPERTY]);
   utils::Timer<double> timer;
   timer.Start();
   for (int i = 0; i < num_threads; ++i) {